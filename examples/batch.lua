@@ -0,0 +1,71 @@
+#!/usr/bin/env lua
+-- MoonCCD example: batch.lua
+-- Checks gjk_intersect_batch() against gjk_intersect() on pairs of native shapes of
+-- small and of very different sizes, placed so that they either clearly intersect
+-- or are clearly separated.
+local ccd = require("moonccd")
+
+math.randomseed(1234)
+local N = 2000 -- number of pairs
+
+local function rand(a, b) return a + (b-a)*math.random() end
+local function randvec(a, b) return { rand(a, b), rand(a, b), rand(a, b) } end
+local function randdir() return ccd.vnormalize(randvec(-1, 1)) end
+local function randrot() return ccd.qset_angle_axis(rand(0, math.pi), randdir()) end
+
+-- Random shape of the given size, containing the origin of its local frame.
+-- Returns the shape and the radius of a sphere centered at its position that contains it.
+local function randshape(size)
+   local kind = math.random(4)
+   if kind == 1 then
+      local r = size*rand(0.5, 1)
+      return ccd.sphere(r), r
+   elseif kind == 2 then
+      local r, h = size*rand(0.2, 0.5), size*rand(0.2, 0.5)
+      return ccd.capsule(r, h), r + h
+   elseif kind == 3 then
+      local half = ccd.vscale(randvec(0.2, 0.6), size)
+      return ccd.box(half), math.sqrt(ccd.vlen2(half))
+   end
+   local points, radius = {}, 0
+   for i = 1, 4 do -- symmetric points, so that the hull contains the origin
+      local p = ccd.vscale(randvec(-0.6, 0.6), size)
+      points[2*i-1], points[2*i] = p, ccd.vscale(p, -1)
+      radius = math.max(radius, math.sqrt(ccd.vlen2(p)))
+   end
+   return ccd.convex(points), radius
+end
+
+local SCALES = { 1e-3, 1e-2, 1 }
+local ccdpar = ccd.new({ max_iterations = 100 })
+local pairs_, expected = {}, {}
+for i = 1, N do
+   local size1 = SCALES[math.random(#SCALES)]
+   local size2 = math.random() < 0.5 and size1 or SCALES[math.random(#SCALES)]
+   local obj1, r1 = randshape(size1)
+   local obj2, r2 = randshape(size2)
+   local pos1 = ccd.vscale(randvec(-1, 1), size1)
+   local pos2
+   if math.random() < 0.5 then
+      -- the position of obj2 is inside obj1 (and vice versa for the origin of obj2)
+      expected[i] = true
+      pos2 = pos1
+   else
+      -- the bounding spheres are separated by a gap of 5% to 50% of their radii
+      expected[i] = false
+      pos2 = ccd.vadd(pos1, ccd.vscale(randdir(), (r1 + r2)*rand(1.05, 1.5)))
+   end
+   obj1:set_pose(pos1, randrot())
+   obj2:set_pose(pos2, randrot())
+   pairs_[i] = { obj1, obj2 }
+end
+
+local results = ccd.gjk_intersect_batch(ccdpar, pairs_)
+for i, p in ipairs(pairs_) do
+   local single = ccd.gjk_intersect(ccdpar, p[1], p[2])
+   assert(single == expected[i])
+   assert(results[i] == single, string.format("pair %d (%s/%s): batch=%s, single=%s",
+      i, p[1]:kind(), p[2]:kind(), tostring(results[i]), tostring(single)))
+end
+
+for _, p in ipairs(pairs_) do p[1]:free() p[2]:free() end
@@ -0,0 +1,131 @@
+#!/usr/bin/env lua
+-- MoonCCD example: broadphase.lua
+-- Runs all the kinds of broadphase on the same random boxes, and checks their
+-- pairs and region queries against brute-force loops over all the boxes.
+local ccd = require("moonccd")
+
+math.randomseed(1234)
+local N = 300 -- number of boxes
+
+local function rand(a, b) return a + (b-a)*math.random() end
+
+-- Random box with center in [-20, 20]^3 and sizes from 0.1 to 4 (mostly small):
+local function randbox()
+   local min, max = {}, {}
+   for i = 1, 3 do
+      local c, half = rand(-20, 20), 0.05 + 1.95*math.random()^3
+      min[i], max[i] = c - half, c + half
+   end
+   return min, max
+end
+
+local function overlap(min1, max1, min2, max2)
+   for i = 1, 3 do
+      if min1[i] > max2[i] or min2[i] > max1[i] then return false end
+   end
+   return true
+end
+
+local function pairkey(id1, id2)
+   if id1 > id2 then id1, id2 = id2, id1 end
+   return string.format("%d:%d", id1, id2)
+end
+
+local function sameset(set1, set2)
+   for k in pairs(set1) do if not set2[k] then return false end end
+   for k in pairs(set2) do if not set1[k] then return false end end
+   return true
+end
+
+local broadphases = {
+   ccd.sap(),
+   ccd.aabb_tree(),
+   ccd.spatial_hash(1.0),
+   ccd.hgrid(0.1),
+   ccd.parallel_sap('auto', 2),
+}
+
+-- The boxes, indexed by id (all the broadphases assign the same ids, since they see
+-- the same sequence of insertions and removals):
+local boxmin, boxmax = {}, {}
+local count = 0
+
+local function insert()
+   local min, max = randbox()
+   local id
+   for _, bp in ipairs(broadphases) do
+      local id1 = bp:insert(count+1, min, max)
+      assert(id == nil or id1 == id)
+      id = id1
+   end
+   boxmin[id], boxmax[id] = min, max
+   count = count + 1
+end
+
+local function remove(id)
+   for _, bp in ipairs(broadphases) do bp:remove(id) end
+   boxmin[id], boxmax[id] = nil, nil
+   count = count - 1
+end
+
+local function check_pairs()
+   local expected, ids = {}, {}
+   for id in pairs(boxmin) do ids[#ids+1] = id end
+   for i = 1, #ids-1 do
+      for j = i+1, #ids do
+         local id1, id2 = ids[i], ids[j]
+         if overlap(boxmin[id1], boxmax[id1], boxmin[id2], boxmax[id2]) then
+            expected[pairkey(id1, id2)] = true
+         end
+      end
+   end
+   for _, bp in ipairs(broadphases) do
+      local found = {}
+      for _, p in ipairs(bp:pairs(true)) do
+         local key = pairkey(p[1], p[2])
+         assert(not found[key], bp:kind()..": duplicate pair "..key)
+         found[key] = true
+      end
+      assert(bp:count() == count)
+      assert(sameset(found, expected), bp:kind()..": wrong pairs")
+   end
+end
+
+local function check_query(min, max)
+   local expected = {}
+   for id in pairs(boxmin) do
+      if overlap(min, max, boxmin[id], boxmax[id]) then expected[id] = true end
+   end
+   for _, bp in ipairs(broadphases) do
+      local found = {}
+      for _, id in ipairs(bp:query(min, max, true)) do found[id] = true end
+      assert(sameset(found, expected), bp:kind()..": wrong query")
+   end
+end
+
+for i = 1, N do insert() end
+
+for frame = 1, 10 do
+   check_pairs()
+   for i = 1, 10 do check_query(randbox()) end
+   -- move the boxes, some by small and some by large amounts:
+   local buffer = {}
+   for id, min in pairs(boxmin) do
+      local max, d = boxmax[id], math.random() < 0.9 and 0.2 or 10
+      for i = 1, 3 do
+         local delta = rand(-d, d)
+         min[i], max[i] = min[i] + delta, max[i] + delta
+         buffer[6*(id-1)+i], buffer[6*(id-1)+3+i] = min[i], max[i]
+      end
+   end
+   for _, bp in ipairs(broadphases) do bp:update_all(buffer) end
+   -- remove some boxes and insert new ones (reusing the ids):
+   for i = 1, 10 do
+      local id = math.random(N)
+      if boxmin[id] then remove(id) end
+   end
+   while count < N do insert() end
+end
+check_pairs()
+
+for _, bp in ipairs(broadphases) do bp:free() end
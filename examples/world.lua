@@ -0,0 +1,198 @@
+#!/usr/bin/env lua
+-- MoonCCD example: world.lua
+-- Checks the results of the world queries against brute-force loops over the
+-- shapes of a small random scene, using the collision detection functions directly.
+local ccd = require("moonccd")
+
+math.randomseed(1234)
+local N = 40     -- number of shapes in the scene
+local TOL = 1e-4 -- tolerance for the distances (loose enough for single precision)
+
+local function rand(a, b) return a + (b-a)*math.random() end
+local function randvec(a, b) return { rand(a, b), rand(a, b), rand(a, b) } end
+local function randrot()
+   return ccd.qset_angle_axis(rand(0, math.pi), ccd.vnormalize(randvec(0.1, 1)))
+end
+
+local function randshape()
+   local kind, shape = math.random(4)
+   if kind == 1 then
+      shape = ccd.sphere(rand(0.2, 1))
+   elseif kind == 2 then
+      shape = ccd.capsule(rand(0.2, 0.5), rand(0.2, 1))
+   elseif kind == 3 then
+      shape = ccd.box(randvec(0.2, 1))
+   else
+      local points = {}
+      for i = 1, 8 do points[i] = randvec(-0.8, 0.8) end
+      shape = ccd.convex(points)
+   end
+   shape:set_pose(randvec(-5, 5), randrot())
+   return shape
+end
+
+-- Sets of ids and of pairs of ids:
+local function toset(list, n)
+   local set = {}
+   for i = 1, n do set[list[i]] = true end
+   return set
+end
+
+local function pairkey(id1, id2)
+   if id1 > id2 then id1, id2 = id2, id1 end
+   return string.format("%d:%d", id1, id2)
+end
+
+local function sameset(set1, set2)
+   for k in pairs(set1) do if not set2[k] then return false end end
+   for k in pairs(set2) do if not set1[k] then return false end end
+   return true
+end
+
+-- Create the scene:
+local ccdpar = ccd.new({})
+local world = ccd.world(ccdpar, { algorithm = 'gjk' })
+local ids = {}
+for i = 1, N do ids[i] = world:add(randshape()) end
+assert(world:count() == N)
+
+-- step(): the contacts must be the pairs for which gjk_penetration() finds a contact
+local function check_step()
+   local n, buffer = world:step()
+   local found, expected = {}, {}
+   for i = 0, n-1 do
+      local id1, id2 = buffer[9*i+1], buffer[9*i+2]
+      assert(id1 < id2)
+      found[pairkey(id1, id2)] = true
+   end
+   for i = 1, N-1 do
+      for j = i+1, N do
+         if ccd.gjk_penetration(ccdpar, world:object(ids[i]), world:object(ids[j])) then
+            expected[pairkey(ids[i], ids[j])] = true
+         end
+      end
+   end
+   assert(sameset(found, expected))
+   return n
+end
+
+-- Region queries: the results must be the shapes that intersect the region
+local function brute_overlap(region)
+   local expected = {}
+   for _, id in ipairs(ids) do
+      if ccd.gjk_intersect(ccdpar, region, world:object(id)) then expected[id] = true end
+   end
+   return expected
+end
+
+local function check_overlap_box(min, max)
+   local n, found = world:overlap_box(min, max)
+   local region = ccd.box(ccd.vscale(ccd.vsub(max, min), 0.5))
+   region:set_pose(ccd.vscale(ccd.vadd(min, max), 0.5), {1, 0, 0, 0})
+   assert(sameset(toset(found, n), brute_overlap(region)))
+   region:free()
+end
+
+local function check_overlap_sphere(center, radius)
+   local n, found = world:overlap_sphere(center, radius)
+   local region = ccd.sphere(radius)
+   region:set_pose(center, {1, 0, 0, 0})
+   assert(sameset(toset(found, n), brute_overlap(region)))
+   region:free()
+end
+
+local function check_overlap(region)
+   local n, found = world:overlap(region)
+   assert(sameset(toset(found, n), brute_overlap(region)))
+end
+
+-- nearest(): the distances must be the k least ones among the distances computed by
+-- pair:distance(), and each of them must be the distance of the returned shape.
+-- For a point query, the brute-force loop uses a tiny sphere in place of the point.
+local function check_nearest(query, k, maxdist)
+   local n, found, dists = world:nearest(query, k, maxdist)
+   local probe, all, dist = query, {}, {}
+   if type(query) == 'table' then
+      probe = ccd.sphere(1e-6)
+      probe:set_pose(query, {1, 0, 0, 0})
+   end
+   for _, id in ipairs(ids) do
+      local pair = ccd.pair(ccdpar, probe, world:object(id))
+      dist[id] = pair:distance()
+      pair:free()
+      if dist[id] <= (maxdist or math.huge) then all[#all+1] = dist[id] end
+   end
+   if probe ~= query then probe:free() end
+   table.sort(all)
+   assert(n == math.min(k, #all))
+   local seen = {}
+   for i = 1, n do
+      assert(not seen[found[i]])
+      seen[found[i]] = true
+      assert(math.abs(dists[i] - all[i]) < TOL)
+      assert(math.abs(dists[i] - dist[found[i]]) < TOL)
+      if i > 1 then assert(dists[i-1] <= dists[i]) end
+   end
+end
+
+for frame = 1, 10 do
+   check_step()
+   for i = 1, 5 do
+      local min = randvec(-6, 4)
+      check_overlap_box(min, ccd.vadd(min, randvec(0.5, 3)))
+      check_overlap_sphere(randvec(-6, 6), rand(0.5, 3))
+      local region = randshape()
+      check_overlap(region)
+      check_nearest(region, math.random(5))
+      check_nearest(region, math.random(5), rand(0, 2))
+      check_nearest(randvec(-6, 6), math.random(5))
+      region:free()
+   end
+   -- move the shapes for the next frame:
+   for _, id in ipairs(ids) do
+      local shape = world:object(id)
+      local pos, rot = shape:pose()
+      shape:set_pose(ccd.vadd(pos, randvec(-0.3, 0.3)), ccd.qnormalize(ccd.qmul(rot, randrot())))
+   end
+end
+
+-- Freeing a world must release only its own references to the ccdpar and broadphase.
+-- The live entries of the registry must be left untouched, and new references must
+-- still be distinct (a slot released twice would be handed out twice).
+local function snapshot()
+   local snap = {}
+   for k, v in pairs(debug.getregistry()) do
+      if type(k) == 'number' and type(v) ~= 'number' then snap[k] = v end
+   end
+   return snap
+end
+
+local snap = snapshot()
+for i = 1, 3 do
+   local par, bp = ccd.new({}), ccd.sap()
+   local w = ccd.world(par, { broadphase = bp })
+   for j = 1, 10 do w:add(randshape()) end
+   w:step()
+   w:free()
+   bp:free()
+   par:free()
+end
+
+-- Create many new references: each pair refers to its ccdpar and to its two objects
+local origin = ccd.sphere(1)
+local probes = {}
+for i = 1, 20 do
+   local sphere = ccd.sphere(1)
+   sphere:set_pose({3*i, 0, 0}, {1, 0, 0, 0})
+   probes[i] = ccd.pair(ccdpar, origin, sphere)
+end
+for i = 1, 20 do
+   assert(math.abs(probes[i]:distance() - (3*i-2)) < TOL)
+end
+local reg = debug.getregistry()
+for k, v in pairs(snap) do assert(rawequal(reg[k], v)) end
+for i = 1, 20 do probes[i]:free() end
+
+-- The world still works:
+check_step()
+world:free()
@@ -0,0 +1,173 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/*------------------------------------------------------------------------------*
+ | Axis-aligned bounding boxes                                                  |
+ *------------------------------------------------------------------------------*/
+
+int testaabb(lua_State *L, int arg, aabb_t *box)
+/* Reads the box given as two vec3 (min and max) at arg and arg+1 */
+    {
+    int i, ec;
+    if((ec = testvec3(L, arg, &box->min)) != 0) return ec;
+    if((ec = testvec3(L, arg+1, &box->max)) != 0) return ec;
+    for(i = 0; i < 3; i++)
+        if(box->min.v[i] > box->max.v[i]) return ERR_VALUE;
+    return 0;
+    }
+
+int checkaabb(lua_State *L, int arg, aabb_t *box)
+    {
+    int ec = testaabb(L, arg, box);
+    if(ec) return argerror(L, arg, ec);
+    return ec;
+    }
+
+void pushaabb(lua_State *L, const aabb_t *box)
+    {
+    pushvec3(L, &box->min);
+    pushvec3(L, &box->max);
+    }
+
+real_t aabb_distance(const aabb_t *a, const aabb_t *b)
+/* Distance between the boxes a and b (0 if they overlap) */
+    {
+    int i;
+    real_t d, d2 = CCD_ZERO;
+    for(i = 0; i < 3; i++)
+        {
+        d = a->min.v[i] - b->max.v[i];
+        if(d <= CCD_ZERO) d = b->min.v[i] - a->max.v[i];
+        if(d > CCD_ZERO) d2 += d*d;
+        }
+    return CCD_SQRT(d2);
+    }
+
+void aabb_support(const void *obj, ccd_support_fn support, aabb_t *box)
+/* Computes the bounding box of obj from its support points along the axes */
+    {
+    int i;
+    vec3_t dir, p;
+    for(i = 0; i < 3; i++)
+        {
+        ccdVec3Set(&dir, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+        dir.v[i] = CCD_ONE;
+        support(obj, &dir, &p);
+        box->max.v[i] = p.v[i];
+        dir.v[i] = -CCD_ONE;
+        support(obj, &dir, &p);
+        box->min.v[i] = p.v[i];
+        }
+    }
+
+static void Axes(const shape_t *shape, vec3_t axis[3])
+/* Columns of the rotation matrix of the shape (its local axes in the global frame) */
+    {
+    int j;
+    for(j = 0; j < 3; j++)
+        {
+        ccdVec3Set(&axis[j], CCD_ZERO, CCD_ZERO, CCD_ZERO);
+        axis[j].v[j] = CCD_ONE;
+        ccdQuatRotVec(&axis[j], &shape->quat);
+        }
+    }
+
+static void ShapeBox(const shape_t *shape, aabb_t *box)
+/* Closed-form bounding box of a shape */
+    {
+    int i, j, k;
+    real_t ext, p;
+    vec3_t axis[3];
+    switch(shape->kind)
+        {
+        case SHAPE_SPHERE:
+            for(i = 0; i < 3; i++)
+                {
+                box->min.v[i] = shape->pos.v[i] - shape->radius;
+                box->max.v[i] = shape->pos.v[i] + shape->radius;
+                }
+            return;
+        case SHAPE_CAPSULE: /* segment along the local z axis, inflated by the radius */
+            Axes(shape, axis);
+            for(i = 0; i < 3; i++)
+                {
+                ext = CCD_FABS(axis[2].v[i])*shape->half_height + shape->radius;
+                box->min.v[i] = shape->pos.v[i] - ext;
+                box->max.v[i] = shape->pos.v[i] + ext;
+                }
+            return;
+        case SHAPE_BOX:
+            Axes(shape, axis);
+            for(i = 0; i < 3; i++)
+                {
+                ext = CCD_ZERO;
+                for(j = 0; j < 3; j++)
+                    ext += CCD_FABS(axis[j].v[i])*shape->half.v[j];
+                box->min.v[i] = shape->pos.v[i] - ext;
+                box->max.v[i] = shape->pos.v[i] + ext;
+                }
+            return;
+        case SHAPE_CONVEX: /* one pass over the rotated points, instead of six support queries */
+            Axes(shape, axis);
+            for(i = 0; i < 3; i++)
+                {
+                box->min.v[i] = CCD_REAL_MAX;
+                box->max.v[i] = -CCD_REAL_MAX;
+                }
+            for(k = 0; k < shape->count; k++)
+                {
+                for(i = 0; i < 3; i++)
+                    {
+                    p = axis[0].v[i]*shape->points[k].v[0] + axis[1].v[i]*shape->points[k].v[1] +
+                        axis[2].v[i]*shape->points[k].v[2];
+                    if(p < box->min.v[i]) box->min.v[i] = p;
+                    if(p > box->max.v[i]) box->max.v[i] = p;
+                    }
+                }
+            ccdVec3Add(&box->min, &shape->pos);
+            ccdVec3Add(&box->max, &shape->pos);
+            return;
+        case SHAPE_PLANE: /* unbounded */
+            ccdVec3Set(&box->min, -CCD_REAL_MAX, -CCD_REAL_MAX, -CCD_REAL_MAX);
+            ccdVec3Set(&box->max, CCD_REAL_MAX, CCD_REAL_MAX, CCD_REAL_MAX);
+            return;
+        default:
+            aabb_support(shape, shape_support, box);
+        }
+    }
+
+void shape_aabb(shape_t *shape, aabb_t *box)
+/* Bounding box of a shape, cached until its pose changes */
+    {
+    if(shape->boxversion != shape->version)
+        {
+        ShapeBox(shape, &shape->box);
+        shape->boxversion = shape->version;
+        }
+    *box = shape->box;
+    }
+
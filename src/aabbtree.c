@@ -0,0 +1,475 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* Dynamic AABB tree broadphase.
+ *
+ * A binary tree whose leaves are the objects' boxes, fattened by a margin and extended
+ * in the direction of motion, and whose internal nodes are the unions of their children.
+ * An object whose box is still contained in the fat box of its leaf does not need to
+ * be moved in the tree; otherwise its leaf is removed and reinserted.
+ *
+ * Leaves are inserted next to the sibling that minimizes the increase in surface area
+ * of the tree (branch and bound descent), and the tree is kept balanced by AVL-style
+ * rotations on the way back to the root (see Erin Catto's b2DynamicTree in Box2D).
+ *
+ * The nodes are stored in a contiguous pool and referenced by index, with a free list.
+ */
+
+#define NIL (-1)
+
+typedef struct {
+    aabb_t box;     /* fat box (leaves), or union of the children */
+    int parent;     /* parent node (also used as next node in the free list) */
+    int child1, child2; /* children (child1 = NIL for leaves) */
+    int height;     /* 0 for leaves, NIL for free nodes */
+    int id;         /* object id (leaves) */
+} node_t;
+
+typedef struct {
+    real_t margin;      /* fattening margin */
+    real_t prediction;  /* displacement multiplier */
+    node_t *nodes;      /* node pool */
+    int size;           /* allocated nodes */
+    int freenode;       /* first free node */
+    int root;
+    int slots;          /* allocated ids (= bp->size) */
+    int *leaf;          /* leaf[id] = leaf node of object id */
+    vec3_t *center;     /* center[id] = center of the box at the last update */
+    int *stack;         /* traversal stack */
+    int stacksize;
+} tree_t;
+
+#define IsLeaf(node) ((node)->child1 == NIL)
+
+static void Union(aabb_t *dst, const aabb_t *a, const aabb_t *b)
+    {
+    int i;
+    for(i = 0; i < 3; i++)
+        {
+        dst->min.v[i] = a->min.v[i] < b->min.v[i] ? a->min.v[i] : b->min.v[i];
+        dst->max.v[i] = a->max.v[i] > b->max.v[i] ? a->max.v[i] : b->max.v[i];
+        }
+    }
+
+static real_t Area(const aabb_t *box)
+/* Surface area (halved) */
+    {
+    real_t x = box->max.v[0] - box->min.v[0];
+    real_t y = box->max.v[1] - box->min.v[1];
+    real_t z = box->max.v[2] - box->min.v[2];
+    return x*y + y*z + z*x;
+    }
+
+static int Contains(const aabb_t *a, const aabb_t *b)
+/* 1 if a contains b */
+    {
+    int i;
+    for(i = 0; i < 3; i++)
+        if(b->min.v[i] < a->min.v[i] || b->max.v[i] > a->max.v[i]) return 0;
+    return 1;
+    }
+
+static void Center(const aabb_t *box, vec3_t *c)
+    {
+    int i;
+    for(i = 0; i < 3; i++)
+        c->v[i] = (box->min.v[i] + box->max.v[i])/2;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Node pool                                                                    |
+ *------------------------------------------------------------------------------*/
+
+static int AllocNode(lua_State *L, tree_t *tree)
+/* Note that this may move the pool */
+    {
+    int i, node, size;
+    if(tree->freenode == NIL)
+        {
+        size = tree->size ? 2*tree->size : 64;
+        tree->nodes = Realloc(L, tree->nodes, tree->size*sizeof(node_t), size*sizeof(node_t));
+        for(i = tree->size; i < size; i++)
+            {
+            tree->nodes[i].parent = i+1 < size ? i+1 : NIL;
+            tree->nodes[i].height = NIL;
+            }
+        tree->freenode = tree->size;
+        tree->size = size;
+        }
+    node = tree->freenode;
+    tree->freenode = tree->nodes[node].parent;
+    tree->nodes[node].parent = NIL;
+    tree->nodes[node].child1 = tree->nodes[node].child2 = NIL;
+    tree->nodes[node].height = 0;
+    tree->nodes[node].id = 0;
+    return node;
+    }
+
+static void FreeNode(tree_t *tree, int node)
+    {
+    tree->nodes[node].parent = tree->freenode;
+    tree->nodes[node].height = NIL;
+    tree->freenode = node;
+    }
+
+static int *Push(lua_State *L, tree_t *tree, int *sp)
+/* Makes room for 2 more entries on the traversal stack */
+    {
+    int n = sp - tree->stack;
+    if(n + 2 > tree->stacksize)
+        {
+        int size = 2*tree->stacksize;
+        tree->stack = Realloc(L, tree->stack, tree->stacksize*sizeof(int), size*sizeof(int));
+        tree->stacksize = size;
+        }
+    return tree->stack + n;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Insertion, removal and balancing                                             |
+ *------------------------------------------------------------------------------*/
+
+static void Replace(tree_t *tree, int parent, int oldchild, int newchild)
+/* Replaces oldchild with newchild in parent (or as root, if parent is NIL) */
+    {
+    if(parent == NIL) tree->root = newchild;
+    else if(tree->nodes[parent].child1 == oldchild) tree->nodes[parent].child1 = newchild;
+    else tree->nodes[parent].child2 = newchild;
+    }
+
+static int Rotate(tree_t *tree, int ia, int ib, int ic, int first)
+/* Rotates up the child ic of ia (ib is the other child, first = 1 if ic is child1)
+ * and returns the new root of the subtree. */
+    {
+    node_t *nodes = tree->nodes;
+    node_t *a = &nodes[ia], *c = &nodes[ic];
+    int i_f = c->child1, ig = c->child2, ilow, ihigh;
+    /* swap a and c */
+    c->child1 = ia;
+    c->parent = a->parent;
+    a->parent = ic;
+    Replace(tree, c->parent, ia, ic);
+    /* the higher child of c stays with c, the lower one goes to a in place of c */
+    if(nodes[i_f].height > nodes[ig].height) { ihigh = i_f; ilow = ig; }
+    else { ihigh = ig; ilow = i_f; }
+    c->child2 = ihigh;
+    if(first) a->child1 = ilow; else a->child2 = ilow;
+    nodes[ilow].parent = ia;
+    Union(&a->box, &nodes[ib].box, &nodes[ilow].box);
+    Union(&c->box, &a->box, &nodes[ihigh].box);
+    a->height = 1 + (nodes[ib].height > nodes[ilow].height ? nodes[ib].height : nodes[ilow].height);
+    c->height = 1 + (a->height > nodes[ihigh].height ? a->height : nodes[ihigh].height);
+    return ic;
+    }
+
+static int Balance(tree_t *tree, int ia)
+/* Performs a left or right rotation if node ia is unbalanced, and returns the new
+ * root of the subtree */
+    {
+    node_t *a = &tree->nodes[ia];
+    int ib, ic, balance;
+    if(IsLeaf(a) || a->height < 2) return ia;
+    ib = a->child1;
+    ic = a->child2;
+    balance = tree->nodes[ic].height - tree->nodes[ib].height;
+    if(balance > 1) return Rotate(tree, ia, ib, ic, 0);
+    if(balance < -1) return Rotate(tree, ia, ic, ib, 1);
+    return ia;
+    }
+
+static void Refit(tree_t *tree, int index)
+/* Walks back to the root, rebalancing and refitting the ancestors */
+    {
+    node_t *node;
+    while(index != NIL)
+        {
+        index = Balance(tree, index);
+        node = &tree->nodes[index];
+        Union(&node->box, &tree->nodes[node->child1].box, &tree->nodes[node->child2].box);
+        node->height = 1 + (tree->nodes[node->child1].height > tree->nodes[node->child2].height ?
+                    tree->nodes[node->child1].height : tree->nodes[node->child2].height);
+        index = node->parent;
+        }
+    }
+
+static real_t DescentCost(const tree_t *tree, int child, const aabb_t *box, real_t inheritance)
+    {
+    aabb_t u;
+    const node_t *node = &tree->nodes[child];
+    Union(&u, box, &node->box);
+    if(IsLeaf(node)) return Area(&u) + inheritance;
+    return Area(&u) - Area(&node->box) + inheritance;
+    }
+
+static void InsertLeaf(lua_State *L, tree_t *tree, int leaf)
+    {
+    int index, sibling, oldparent, newparent;
+    real_t area, cost, inheritance, cost1, cost2;
+    aabb_t box, u;
+    node_t *node;
+    if(tree->root == NIL)
+        {
+        tree->root = leaf;
+        tree->nodes[leaf].parent = NIL;
+        return;
+        }
+    /* find the best sibling */
+    box = tree->nodes[leaf].box;
+    index = tree->root;
+    while(!IsLeaf(&tree->nodes[index]))
+        {
+        node = &tree->nodes[index];
+        area = Area(&node->box);
+        Union(&u, &node->box, &box);
+        cost = 2*Area(&u); /* cost of creating a new parent for this node and the leaf */
+        inheritance = 2*(Area(&u) - area); /* min cost of pushing the leaf further down */
+        cost1 = DescentCost(tree, node->child1, &box, inheritance);
+        cost2 = DescentCost(tree, node->child2, &box, inheritance);
+        if(cost < cost1 && cost < cost2) break;
+        index = cost1 < cost2 ? node->child1 : node->child2;
+        }
+    sibling = index;
+    /* create a new parent for the sibling and the leaf */
+    newparent = AllocNode(L, tree); /* may move the pool */
+    oldparent = tree->nodes[sibling].parent;
+    node = &tree->nodes[newparent];
+    node->parent = oldparent;
+    Union(&node->box, &box, &tree->nodes[sibling].box);
+    node->height = tree->nodes[sibling].height + 1;
+    node->child1 = sibling;
+    node->child2 = leaf;
+    Replace(tree, oldparent, sibling, newparent);
+    tree->nodes[sibling].parent = newparent;
+    tree->nodes[leaf].parent = newparent;
+    Refit(tree, oldparent);
+    }
+
+static void RemoveLeaf(tree_t *tree, int leaf)
+    {
+    int parent, grandparent, sibling;
+    if(leaf == tree->root)
+        { tree->root = NIL; return; }
+    parent = tree->nodes[leaf].parent;
+    grandparent = tree->nodes[parent].parent;
+    sibling = tree->nodes[parent].child1 == leaf ?
+                tree->nodes[parent].child2 : tree->nodes[parent].child1;
+    Replace(tree, grandparent, parent, sibling);
+    tree->nodes[sibling].parent = grandparent;
+    FreeNode(tree, parent);
+    Refit(tree, grandparent);
+    }
+
+static void FatBox(const tree_t *tree, const aabb_t *box, const vec3_t *d, aabb_t *fat)
+/* Fattens box by the margin, and extends it by the predicted displacement d */
+    {
+    int i;
+    for(i = 0; i < 3; i++)
+        {
+        fat->min.v[i] = box->min.v[i] - tree->margin;
+        fat->max.v[i] = box->max.v[i] + tree->margin;
+        if(d->v[i] < CCD_ZERO) fat->min.v[i] += tree->prediction*d->v[i];
+        else fat->max.v[i] += tree->prediction*d->v[i];
+        }
+    }
+
+/*------------------------------------------------------------------------------*
+ | Hooks                                                                        |
+ *------------------------------------------------------------------------------*/
+
+static void TreeFree(lua_State *L, broadphase_t *bp)
+    {
+    tree_t *tree = (tree_t*)bp->data;
+    if(tree->nodes) Free(L, tree->nodes);
+    if(tree->leaf) Free(L, tree->leaf);
+    if(tree->center) Free(L, tree->center);
+    if(tree->stack) Free(L, tree->stack);
+    Free(L, tree);
+    }
+
+static void TreeResize(lua_State *L, broadphase_t *bp)
+    {
+    tree_t *tree = (tree_t*)bp->data;
+    tree->leaf = Realloc(L, tree->leaf, (tree->slots+1)*sizeof(int), (bp->size+1)*sizeof(int));
+    tree->center = Realloc(L, tree->center, (tree->slots+1)*sizeof(vec3_t), (bp->size+1)*sizeof(vec3_t));
+    tree->slots = bp->size;
+    }
+
+static void TreeInsert(lua_State *L, broadphase_t *bp, int id)
+    {
+    tree_t *tree = (tree_t*)bp->data;
+    int leaf = AllocNode(L, tree);
+    vec3_t zero;
+    ccdVec3Set(&zero, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    FatBox(tree, &bp->aabb[id], &zero, &tree->nodes[leaf].box);
+    tree->nodes[leaf].id = id;
+    tree->leaf[id] = leaf;
+    Center(&bp->aabb[id], &tree->center[id]);
+    InsertLeaf(L, tree, leaf);
+    }
+
+static void TreeRemove(lua_State *L, broadphase_t *bp, int id)
+    {
+    tree_t *tree = (tree_t*)bp->data;
+    (void)L;
+    RemoveLeaf(tree, tree->leaf[id]);
+    FreeNode(tree, tree->leaf[id]);
+    }
+
+static void TreeUpdate(lua_State *L, broadphase_t *bp, int id)
+    {
+    tree_t *tree = (tree_t*)bp->data;
+    int leaf = tree->leaf[id];
+    vec3_t c, d;
+    Center(&bp->aabb[id], &c);
+    ccdVec3Sub2(&d, &c, &tree->center[id]);
+    ccdVec3Copy(&tree->center[id], &c);
+    if(Contains(&tree->nodes[leaf].box, &bp->aabb[id])) return; /* still within its fat box */
+    RemoveLeaf(tree, leaf);
+    FatBox(tree, &bp->aabb[id], &d, &tree->nodes[leaf].box);
+    InsertLeaf(L, tree, leaf);
+    }
+
+static void Query(lua_State *L, broadphase_t *bp, const aabb_t *box, int self, pairbuf_t *pairs, idbuf_t *ids)
+/* Finds the objects whose boxes overlap box. If self > 0, box is the box of the object
+ * self, and the pairs (self, id) with id > self are added to pairs, otherwise the ids
+ * are added to ids. */
+    {
+    tree_t *tree = (tree_t*)bp->data;
+    int *sp = tree->stack;
+    node_t *node;
+    if(tree->root == NIL) return;
+    *sp++ = tree->root;
+    while(sp > tree->stack)
+        {
+        node = &tree->nodes[*--sp];
+        if(!aabb_overlap(&node->box, box)) continue;
+        if(IsLeaf(node))
+            {
+            if(self == 0)
+                { if(aabb_overlap(&bp->aabb[node->id], box)) idbuf_add(L, ids, node->id); }
+            else if(node->id > self && aabb_overlap(&bp->aabb[node->id], box) &&
+                    broadphase_accept(bp, self, node->id))
+                pairbuf_add(L, pairs, self, node->id);
+            continue;
+            }
+        sp = Push(L, tree, sp);
+        *sp++ = node->child1;
+        *sp++ = node->child2;
+        }
+    }
+
+static void TreePairs(lua_State *L, broadphase_t *bp, pairbuf_t *buf)
+    {
+    int id;
+    for(id = 1; id <= bp->size; id++)
+        if(bp->used[id]) Query(L, bp, &bp->aabb[id], id, buf, NULL);
+    }
+
+static void TreeQuery(lua_State *L, broadphase_t *bp, const aabb_t *box, idbuf_t *buf)
+    {
+    Query(L, bp, box, 0, NULL, buf);
+    }
+
+static void TreeNearest(lua_State *L, broadphase_t *bp, knn_t *nn)
+/* Best-first traversal (see broadphase_nearest). A leaf is queued again as an object,
+ * with the lower bound given by the object's box, which is tighter than its fat box. */
+    {
+    tree_t *tree = (tree_t*)bp->data;
+    node_t *node;
+    int item;
+    real_t key;
+    if(tree->root == NIL) return;
+    knn_push(L, nn, aabb_distance(&nn->box, &tree->nodes[tree->root].box), tree->root);
+    while(knn_pop(nn, &key, &item) && knn_closer(nn, key))
+        {
+        if(item < 0)
+            { knn_test(nn, -item); continue; }
+        node = &tree->nodes[item];
+        if(IsLeaf(node))
+            {
+            key = aabb_distance(&nn->box, &bp->aabb[node->id]);
+            if(knn_closer(nn, key)) knn_push(L, nn, key, -node->id);
+            continue;
+            }
+        key = aabb_distance(&nn->box, &tree->nodes[node->child1].box);
+        if(knn_closer(nn, key)) knn_push(L, nn, key, node->child1);
+        key = aabb_distance(&nn->box, &tree->nodes[node->child2].box);
+        if(knn_closer(nn, key)) knn_push(L, nn, key, node->child2);
+        }
+    }
+
+static const bpclass_t TreeClass = {
+    "aabb_tree", TreeFree, TreeResize, TreeInsert, TreeRemove, TreeUpdate, TreePairs, TreeQuery,
+    TreeNearest
+};
+
+/*------------------------------------------------------------------------------*
+ | Constructor                                                                  |
+ *------------------------------------------------------------------------------*/
+
+broadphase_t *aabbtree_new(lua_State *L, real_t margin, real_t prediction)
+/* Creates an aabb_tree broadphase and pushes it on the stack */
+    {
+    tree_t *tree = Malloc(L, sizeof(tree_t));
+    tree->margin = margin;
+    tree->prediction = prediction;
+    tree->root = tree->freenode = NIL;
+    tree->stacksize = 256;
+    tree->stack = Malloc(L, tree->stacksize*sizeof(int));
+    return broadphase_new(L, &TreeClass, tree);
+    }
+
+static int NewTree(lua_State *L)
+/* bp = ccd.aabb_tree([{margin=0.1, prediction=2}]) */
+    {
+    real_t margin = CCD_REAL(0.1), prediction = CCD_REAL(2.0);
+    if(!lua_isnoneornil(L, 1))
+        {
+        if(!lua_istable(L, 1)) return argerror(L, 1, ERR_TABLE);
+        lua_getfield(L, 1, "margin");
+        margin = luaL_optnumber(L, -1, margin);
+        lua_pop(L, 1);
+        lua_getfield(L, 1, "prediction");
+        prediction = luaL_optnumber(L, -1, prediction);
+        lua_pop(L, 1);
+        if(margin < 0 || prediction < 0) return argerror(L, 1, ERR_VALUE);
+        }
+    aabbtree_new(L, margin, prediction);
+    return 1;
+    }
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "aabb_tree", NewTree },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonccd_open_aabbtree(lua_State *L)
+    {
+    luaL_setfuncs(L, Functions, 0);
+    }
+
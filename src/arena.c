@@ -0,0 +1,246 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stddef.h>
+#include "internal.h"
+
+/* Memory allocator for libccd.
+ *
+ * When libccd is compiled together with MoonCCD (make LIBCCD=path, see the Makefile),
+ * its calls to malloc(), calloc(), realloc() and free() are redirected to the
+ * moonccd_ccd_xxx() hooks below, which by default are backed by a per-thread arena.
+ *
+ * The arena is a list of chunks allocated from the system heap, from which blocks are
+ * carved by bumping a pointer. Freeing a block is a no-op (unless it is the last one),
+ * and the whole arena is rewound by arena_reset() at the beginning of each query.
+ * The chunks are retained across resets, so once the arena has grown to the size needed
+ * by the largest query, queries no longer allocate from the system heap.
+ */
+
+#define CHUNK_SIZE  (64*1024)
+#define ALIGNMENT   16
+#define ALIGN(n)    (((n) + ALIGNMENT - 1) & ~((size_t)ALIGNMENT - 1))
+#define HEADER      ALIGN(sizeof(size_t)) /* each block is preceded by its size */
+
+typedef struct chunk_s {
+    struct chunk_s *next;
+    size_t size;    /* size of mem */
+    size_t used;    /* bytes used in mem */
+    union { unsigned char mem[1]; long double align_; } u;
+} chunk_t;
+
+typedef struct {
+    chunk_t *head;          /* first chunk */
+    chunk_t *cur;           /* chunk being used */
+    size_t used;            /* bytes used since last reset */
+    size_t peak;            /* max bytes used between resets */
+    size_t capacity;        /* total size of the chunks */
+    unsigned long sysallocs;/* number of chunks allocated from the system heap */
+    int system;             /* 1 if the system heap is used instead of the arena */
+} arena_t;
+
+static __thread arena_t Arena;
+
+static chunk_t *NewChunk(size_t size)
+    {
+    chunk_t *chunk = (chunk_t*)malloc(offsetof(chunk_t, u) + size);
+    if(!chunk) return NULL;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    Arena.capacity += size;
+    Arena.sysallocs++;
+    return chunk;
+    }
+
+static void *ArenaAlloc(size_t size)
+    {
+    size_t n = HEADER + ALIGN(size);
+    unsigned char *p;
+    chunk_t *chunk, *prev = NULL;
+    /* find the first chunk with enough room, from the current one on */
+    for(chunk = Arena.cur; chunk; prev = chunk, chunk = chunk->next)
+        if(chunk->size - chunk->used >= n) break;
+    if(!chunk)
+        {
+        chunk = NewChunk(n > CHUNK_SIZE ? n : CHUNK_SIZE);
+        if(!chunk) return NULL;
+        if(prev) prev->next = chunk;
+        else Arena.head = chunk;
+        }
+    Arena.cur = chunk;
+    p = chunk->u.mem + chunk->used;
+    chunk->used += n;
+    Arena.used += n;
+    if(Arena.used > Arena.peak) Arena.peak = Arena.used;
+    *(size_t*)p = size;
+    return p + HEADER;
+    }
+
+static int IsLast(const unsigned char *p, size_t size)
+/* Returns 1 if the block at p is the last one allocated from the current chunk */
+    {
+    chunk_t *chunk = Arena.cur;
+    return chunk && (p + ALIGN(size) == chunk->u.mem + chunk->used);
+    }
+
+static void *ArenaRealloc(void *ptr, size_t size)
+    {
+    size_t old, grow;
+    void *p;
+    if(!ptr) return ArenaAlloc(size);
+    old = *(size_t*)((unsigned char*)ptr - HEADER);
+    if(size <= old) return ptr;
+    grow = ALIGN(size) - ALIGN(old);
+    if(IsLast(ptr, old) && Arena.cur->size - Arena.cur->used >= grow)
+        { /* grow in place */
+        Arena.cur->used += grow;
+        Arena.used += grow;
+        if(Arena.used > Arena.peak) Arena.peak = Arena.used;
+        *(size_t*)((unsigned char*)ptr - HEADER) = size;
+        return ptr;
+        }
+    p = ArenaAlloc(size);
+    if(p) memcpy(p, ptr, old);
+    return p;
+    }
+
+static void ArenaRelease(void *ptr)
+    {
+    size_t size;
+    if(!ptr) return;
+    size = *(size_t*)((unsigned char*)ptr - HEADER);
+    if(IsLast(ptr, size))
+        {
+        Arena.cur->used -= HEADER + ALIGN(size);
+        Arena.used -= HEADER + ALIGN(size);
+        }
+    }
+
+void arena_reset(void)
+    {
+    chunk_t *chunk;
+    for(chunk = Arena.head; chunk; chunk = chunk->next)
+        chunk->used = 0;
+    Arena.cur = Arena.head;
+    Arena.used = 0;
+    }
+
+void arena_release(void)
+/* Returns all the chunks to the system heap */
+    {
+    chunk_t *chunk;
+    while(Arena.head)
+        {
+        chunk = Arena.head;
+        Arena.head = chunk->next;
+        free(chunk);
+        }
+    Arena.cur = NULL;
+    Arena.used = Arena.capacity = 0;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Hooks (called by libccd)                                                     |
+ *------------------------------------------------------------------------------*/
+
+void *moonccd_ccd_malloc(size_t size)
+    {
+    return Arena.system ? malloc(size) : ArenaAlloc(size);
+    }
+
+void *moonccd_ccd_calloc(size_t nmemb, size_t size)
+    {
+    void *p;
+    if(Arena.system) return calloc(nmemb, size);
+    if(size && nmemb > ((size_t)-1)/size) return NULL;
+    p = ArenaAlloc(nmemb*size);
+    if(p) memset(p, 0, nmemb*size);
+    return p;
+    }
+
+void *moonccd_ccd_realloc(void *ptr, size_t size)
+    {
+    return Arena.system ? realloc(ptr, size) : ArenaRealloc(ptr, size);
+    }
+
+void moonccd_ccd_free(void *ptr)
+    {
+    if(Arena.system) free(ptr);
+    else ArenaRelease(ptr);
+    }
+
+/*------------------------------------------------------------------------------*
+ | Lua functions                                                                |
+ *------------------------------------------------------------------------------*/
+
+static int ArenaInfo(lua_State *L)
+    {
+    lua_newtable(L);
+#ifdef MOONCCD_VENDORED_LIBCCD
+    lua_pushboolean(L, 1);
+#else
+    lua_pushboolean(L, 0);
+#endif
+    lua_setfield(L, -2, "vendored");
+    lua_pushstring(L, Arena.system ? "system" : "arena");
+    lua_setfield(L, -2, "allocator");
+    lua_pushinteger(L, Arena.capacity);
+    lua_setfield(L, -2, "capacity");
+    lua_pushinteger(L, Arena.peak);
+    lua_setfield(L, -2, "peak");
+    lua_pushinteger(L, Arena.sysallocs);
+    lua_setfield(L, -2, "sysallocs");
+    return 1;
+    }
+
+static int SetAllocator(lua_State *L)
+    {
+    const char *name = luaL_checkstring(L, 1);
+    int system;
+    if(strcmp(name, "arena") == 0) system = 0;
+    else if(strcmp(name, "system") == 0) system = 1;
+    else return argerror(L, 1, ERR_VALUE);
+    if(system != Arena.system)
+        {
+        /* never mix the two: blocks are allocated and freed within a single query */
+        arena_release();
+        Arena.system = system;
+        }
+    return 0;
+    }
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "arena_info", ArenaInfo },
+        { "set_allocator", SetAllocator },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonccd_open_arena(lua_State *L)
+    {
+    luaL_setfuncs(L, Functions, 0);
+    }
+
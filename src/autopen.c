@@ -0,0 +1,262 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* Adaptive selection between GJK+EPA and MPR for penetration queries.
+ *
+ * Pairs are classified by the kinds of their objects (the shape kind, or 'user' for
+ * user-defined objects). For each class, the first queries run both algorithms, and
+ * record their execution times, their numbers of support function calls, and the
+ * difference between the penetration depths they report. After a given number of
+ * samples, MPR is chosen if it was faster and its depth error was within the tolerance
+ * (GJK+EPA is taken as the reference, since EPA computes the exact penetration depth),
+ * otherwise GJK+EPA is chosen. The choices can also be set by configuration (frozen).
+ */
+
+static const char *AlgName[] = { "none", "gjk", "mpr" };
+
+void autopen_init(autopen_t *a, unsigned int samples, double max_error)
+    {
+    memset(a, 0, sizeof(autopen_t));
+    a->samples = samples;
+    a->max_error = max_error;
+    }
+
+static autostat_t *Class(autopen_t *a, const ccd_t *ccd, const void *obj1, const void *obj2)
+    {
+    int k1, k2, k;
+    k1 = isshape(ccd, 1) ? ((const shape_t*)obj1)->kind : SHAPE_NKINDS;
+    k2 = isshape(ccd, 2) ? ((const shape_t*)obj2)->kind : SHAPE_NKINDS;
+    if(k1 > k2) { k = k1; k1 = k2; k2 = k; }
+    return &a->stat[k1][k2];
+    }
+
+/*------------------------------------------------------------------------------*
+ | Sampling                                                                     |
+ *------------------------------------------------------------------------------*/
+
+static ccd_support_fn Support1, Support2; /* the actual support functions */
+static unsigned long Calls; /* support calls counter */
+
+static void CountingSupport1(const void *obj, const vec3_t *dir, vec3_t *vec)
+    {
+    Calls++;
+    Support1(obj, dir, vec);
+    }
+
+static void CountingSupport2(const void *obj, const vec3_t *dir, vec3_t *vec)
+    {
+    Calls++;
+    Support2(obj, dir, vec);
+    }
+
+static int Sample(autostat_t *st, int alg, const ccd_t *ccd, const void *obj1, const void *obj2,
+                real_t *depth, vec3_t *dir, vec3_t *pos)
+/* Executes the query with the given algorithm, and adds its cost to the statistics */
+    {
+    int rc;
+    double t;
+    ccd_t c;
+    memcpy(&c, ccd, sizeof(ccd_t));
+    Support1 = ccd->support1;
+    Support2 = ccd->support2;
+    c.support1 = CountingSupport1;
+    c.support2 = CountingSupport2;
+    Calls = 0;
+    t = now();
+    if(alg == AUTO_MPR)
+        rc = ccdMPRPenetration(obj1, obj2, &c, depth, dir, pos);
+    else
+        rc = ccdGJKPenetration(obj1, obj2, &c, depth, dir, pos);
+    st->time[alg-1] += since(t);
+    st->calls[alg-1] += Calls;
+    return rc;
+    }
+
+static void Decide(const autopen_t *a, autostat_t *st)
+    {
+    if(st->hits > 0 && st->error <= a->max_error && st->time[AUTO_MPR-1] < st->time[AUTO_GJK-1])
+        st->choice = AUTO_MPR;
+    else
+        st->choice = AUTO_GJK;
+    }
+
+int autopen_penetration(autopen_t *a, const ccd_t *ccd, const void *obj1, const void *obj2,
+                real_t *depth, vec3_t *dir, vec3_t *pos)
+/* Same return values as ccdGJKPenetration(). While learning, the result of GJK+EPA is
+ * returned. */
+    {
+    int rc, rc2;
+    real_t depth2, err;
+    vec3_t dir2, pos2;
+    autostat_t *st;
+
+    rc = kernel_penetration(ccd, obj1, obj2, depth, dir, pos);
+    if(rc != KERNEL_NONE) return rc; /* closed-form: nothing to choose */
+    if(!ccd->center1 || !ccd->center2) /* MPR not available */
+        return ccdGJKPenetration(obj1, obj2, ccd, depth, dir, pos);
+    st = Class(a, ccd, obj1, obj2);
+    switch(st->choice)
+        {
+        case AUTO_GJK: return ccdGJKPenetration(obj1, obj2, ccd, depth, dir, pos);
+        case AUTO_MPR: return ccdMPRPenetration(obj1, obj2, ccd, depth, dir, pos);
+        default: break;
+        }
+    /* learning: run both, alternating the order so that neither is favoured by caches */
+    if(st->samples % 2 == 0)
+        {
+        rc = Sample(st, AUTO_GJK, ccd, obj1, obj2, depth, dir, pos);
+        rc2 = Sample(st, AUTO_MPR, ccd, obj1, obj2, &depth2, &dir2, &pos2);
+        }
+    else
+        {
+        rc2 = Sample(st, AUTO_MPR, ccd, obj1, obj2, &depth2, &dir2, &pos2);
+        rc = Sample(st, AUTO_GJK, ccd, obj1, obj2, depth, dir, pos);
+        }
+    if(rc == -2 || rc2 == -2) return -2;
+    st->samples++;
+    if(rc == 0 && rc2 == 0)
+        {
+        st->hits++;
+        err = CCD_FABS(depth2 - *depth)/CCD_FMAX(*depth, CCD_EPS);
+        if(err > st->error) st->error = err;
+        }
+    if(st->samples >= a->samples) Decide(a, st);
+    return rc;
+    }
+
+void autopen_freeze(autopen_t *a)
+/* Freezes the choices made so far */
+    {
+    int k1, k2;
+    for(k1 = 0; k1 < AUTO_NKINDS; k1++)
+        for(k2 = k1; k2 < AUTO_NKINDS; k2++)
+            if(a->stat[k1][k2].choice != AUTO_NONE) a->stat[k1][k2].frozen = 1;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Configuration                                                                |
+ *------------------------------------------------------------------------------*/
+
+static int ParseClass(const char *name, int *k1, int *k2)
+/* Parses a class name ('kind1/kind2') */
+    {
+    char buf[32];
+    const char *sep = strchr(name, '/');
+    size_t len;
+    int k;
+    if(!sep) return -1;
+    len = sep - name;
+    if(len >= sizeof(buf)) return -1;
+    memcpy(buf, name, len);
+    buf[len] = '\0';
+    *k1 = shape_kindof(buf);
+    *k2 = shape_kindof(sep+1);
+    if(*k1 < 0 || *k2 < 0) return -1;
+    if(*k1 > *k2) { k = *k1; *k1 = *k2; *k2 = k; }
+    return 0;
+    }
+
+int autopen_setchoices(lua_State *L, autopen_t *a, int arg)
+/* Sets the choices from the table at arg ({ ['kind1/kind2'] = 'gjk'|'mpr' }), freezing them */
+    {
+    int k1, k2, alg;
+    const char *val;
+    if(lua_type(L, arg) != LUA_TTABLE) return argerror(L, arg, ERR_TABLE);
+    lua_pushnil(L);
+    while(lua_next(L, arg) != 0)
+        {
+        if(lua_type(L, -2) != LUA_TSTRING || lua_type(L, -1) != LUA_TSTRING)
+            return argerror(L, arg, ERR_TYPE);
+        if(ParseClass(lua_tostring(L, -2), &k1, &k2) != 0)
+            return luaL_error(L, "invalid pair class '%s'", lua_tostring(L, -2));
+        val = lua_tostring(L, -1);
+        if(strcmp(val, AlgName[AUTO_GJK]) == 0) alg = AUTO_GJK;
+        else if(strcmp(val, AlgName[AUTO_MPR]) == 0) alg = AUTO_MPR;
+        else return luaL_error(L, "invalid algorithm '%s'", val);
+        a->stat[k1][k2].choice = alg;
+        a->stat[k1][k2].frozen = 1;
+        lua_pop(L, 1);
+        }
+    return 0;
+    }
+
+static void PushClass(lua_State *L, int k1, int k2)
+    {
+    lua_pushfstring(L, "%s/%s", shape_kindname(k1), shape_kindname(k2));
+    }
+
+int autopen_pushchoices(lua_State *L, const autopen_t *a)
+    {
+    int k1, k2;
+    const autostat_t *st;
+    lua_newtable(L);
+    for(k1 = 0; k1 < AUTO_NKINDS; k1++)
+        for(k2 = k1; k2 < AUTO_NKINDS; k2++)
+            {
+            st = &a->stat[k1][k2];
+            if(st->choice == AUTO_NONE) continue;
+            PushClass(L, k1, k2);
+            lua_pushstring(L, AlgName[st->choice]);
+            lua_rawset(L, -3);
+            }
+    return 1;
+    }
+
+int autopen_pushstats(lua_State *L, const autopen_t *a)
+    {
+    int k1, k2;
+    const autostat_t *st;
+    lua_newtable(L);
+    for(k1 = 0; k1 < AUTO_NKINDS; k1++)
+        for(k2 = k1; k2 < AUTO_NKINDS; k2++)
+            {
+            st = &a->stat[k1][k2];
+            if(st->choice == AUTO_NONE && st->samples == 0) continue;
+            PushClass(L, k1, k2);
+            lua_newtable(L);
+            lua_pushstring(L, AlgName[st->choice]); lua_setfield(L, -2, "choice");
+            lua_pushboolean(L, st->frozen); lua_setfield(L, -2, "frozen");
+            lua_pushinteger(L, st->samples); lua_setfield(L, -2, "samples");
+            lua_pushinteger(L, st->hits); lua_setfield(L, -2, "hits");
+            if(st->samples > 0)
+                {
+                lua_pushnumber(L, st->time[AUTO_GJK-1]/st->samples);
+                lua_setfield(L, -2, "gjk_time");
+                lua_pushnumber(L, st->time[AUTO_MPR-1]/st->samples);
+                lua_setfield(L, -2, "mpr_time");
+                lua_pushnumber(L, (double)st->calls[AUTO_GJK-1]/st->samples);
+                lua_setfield(L, -2, "gjk_support_calls");
+                lua_pushnumber(L, (double)st->calls[AUTO_MPR-1]/st->samples);
+                lua_setfield(L, -2, "mpr_support_calls");
+                }
+            if(st->hits > 0)
+                { lua_pushnumber(L, st->error); lua_setfield(L, -2, "mpr_error"); }
+            lua_rawset(L, -3);
+            }
+    return 1;
+    }
+
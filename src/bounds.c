@@ -0,0 +1,394 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+#include "simd.h"
+
+/* Bounds containers, and SIMD overlap kernels.
+ *
+ * A bounds_t stores a list of boxes in SoA form (one array per coordinate of the min
+ * and max corners), so that LANES boxes at a time can be loaded in SIMD vectors and
+ * tested against a box with a few vector comparisons. The arrays are padded to a
+ * multiple of LANES with empty boxes (min = +inf, max = -inf), and the lanes past the
+ * count are masked out, so the kernels need no scalar tail.
+ *
+ * The kernels emit bitmasks (one bit per box) or lists of indices. They are used by the
+ * broadphase objects for their linear scans, and exposed to Lua as bounds objects.
+ */
+
+#define EMPTYMIN ((real_t)HUGE_VAL)
+#define EMPTYMAX (-(real_t)HUGE_VAL)
+
+void bounds_resize(lua_State *L, bounds_t *bounds, int count)
+/* Resizes the container to count boxes (new boxes are empty) */
+    {
+    int i, k, size;
+    if(count > bounds->size)
+        {
+        size = bounds->size ? bounds->size : 4*LANES;
+        while(size < count) size *= 2;
+        for(k = 0; k < 6; k++)
+            {
+            bounds->v[k] = Realloc(L, bounds->v[k], bounds->size*sizeof(real_t), size*sizeof(real_t));
+            for(i = bounds->size; i < size; i++)
+                bounds->v[k][i] = k < 3 ? EMPTYMIN : EMPTYMAX;
+            }
+        bounds->size = size;
+        }
+    for(i = count; i < bounds->count; i++) /* clear the removed boxes, for padding */
+        bounds_clear(bounds, i);
+    bounds->count = count;
+    }
+
+void bounds_release(lua_State *L, bounds_t *bounds)
+    {
+    int k;
+    for(k = 0; k < 6; k++)
+        if(bounds->v[k]) Free(L, bounds->v[k]);
+    memset(bounds, 0, sizeof(bounds_t));
+    }
+
+void bounds_set(bounds_t *bounds, int i, const aabb_t *box)
+    {
+    int k;
+    for(k = 0; k < 3; k++)
+        {
+        bounds->v[k][i] = box->min.v[k];
+        bounds->v[k+3][i] = box->max.v[k];
+        }
+    }
+
+void bounds_get(const bounds_t *bounds, int i, aabb_t *box)
+    {
+    int k;
+    for(k = 0; k < 3; k++)
+        {
+        box->min.v[k] = bounds->v[k][i];
+        box->max.v[k] = bounds->v[k+3][i];
+        }
+    }
+
+void bounds_clear(bounds_t *bounds, int i)
+    {
+    int k;
+    for(k = 0; k < 3; k++)
+        {
+        bounds->v[k][i] = EMPTYMIN;
+        bounds->v[k+3][i] = EMPTYMAX;
+        }
+    }
+
+/*------------------------------------------------------------------------------*
+ | Kernels                                                                      |
+ *------------------------------------------------------------------------------*/
+
+static vreal_t Load(const real_t *p)
+/* Unaligned load (the arrays are only aligned as the Lua allocator aligns them) */
+    {
+    vreal_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+    }
+
+static unsigned int Block(const bounds_t *bounds, int k, const vreal_t q[6])
+/* Tests the boxes k ... k+LANES-1 against the box q (splatted), and returns the
+ * bitmask of the overlapping ones */
+    {
+    unsigned int bits = 0;
+    int l;
+    vmask_t m = (Load(bounds->v[0]+k) <= q[3]) & (q[0] <= Load(bounds->v[3]+k)) &
+                (Load(bounds->v[1]+k) <= q[4]) & (q[1] <= Load(bounds->v[4]+k)) &
+                (Load(bounds->v[2]+k) <= q[5]) & (q[2] <= Load(bounds->v[5]+k));
+    for(l = 0; l < LANES; l++)
+        if(m[l]) bits |= 1u << l;
+    if(k + LANES > bounds->count) /* mask out the padding */
+        bits &= (1u << (bounds->count - k)) - 1;
+    return bits;
+    }
+
+static void Splat(const aabb_t *box, vreal_t q[6])
+    {
+    int k, l;
+    for(l = 0; l < LANES; l++)
+        for(k = 0; k < 3; k++)
+            {
+            q[k][l] = box->min.v[k];
+            q[k+3][l] = box->max.v[k];
+            }
+    }
+
+static void Mask(const bounds_t *bounds, const aabb_t *box, unsigned char *mask)
+/* One-vs-many, with the results as a bitmask (bit i%8 of byte i/8 set if the box i
+ * overlaps box). The mask must have room for (count+7)/8 bytes, zeroed. */
+    {
+    int k, l;
+    unsigned int bits;
+    vreal_t q[6];
+    Splat(box, q);
+    for(k = 0; k < bounds->count; k += LANES)
+        {
+        bits = Block(bounds, k, q);
+        for(l = 0; bits; l++, bits >>= 1)
+            if(bits & 1) mask[(k+l)/8] |= 1 << ((k+l)%8);
+        }
+    }
+
+void bounds_query(lua_State *L, const bounds_t *bounds, const aabb_t *box, int base, idbuf_t *buf)
+/* One-vs-many: appends to buf the indices (plus base) of the boxes overlapping box */
+    {
+    int k, l;
+    unsigned int bits;
+    vreal_t q[6];
+    Splat(box, q);
+    for(k = 0; k < bounds->count; k += LANES)
+        {
+        bits = Block(bounds, k, q);
+        for(l = 0; bits; l++, bits >>= 1)
+            if(bits & 1) idbuf_add(L, buf, k+l+base);
+        }
+    }
+
+void bounds_pairs(lua_State *L, const bounds_t *a, const bounds_t *b, int base, idbuf_t *buf)
+/* Many-vs-many: appends to buf the pairs of indices (plus base) i, j of the overlapping
+ * boxes, with i in a and j in b. If b is NULL, the pairs are those in a, with i < j. */
+    {
+    int i, k, l;
+    unsigned int bits;
+    vreal_t q[6];
+    aabb_t box;
+    const bounds_t *other = b ? b : a;
+    for(i = 0; i < a->count; i++)
+        {
+        bounds_get(a, i, &box);
+        Splat(&box, q);
+        k = b ? 0 : ((i+1)/LANES)*LANES;
+        for( ; k < other->count; k += LANES)
+            {
+            bits = Block(other, k, q);
+            if(!b && k <= i) /* mask out the boxes up to i */
+                bits &= ~((2u << (i-k)) - 1);
+            for(l = 0; bits; l++, bits >>= 1)
+                if(bits & 1)
+                    {
+                    idbuf_add(L, buf, i+base);
+                    idbuf_add(L, buf, k+l+base);
+                    }
+            }
+        }
+    }
+
+/*------------------------------------------------------------------------------*
+ | Lua bounds objects                                                           |
+ *------------------------------------------------------------------------------*/
+
+static int freebounds(lua_State *L, ud_t *ud)
+    {
+    bounds_t *bounds = (bounds_t*)ud->handle;
+    if(!freeuserdata(L, ud, "bounds")) return 0;
+    bounds_release(L, bounds);
+    Free(L, bounds);
+    return 0;
+    }
+
+static int checkboxindex(lua_State *L, bounds_t *bounds, int arg)
+    {
+    lua_Integer i = luaL_checkinteger(L, arg);
+    if(i < 1 || i > bounds->count) return argerror(L, arg, ERR_VALUE);
+    return (int)i - 1;
+    }
+
+static int Create(lua_State *L)
+/* bounds = ccd.bounds([count]) */
+    {
+    ud_t *ud;
+    bounds_t *bounds;
+    int count = luaL_optinteger(L, 1, 0);
+    if(count < 0) return argerror(L, 1, ERR_VALUE);
+    bounds = Malloc(L, sizeof(bounds_t));
+    ud = newuserdata(L, bounds, BOUNDS_MT, "bounds");
+    ud->parent_ud = NULL;
+    ud->destructor = freebounds;
+    bounds_resize(L, bounds, count);
+    return 1;
+    }
+
+static int Count(lua_State *L)
+    {
+    bounds_t *bounds = checkbounds(L, 1, NULL);
+    lua_pushinteger(L, bounds->count);
+    return 1;
+    }
+
+static int Resize(lua_State *L)
+    {
+    bounds_t *bounds = checkbounds(L, 1, NULL);
+    int count = luaL_checkinteger(L, 2);
+    if(count < 0) return argerror(L, 2, ERR_VALUE);
+    bounds_resize(L, bounds, count);
+    return 0;
+    }
+
+static int Set(lua_State *L)
+/* bounds:set(i, min, max) */
+    {
+    aabb_t box;
+    bounds_t *bounds = checkbounds(L, 1, NULL);
+    int i = checkboxindex(L, bounds, 2);
+    checkaabb(L, 3, &box);
+    bounds_set(bounds, i, &box);
+    return 0;
+    }
+
+static int Get(lua_State *L)
+/* min, max = bounds:get(i) */
+    {
+    aabb_t box;
+    bounds_t *bounds = checkbounds(L, 1, NULL);
+    int i = checkboxindex(L, bounds, 2);
+    bounds_get(bounds, i, &box);
+    pushaabb(L, &box);
+    return 2;
+    }
+
+static int SetAll(lua_State *L)
+/* bounds:set_all(buffer), buffer = { min1x, min1y, min1z, max1x, max1y, max1z, min2x, ... } */
+    {
+    int i, k, n;
+    real_t *v;
+    bounds_t *bounds = checkbounds(L, 1, NULL);
+    if(!lua_istable(L, 2)) return argerror(L, 2, ERR_TABLE);
+    n = luaL_len(L, 2);
+    if(n % 6 != 0) return argerror(L, 2, ERR_LENGTH);
+    bounds_resize(L, bounds, n/6);
+    for(i = 0; i < n/6; i++)
+        {
+        for(k = 0; k < 6; k++)
+            {
+            lua_rawgeti(L, 2, 6*i+k+1);
+            if(!lua_isnumber(L, -1)) return luaL_error(L, "invalid bounds for box %d", i+1);
+            v = bounds->v[k];
+            v[i] = lua_tonumber(L, -1);
+            lua_pop(L, 1);
+            }
+        for(k = 0; k < 3; k++)
+            if(bounds->v[k][i] > bounds->v[k+3][i]) return luaL_error(L, "invalid bounds for box %d", i+1);
+        }
+    return 0;
+    }
+
+static int Overlap(lua_State *L)
+/* {i} = bounds:overlap(min, max) */
+    {
+    aabb_t box;
+    idbuf_t buf;
+    int i;
+    bounds_t *bounds = checkbounds(L, 1, NULL);
+    checkaabb(L, 2, &box);
+    memset(&buf, 0, sizeof(buf));
+    bounds_query(L, bounds, &box, 1, &buf);
+    lua_createtable(L, buf.count, 0);
+    for(i = 0; i < buf.count; i++)
+        {
+        lua_pushinteger(L, buf.ids[i]);
+        lua_rawseti(L, -2, i+1);
+        }
+    if(buf.ids) Free(L, buf.ids);
+    return 1;
+    }
+
+static int OverlapMask(lua_State *L)
+/* mask = bounds:overlap_mask(min, max) */
+    {
+    aabb_t box;
+    unsigned char *mask;
+    int n;
+    bounds_t *bounds = checkbounds(L, 1, NULL);
+    checkaabb(L, 2, &box);
+    n = (bounds->count + 7)/8;
+    if(n == 0) { lua_pushstring(L, ""); return 1; }
+    mask = Malloc(L, n);
+    Mask(bounds, &box, mask);
+    lua_pushlstring(L, (char*)mask, n);
+    Free(L, mask);
+    return 1;
+    }
+
+static int OverlapPairs(lua_State *L)
+/* {{i, j}} = bounds:overlap_pairs([other]) */
+    {
+    idbuf_t buf;
+    int i;
+    bounds_t *bounds = checkbounds(L, 1, NULL);
+    bounds_t *other = optbounds(L, 2, NULL);
+    memset(&buf, 0, sizeof(buf));
+    bounds_pairs(L, bounds, other, 1, &buf);
+    lua_createtable(L, buf.count/2, 0);
+    for(i = 0; i < buf.count/2; i++)
+        {
+        lua_createtable(L, 2, 0);
+        lua_pushinteger(L, buf.ids[2*i]);
+        lua_rawseti(L, -2, 1);
+        lua_pushinteger(L, buf.ids[2*i+1]);
+        lua_rawseti(L, -2, 2);
+        lua_rawseti(L, -2, i+1);
+        }
+    if(buf.ids) Free(L, buf.ids);
+    return 1;
+    }
+
+DESTROY_FUNC(bounds)
+
+static const struct luaL_Reg Methods[] = 
+    {
+        { "free", Destroy },
+        { "count", Count },
+        { "resize", Resize },
+        { "set", Set },
+        { "get", Get },
+        { "set_all", SetAll },
+        { "overlap", Overlap },
+        { "overlap_mask", OverlapMask },
+        { "overlap_pairs", OverlapPairs },
+        { NULL, NULL } /* sentinel */
+    };
+
+static const struct luaL_Reg MetaMethods[] = 
+    {
+        { "__gc",  Destroy },
+        { NULL, NULL } /* sentinel */
+    };
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "bounds", Create },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonccd_open_bounds(lua_State *L)
+    {
+    udata_define(L, BOUNDS_MT, Methods, MetaMethods);
+    luaL_setfuncs(L, Functions, 0);
+    }
+
@@ -0,0 +1,752 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* A broadphase object keeps a set of objects with their axis-aligned bounding boxes,
+ * and finds the pairs of objects whose boxes overlap, i.e. the candidate pairs for the
+ * narrowphase queries.
+ *
+ * This file implements the parts common to all the broadphase kinds (ids, objects and
+ * boxes bookkeeping, and the Lua interface), while the acceleration structures are
+ * implemented in separate files (sap.c, etc.), behind a bpclass_t.
+ *
+ * The objects are identified by integer ids (1, 2, ...), reused after removal, and are
+ * kept in a Lua table referenced by ref[0], indexed by id.
+ */
+
+#define OBJECTS 0 /* ref[] index of the objects table */
+
+static int freebroadphase(lua_State *L, ud_t *ud)
+    {
+    broadphase_t *bp = (broadphase_t*)ud->handle;
+    if(!freeuserdata(L, ud, "broadphase")) return 0;
+    if(bp->cls->free) bp->cls->free(L, bp);
+    if(bp->aabb) Free(L, bp->aabb);
+    if(bp->used) Free(L, bp->used);
+    if(bp->next) Free(L, bp->next);
+    if(bp->pairs.ids) Free(L, bp->pairs.ids);
+    if(bp->hits.ids) Free(L, bp->hits.ids);
+    if(bp->filter) Free(L, bp->filter);
+    if(bp->idle) Free(L, bp->idle);
+    exclset_release(L, &bp->excluded);
+    bounds_release(L, &bp->bounds);
+    Free(L, bp);
+    return 0;
+    }
+
+broadphase_t *broadphase_new(lua_State *L, const bpclass_t *cls, void *data)
+/* Creates a broadphase object and pushes it on the stack */
+    {
+    int i;
+    ud_t *ud;
+    broadphase_t *bp = Malloc(L, sizeof(broadphase_t));
+    bp->cls = cls;
+    bp->data = data;
+    ud = newuserdata(L, bp, BROADPHASE_MT, "broadphase");
+    ud->parent_ud = NULL;
+    ud->destructor = freebroadphase;
+    for(i=0; i<6; i++) ud->ref[i] = LUA_NOREF;
+    lua_newtable(L);
+    ud->ref[OBJECTS] = luaL_ref(L, LUA_REGISTRYINDEX);
+    return bp;
+    }
+
+void pairbuf_add(lua_State *L, pairbuf_t *buf, int id1, int id2)
+/* Appends the pair (id1, id2) to buf, with id1 < id2 */
+    {
+    if(buf->count == buf->size)
+        {
+        int size = buf->size ? 2*buf->size : 64;
+        buf->ids = Realloc(L, buf->ids, 2*buf->size*sizeof(int), 2*size*sizeof(int));
+        buf->size = size;
+        }
+    buf->ids[2*buf->count] = id1 < id2 ? id1 : id2;
+    buf->ids[2*buf->count+1] = id1 < id2 ? id2 : id1;
+    buf->count++;
+    }
+
+void idbuf_add(lua_State *L, idbuf_t *buf, int id)
+/* Appends id to buf */
+    {
+    if(buf->count == buf->size)
+        {
+        int size = buf->size ? 2*buf->size : 64;
+        buf->ids = Realloc(L, buf->ids, buf->size*sizeof(int), size*sizeof(int));
+        buf->size = size;
+        }
+    buf->ids[buf->count++] = id;
+    }
+
+static int Grow(lua_State *L, broadphase_t *bp)
+/* Doubles the number of slots for ids, and returns the first new one */
+    {
+    int id, size = bp->size ? 2*bp->size : 64;
+    bp->aabb = Realloc(L, bp->aabb, (bp->size+1)*sizeof(aabb_t), (size+1)*sizeof(aabb_t));
+    bp->used = Realloc(L, bp->used, bp->size+1, size+1);
+    bp->next = Realloc(L, bp->next, (bp->size+1)*sizeof(int), (size+1)*sizeof(int));
+    bp->filter = Realloc(L, bp->filter, (bp->size+1)*sizeof(filter_t), (size+1)*sizeof(filter_t));
+    for(id = bp->size+1; id <= size; id++) filter_default(&bp->filter[id]);
+    bp->idle = Realloc(L, bp->idle, bp->size+1, size+1);
+    for(id = bp->size+1; id < size; id++) bp->next[id] = id+1;
+    bp->next[size] = 0;
+    bp->freeid = bp->size+1;
+    bp->size = size;
+    bounds_resize(L, &bp->bounds, size);
+    if(bp->cls->resize) bp->cls->resize(L, bp);
+    return bp->freeid;
+    }
+
+int broadphase_axis(broadphase_t *bp)
+/* Returns the axis along which the centers of the boxes have the largest variance */
+    {
+    int id, i, best = 0;
+    real_t c, n = CCD_ZERO, sum[3] = {0, 0, 0}, sum2[3] = {0, 0, 0}, var[3];
+    for(id = 1; id <= bp->size; id++)
+        {
+        if(!bp->used[id]) continue;
+        for(i = 0; i < 3; i++)
+            {
+            c = (bp->aabb[id].min.v[i] + bp->aabb[id].max.v[i])/2;
+            sum[i] += c;
+            sum2[i] += c*c;
+            }
+        n += CCD_ONE;
+        }
+    if(n == CCD_ZERO) return 0;
+    for(i = 0; i < 3; i++)
+        {
+        var[i] = sum2[i] - sum[i]*sum[i]/n;
+        if(var[i] > var[best]) best = i;
+        }
+    return best;
+    }
+
+int optaxis(lua_State *L, int arg)
+/* axis = 'x' | 'y' | 'z' | 'auto' (default), returns 0, 1, 2, or -1 for 'auto' */
+    {
+    const char *s = luaL_optstring(L, arg, "auto");
+    if(strcmp(s, "x") == 0) return 0;
+    if(strcmp(s, "y") == 0) return 1;
+    if(strcmp(s, "z") == 0) return 2;
+    if(strcmp(s, "auto") != 0) return argerror(L, arg, ERR_VALUE);
+    return -1;
+    }
+
+static void SetBox(broadphase_t *bp, int id, const aabb_t *box)
+    {
+    bp->aabb[id] = *box;
+    bounds_set(&bp->bounds, id-1, box);
+    }
+
+void broadphase_scan(lua_State *L, broadphase_t *bp, const aabb_t *box, idbuf_t *buf)
+/* Linear scan (with the SIMD kernel): appends to buf the ids whose boxes overlap box */
+    {
+    int i, n = buf->count;
+    bounds_query(L, &bp->bounds, box, 1, buf);
+    for(i = n; i < buf->count; i++)
+        if(bp->used[buf->ids[i]]) buf->ids[n++] = buf->ids[i];
+    buf->count = n;
+    }
+
+int broadphase_filter(const broadphase_t *bp, int id1, int id2)
+/* Returns 1 if the pair (id1, id2) passes the filters, is not excluded, and at least
+ * one of the two objects is not idle */
+    {
+    if(bp->idle[id1] && bp->idle[id2]) return 0;
+    if(!filter_accept(&bp->filter[id1], &bp->filter[id2])) return 0;
+    return !exclset_has(&bp->excluded, id1, id2);
+    }
+
+void broadphase_setfilter(broadphase_t *bp, int id, const filter_t *filter)
+    {
+    bp->filter[id] = *filter;
+    if(!filter_isdefault(filter)) bp->filtering = 1;
+    }
+
+void broadphase_setidle(broadphase_t *bp, int id, int idle)
+    {
+    bp->idle[id] = idle ? 1 : 0;
+    if(idle) bp->filtering = 1;
+    }
+
+int broadphase_checkid(lua_State *L, broadphase_t *bp, int arg)
+    {
+    lua_Integer id = luaL_checkinteger(L, arg);
+    if(id < 1 || id > bp->size || !bp->used[id]) return argerror(L, arg, ERR_VALUE);
+    return (int)id;
+    }
+
+static void ShapeBox(lua_State *L, ud_t *ud, broadphase_t *bp, int id, aabb_t *box)
+/* Computes the box of the object with the given id, which must be a native shape,
+ * and refreshes its filter and idle flag */
+    {
+    shape_t *shape;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[OBJECTS]);
+    lua_rawgeti(L, -1, id);
+    shape = testshape(L, -1, NULL);
+    if(!shape) luaL_error(L, "missing bounds for object %d (not a native shape)", id);
+    shape_aabb(shape, box);
+    broadphase_setfilter(bp, id, &shape->filter);
+    broadphase_setidle(bp, id, shape_idle(shape));
+    lua_pop(L, 2);
+    }
+
+int broadphase_insert(lua_State *L, broadphase_t *bp, ud_t *ud, int arg, const aabb_t *box)
+/* Inserts the object at the given stack position, with the given box, and returns its id */
+    {
+    shape_t *shape;
+    int id = bp->freeid ? bp->freeid : Grow(L, bp);
+    bp->freeid = bp->next[id];
+    bp->used[id] = 1;
+    bp->count++;
+    SetBox(bp, id, box);
+    shape = testshape(L, arg, NULL);
+    if(shape)
+        {
+        broadphase_setfilter(bp, id, &shape->filter);
+        broadphase_setidle(bp, id, shape_idle(shape));
+        }
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[OBJECTS]);
+    lua_pushvalue(L, arg);
+    lua_rawseti(L, -2, id);
+    lua_pop(L, 1);
+    bp->cls->insert(L, bp, id);
+    return id;
+    }
+
+void broadphase_remove(lua_State *L, broadphase_t *bp, ud_t *ud, int id)
+    {
+    bp->cls->remove(L, bp, id);
+    bounds_clear(&bp->bounds, id-1);
+    filter_default(&bp->filter[id]);
+    bp->idle[id] = 0;
+    if(bp->excluded.count > 0) exclset_purge(&bp->excluded, id);
+    bp->used[id] = 0;
+    bp->next[id] = bp->freeid;
+    bp->freeid = id;
+    bp->count--;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[OBJECTS]);
+    lua_pushnil(L);
+    lua_rawseti(L, -2, id);
+    lua_pop(L, 1);
+    }
+
+void broadphase_update(lua_State *L, broadphase_t *bp, int id, const aabb_t *box)
+    {
+    SetBox(bp, id, box);
+    bp->cls->update(L, bp, id);
+    }
+
+void broadphase_pairs(lua_State *L, broadphase_t *bp)
+/* Finds the overlapping pairs, and puts them in bp->pairs */
+    {
+    bp->pairs.count = 0;
+    bp->cls->pairs(L, bp, &bp->pairs);
+    }
+
+void broadphase_pushobjects(lua_State *L, ud_t *ud)
+/* Pushes the objects table (indexed by id) */
+    {
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[OBJECTS]);
+    }
+
+/*------------------------------------------------------------------------------*
+ | Methods                                                                      |
+ *------------------------------------------------------------------------------*/
+
+static int Insert(lua_State *L)
+/* id = bp:insert(obj, [min, max]) */
+    {
+    ud_t *ud;
+    aabb_t box;
+    broadphase_t *bp = checkbroadphase(L, 1, &ud);
+    if(lua_isnoneornil(L, 2)) return argerror(L, 2, ERR_NOTPRESENT);
+    if(!lua_isnoneornil(L, 3))
+        checkaabb(L, 3, &box);
+    else
+        {
+        shape_t *shape = testshape(L, 2, NULL);
+        if(!shape) return argerror(L, 3, ERR_NOTPRESENT);
+        shape_aabb(shape, &box);
+        }
+    lua_pushinteger(L, broadphase_insert(L, bp, ud, 2, &box));
+    return 1;
+    }
+
+static int Remove(lua_State *L)
+    {
+    ud_t *ud;
+    broadphase_t *bp = checkbroadphase(L, 1, &ud);
+    int id = broadphase_checkid(L, bp, 2);
+    broadphase_remove(L, bp, ud, id);
+    return 0;
+    }
+
+static int Update(lua_State *L)
+/* bp:update(id, [min, max]) */
+    {
+    ud_t *ud;
+    aabb_t box;
+    broadphase_t *bp = checkbroadphase(L, 1, &ud);
+    int id = broadphase_checkid(L, bp, 2);
+    if(!lua_isnoneornil(L, 3))
+        checkaabb(L, 3, &box);
+    else
+        ShapeBox(L, ud, bp, id, &box);
+    broadphase_update(L, bp, id, &box);
+    return 0;
+    }
+
+static int UpdateAll(lua_State *L)
+/* bp:update_all([buffer])
+ * buffer = { min1x, min1y, min1z, max1x, max1y, max1z, min2x, ... } (indexed by id)
+ *
+ * bp:update_all(positions, extent)
+ * positions = { pos1x, pos1y, pos1z, pos2x, ... } (indexed by id)
+ *
+ * bp:update_all(ccdpar)
+ */
+    {
+    ud_t *ud, *ccdud;
+    int id, i, k, stride;
+    real_t extent = 0;
+    aabb_t box;
+    broadphase_t *bp = checkbroadphase(L, 1, &ud);
+    if(testccd(L, 2, &ccdud))
+        {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[OBJECTS]);
+        for(id = 1; id <= bp->size; id++)
+            {
+            if(!bp->used[id]) continue;
+            lua_rawgeti(L, -1, id);
+            ccdpar_aabb(L, ccdud, -1, &box);
+            lua_pop(L, 1);
+            broadphase_update(L, bp, id, &box);
+            }
+        lua_pop(L, 1);
+        return 0;
+        }
+    if(lua_isnoneornil(L, 2))
+        {
+        for(id = 1; id <= bp->size; id++)
+            {
+            if(!bp->used[id]) continue;
+            ShapeBox(L, ud, bp, id, &box);
+            broadphase_update(L, bp, id, &box);
+            }
+        return 0;
+        }
+    if(!lua_istable(L, 2)) return argerror(L, 2, ERR_TABLE);
+    stride = 6;
+    if(!lua_isnoneornil(L, 3))
+        {
+        extent = luaL_checknumber(L, 3);
+        if(extent < 0) return argerror(L, 3, ERR_VALUE);
+        stride = 3;
+        }
+    for(id = 1; id <= bp->size; id++)
+        {
+        if(!bp->used[id]) continue;
+        k = stride*(id-1);
+        for(i = 0; i < 3; i++)
+            {
+            if(stride == 3)
+                {
+                lua_rawgeti(L, 2, k+i+1);
+                if(!lua_isnumber(L, -1))
+                    return luaL_error(L, "missing or invalid position for object %d", id);
+                box.min.v[i] = lua_tonumber(L, -1) - extent;
+                box.max.v[i] = lua_tonumber(L, -1) + extent;
+                lua_pop(L, 1);
+                continue;
+                }
+            lua_rawgeti(L, 2, k+i+1);
+            lua_rawgeti(L, 2, k+i+4);
+            if(!lua_isnumber(L, -2) || !lua_isnumber(L, -1))
+                return luaL_error(L, "missing or invalid bounds for object %d", id);
+            box.min.v[i] = lua_tonumber(L, -2);
+            box.max.v[i] = lua_tonumber(L, -1);
+            lua_pop(L, 2);
+            if(box.min.v[i] > box.max.v[i])
+                return luaL_error(L, "invalid bounds for object %d", id);
+            }
+        broadphase_update(L, bp, id, &box);
+        }
+    return 0;
+    }
+
+static int Aabb(lua_State *L)
+    {
+    broadphase_t *bp = checkbroadphase(L, 1, NULL);
+    int id = broadphase_checkid(L, bp, 2);
+    pushaabb(L, &bp->aabb[id]);
+    return 2;
+    }
+
+static int Object(lua_State *L)
+    {
+    ud_t *ud;
+    broadphase_t *bp = checkbroadphase(L, 1, &ud);
+    int id = broadphase_checkid(L, bp, 2);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[OBJECTS]);
+    lua_rawgeti(L, -1, id);
+    return 1;
+    }
+
+static int Count(lua_State *L)
+    {
+    broadphase_t *bp = checkbroadphase(L, 1, NULL);
+    lua_pushinteger(L, bp->count);
+    return 1;
+    }
+
+static int Kind(lua_State *L)
+    {
+    broadphase_t *bp = checkbroadphase(L, 1, NULL);
+    lua_pushstring(L, bp->cls->name);
+    return 1;
+    }
+
+int pushpairs(lua_State *L, ud_t *ud, const pairbuf_t *buf, int ids)
+/* Pushes the list of pairs in buf, as {{obj1, obj2}, ...}, or {{id1, id2}, ...} */
+    {
+    int i, objects;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[OBJECTS]);
+    objects = lua_gettop(L);
+    lua_createtable(L, buf->count, 0);
+    for(i = 0; i < buf->count; i++)
+        {
+        lua_createtable(L, 2, 0);
+        if(ids)
+            {
+            lua_pushinteger(L, buf->ids[2*i]);
+            lua_rawseti(L, -2, 1);
+            lua_pushinteger(L, buf->ids[2*i+1]);
+            lua_rawseti(L, -2, 2);
+            }
+        else
+            {
+            lua_rawgeti(L, objects, buf->ids[2*i]);
+            lua_rawseti(L, -2, 1);
+            lua_rawgeti(L, objects, buf->ids[2*i+1]);
+            lua_rawseti(L, -2, 2);
+            }
+        lua_rawseti(L, -2, i+1);
+        }
+    lua_remove(L, objects);
+    return 1;
+    }
+
+static int Pairs(lua_State *L)
+/* pairs = bp:pairs([ids]) */
+    {
+    ud_t *ud;
+    broadphase_t *bp = checkbroadphase(L, 1, &ud);
+    int ids = optboolean(L, 2, 0);
+    broadphase_pairs(L, bp);
+    return pushpairs(L, ud, &bp->pairs, ids);
+    }
+
+void broadphase_query(lua_State *L, broadphase_t *bp, const aabb_t *box)
+/* Finds the ids whose boxes overlap box, and puts them in bp->hits */
+    {
+    bp->hits.count = 0;
+    if(bp->cls->query)
+        bp->cls->query(L, bp, box, &bp->hits);
+    else
+        broadphase_scan(L, bp, box, &bp->hits);
+    }
+
+/*------------------------------------------------------------------------------*
+ | k nearest neighbors                                                          |
+ *------------------------------------------------------------------------------*/
+
+/* Best-first search: the candidates (nodes of an acceleration structure, or objects) are
+ * visited in order of increasing lower bound of their distance from the query object,
+ * given by the distance between the boxes, and the search stops as soon as the next lower
+ * bound is not less than the distance of the k-th neighbor found so far (or exceeds maxdist).
+ * The items in the queue are nodes if >= 0 (class specific), or objects if < 0 (-id).
+ */
+
+real_t knn_bound(const knn_t *nn)
+/* Distance beyond which the candidates can be pruned */
+    {
+    if(nn->count == nn->k && nn->dist[nn->k-1] < nn->maxdist)
+        return nn->dist[nn->k-1];
+    return nn->maxdist;
+    }
+
+int knn_closer(const knn_t *nn, real_t key)
+/* 1 if a candidate with the given lower bound may be closer than the k-th neighbor */
+    {
+    return key <= nn->maxdist && (nn->count < nn->k || key < nn->dist[nn->k-1]);
+    }
+
+void knn_push(lua_State *L, knn_t *nn, real_t key, int item)
+    {
+    int i, parent;
+    if(nn->hcount == nn->hsize)
+        {
+        int size = nn->hsize ? 2*nn->hsize : 64;
+        nn->heap = Realloc(L, nn->heap, nn->hsize*sizeof(*nn->heap), size*sizeof(*nn->heap));
+        nn->hsize = size;
+        }
+    for(i = nn->hcount++; i > 0; i = parent)
+        {
+        parent = (i-1)/2;
+        if(nn->heap[parent].key <= key) break;
+        nn->heap[i] = nn->heap[parent];
+        }
+    nn->heap[i].key = key;
+    nn->heap[i].item = item;
+    }
+
+int knn_pop(knn_t *nn, real_t *key, int *item)
+/* Pops the item with the least key. Returns 0 if the queue is empty */
+    {
+    int i, child, n;
+    if(nn->hcount == 0) return 0;
+    *key = nn->heap[0].key;
+    *item = nn->heap[0].item;
+    n = --nn->hcount;
+    for(i = 0; (child = 2*i+1) < n; i = child)
+        {
+        if(child+1 < n && nn->heap[child+1].key < nn->heap[child].key) child++;
+        if(nn->heap[n].key <= nn->heap[child].key) break;
+        nn->heap[i] = nn->heap[child];
+        }
+    nn->heap[i] = nn->heap[n];
+    return 1;
+    }
+
+void knn_test(knn_t *nn, int id)
+/* Computes the exact distance of the object id, and adds it to the neighbors if it is
+ * among the k nearest ones found so far */
+    {
+    int i;
+    real_t bound = knn_bound(nn);
+    real_t dist = nn->distance(nn->data, id, bound);
+    if(dist < CCD_ZERO || dist > bound || (dist == bound && nn->count == nn->k)) return;
+    i = nn->count < nn->k ? nn->count++ : nn->k-1;
+    for(; i > 0 && nn->dist[i-1] > dist; i--)
+        {
+        nn->ids[i] = nn->ids[i-1];
+        nn->dist[i] = nn->dist[i-1];
+        }
+    nn->ids[i] = id;
+    nn->dist[i] = dist;
+    }
+
+void knn_release(lua_State *L, knn_t *nn)
+    {
+    if(nn->heap) Free(L, nn->heap);
+    if(nn->ids) Free(L, nn->ids);
+    if(nn->dist) Free(L, nn->dist);
+    memset(nn, 0, sizeof(knn_t));
+    }
+
+void broadphase_nearest(lua_State *L, broadphase_t *bp, knn_t *nn)
+/* Finds the k nearest objects to the query object (nn->box, k, maxdist, distance and
+ * data must be set, with k > 0), and puts them in nn->ids and nn->dist */
+    {
+    int id, item;
+    real_t key;
+    if(nn->ksize < nn->k)
+        {
+        nn->ids = Realloc(L, nn->ids, nn->ksize*sizeof(int), nn->k*sizeof(int));
+        nn->dist = Realloc(L, nn->dist, nn->ksize*sizeof(real_t), nn->k*sizeof(real_t));
+        nn->ksize = nn->k;
+        }
+    nn->count = nn->hcount = 0;
+    if(bp->cls->nearest)
+        { bp->cls->nearest(L, bp, nn); return; }
+    for(id = 1; id <= bp->size; id++)
+        {
+        if(!bp->used[id]) continue;
+        key = aabb_distance(&nn->box, &bp->aabb[id]);
+        if(key <= nn->maxdist) knn_push(L, nn, key, -id);
+        }
+    while(knn_pop(nn, &key, &item) && knn_closer(nn, key))
+        knn_test(nn, -item);
+    }
+
+static int PushHits(lua_State *L, ud_t *ud, broadphase_t *bp, int ids, int exclude)
+/* Pushes the list of objects (or ids) in bp->hits, except the given id and, if it
+ * is not 0, the ones that do not pass the filters with it */
+    {
+    int i, n, objects;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[OBJECTS]);
+    objects = lua_gettop(L);
+    lua_createtable(L, bp->hits.count, 0);
+    n = 0;
+    for(i = 0; i < bp->hits.count; i++)
+        {
+        if(bp->hits.ids[i] == exclude) continue;
+        if(exclude && !broadphase_accept(bp, exclude, bp->hits.ids[i])) continue;
+        if(ids)
+            lua_pushinteger(L, bp->hits.ids[i]);
+        else
+            lua_rawgeti(L, objects, bp->hits.ids[i]);
+        lua_rawseti(L, -2, ++n);
+        }
+    lua_remove(L, objects);
+    return 1;
+    }
+
+static int Query(lua_State *L)
+/* hits = bp:query(min, max, [ids]) */
+    {
+    ud_t *ud;
+    aabb_t box;
+    broadphase_t *bp = checkbroadphase(L, 1, &ud);
+    int ids = optboolean(L, 4, 0);
+    checkaabb(L, 2, &box);
+    broadphase_query(L, bp, &box);
+    return PushHits(L, ud, bp, ids, 0);
+    }
+
+static int Neighbors(lua_State *L)
+/* neighbors = bp:neighbors(id, [ids]) */
+    {
+    ud_t *ud;
+    broadphase_t *bp = checkbroadphase(L, 1, &ud);
+    int id = broadphase_checkid(L, bp, 2);
+    int ids = optboolean(L, 3, 0);
+    broadphase_query(L, bp, &bp->aabb[id]);
+    return PushHits(L, ud, bp, ids, id);
+    }
+
+static int SetFilter(lua_State *L)
+/* bp:set_filter(id, category, mask, [group]) */
+    {
+    filter_t filter;
+    broadphase_t *bp = checkbroadphase(L, 1, NULL);
+    int id = broadphase_checkid(L, bp, 2);
+    checkfilter(L, 3, &filter);
+    broadphase_setfilter(bp, id, &filter);
+    return 0;
+    }
+
+static int Filter(lua_State *L)
+/* category, mask, group = bp:filter(id) */
+    {
+    broadphase_t *bp = checkbroadphase(L, 1, NULL);
+    int id = broadphase_checkid(L, bp, 2);
+    return pushfilter(L, &bp->filter[id]);
+    }
+
+static int Exclude(lua_State *L)
+/* bp:exclude(id1, id2, [boolean]) */
+    {
+    broadphase_t *bp = checkbroadphase(L, 1, NULL);
+    int id1 = broadphase_checkid(L, bp, 2);
+    int id2 = broadphase_checkid(L, bp, 3);
+    int on = optboolean(L, 4, 1);
+    if(id1 == id2) return argerror(L, 3, ERR_VALUE);
+    if(on)
+        {
+        exclset_add(L, &bp->excluded, id1, id2);
+        bp->filtering = 1;
+        }
+    else
+        exclset_remove(&bp->excluded, id1, id2);
+    return 0;
+    }
+
+static int Excluded(lua_State *L)
+/* boolean = bp:excluded(id1, id2) */
+    {
+    broadphase_t *bp = checkbroadphase(L, 1, NULL);
+    int id1 = broadphase_checkid(L, bp, 2);
+    int id2 = broadphase_checkid(L, bp, 3);
+    lua_pushboolean(L, exclset_has(&bp->excluded, id1, id2));
+    return 1;
+    }
+
+static int SetIdle(lua_State *L)
+/* bp:set_idle(id, boolean) */
+    {
+    broadphase_t *bp = checkbroadphase(L, 1, NULL);
+    int id = broadphase_checkid(L, bp, 2);
+    broadphase_setidle(bp, id, checkboolean(L, 3));
+    return 0;
+    }
+
+static int Idle(lua_State *L)
+    {
+    broadphase_t *bp = checkbroadphase(L, 1, NULL);
+    int id = broadphase_checkid(L, bp, 2);
+    lua_pushboolean(L, bp->idle[id]);
+    return 1;
+    }
+
+static int Accept(lua_State *L)
+/* boolean = bp:accept(id1, id2) */
+    {
+    broadphase_t *bp = checkbroadphase(L, 1, NULL);
+    int id1 = broadphase_checkid(L, bp, 2);
+    int id2 = broadphase_checkid(L, bp, 3);
+    lua_pushboolean(L, id1 != id2 && broadphase_filter(bp, id1, id2));
+    return 1;
+    }
+
+DESTROY_FUNC(broadphase)
+
+static const struct luaL_Reg Methods[] = 
+    {
+        { "free", Destroy },
+        { "kind", Kind },
+        { "insert", Insert },
+        { "remove", Remove },
+        { "update", Update },
+        { "update_all", UpdateAll },
+        { "aabb", Aabb },
+        { "object", Object },
+        { "count", Count },
+        { "pairs", Pairs },
+        { "query", Query },
+        { "neighbors", Neighbors },
+        { "set_filter", SetFilter },
+        { "filter", Filter },
+        { "exclude", Exclude },
+        { "excluded", Excluded },
+        { "set_idle", SetIdle },
+        { "idle", Idle },
+        { "accept", Accept },
+        { NULL, NULL } /* sentinel */
+    };
+
+static const struct luaL_Reg MetaMethods[] = 
+    {
+        { "__gc",  Destroy },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonccd_open_broadphase(lua_State *L)
+    {
+    udata_define(L, BROADPHASE_MT, Methods, MetaMethods);
+    }
+
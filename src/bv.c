@@ -0,0 +1,614 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* Bounding volumes: bounding spheres, oriented bounding boxes (OBB), and k-DOPs
+ * (discrete oriented polytopes, i.e. the intersection of k/2 slabs with fixed normals).
+ *
+ * For native shapes, the sphere and the OBB are computed once in the local frame of the
+ * shape (closed forms, or PCA of the points of convex hulls) and then transformed with
+ * the current pose. For other objects, they are computed from support points sampled
+ * along the 26-DOP directions, with the support functions of a ccdpar.
+ *
+ * The k-DOP axes are the coordinate axes (k=6), plus the 4 corner diagonals (k=14), or
+ * the 6 edge diagonals (k=18), or both (k=26). They are not normalized, so the k-DOP
+ * values are the projections of the object on them as listed in Axes[].
+ */
+
+static const real_t Axes[KDOP_MAXAXES][3] = {
+    { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 },                             /* faces */
+    { 1, 1, 1 }, { 1, 1, -1 }, { 1, -1, 1 }, { -1, 1, 1 },              /* corners */
+    { 1, 1, 0 }, { 1, 0, 1 }, { 0, 1, 1 }, { 1, -1, 0 }, { 1, 0, -1 }, { 0, 1, -1 }, /* edges */
+};
+
+static int KdopAxes(int k, int *index)
+/* Fills index[] with the indices in Axes[] of the axes of a k-DOP, and returns their number */
+    {
+    int i, n = 0;
+    for(i = 0; i < 3; i++) index[n++] = i;
+    if(k == 14 || k == 26) for(i = 3; i < 7; i++) index[n++] = i;
+    if(k == 18 || k == 26) for(i = 7; i < 13; i++) index[n++] = i;
+    return n;
+    }
+
+static void Axis(int i, vec3_t *axis)
+    {
+    ccdVec3Set(axis, Axes[i][0], Axes[i][1], Axes[i][2]);
+    }
+
+/*------------------------------------------------------------------------------*
+ | Principal component analysis                                                 |
+ *------------------------------------------------------------------------------*/
+
+static void Jacobi(real_t a[3][3], vec3_t axis[3])
+/* Eigenvectors of the symmetric matrix a (destroyed), with the cyclic Jacobi method */
+    {
+    int p, q, k, sweep;
+    real_t theta, t, c, s, x, y, v[3][3] = { {1, 0, 0}, {0, 1, 0}, {0, 0, 1} };
+    for(sweep = 0; sweep < 32; sweep++)
+        {
+        if(a[0][1]*a[0][1] + a[0][2]*a[0][2] + a[1][2]*a[1][2] < CCD_EPS*CCD_EPS) break;
+        for(p = 0; p < 2; p++)
+            for(q = p+1; q < 3; q++)
+                {
+                if(CCD_FABS(a[p][q]) < CCD_EPS*CCD_EPS) continue;
+                theta = (a[q][q] - a[p][p])/(2*a[p][q]);
+                t = CCD_ONE/(CCD_FABS(theta) + CCD_SQRT(theta*theta + CCD_ONE));
+                if(theta < 0) t = -t;
+                c = CCD_ONE/CCD_SQRT(t*t + CCD_ONE);
+                s = t*c;
+                for(k = 0; k < 3; k++) /* a = a*J */
+                    {
+                    x = a[k][p]; y = a[k][q];
+                    a[k][p] = c*x - s*y; a[k][q] = s*x + c*y;
+                    }
+                for(k = 0; k < 3; k++) /* a = J^T*a */
+                    {
+                    x = a[p][k]; y = a[q][k];
+                    a[p][k] = c*x - s*y; a[q][k] = s*x + c*y;
+                    }
+                for(k = 0; k < 3; k++) /* v = v*J */
+                    {
+                    x = v[k][p]; y = v[k][q];
+                    v[k][p] = c*x - s*y; v[k][q] = s*x + c*y;
+                    }
+                }
+        }
+    for(k = 0; k < 3; k++)
+        ccdVec3Set(&axis[k], v[0][k], v[1][k], v[2][k]);
+    ccdVec3Normalize(&axis[0]);
+    ccdVec3Normalize(&axis[1]);
+    ccdVec3Cross(&axis[2], &axis[0], &axis[1]); /* right-handed */
+    ccdVec3Normalize(&axis[2]);
+    }
+
+static void PrincipalAxes(const vec3_t *points, int n, vec3_t axis[3])
+/* Principal axes of a set of points (eigenvectors of their covariance matrix) */
+    {
+    int i, j, k;
+    real_t cov[3][3];
+    vec3_t mean, d;
+    ccdVec3Set(&mean, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    for(k = 0; k < n; k++) ccdVec3Add(&mean, &points[k]);
+    ccdVec3Scale(&mean, CCD_ONE/n);
+    memset(cov, 0, sizeof(cov));
+    for(k = 0; k < n; k++)
+        {
+        ccdVec3Sub2(&d, &points[k], &mean);
+        for(i = 0; i < 3; i++)
+            for(j = i; j < 3; j++)
+                cov[i][j] += d.v[i]*d.v[j];
+        }
+    cov[1][0] = cov[0][1]; cov[2][0] = cov[0][2]; cov[2][1] = cov[1][2];
+    Jacobi(cov, axis);
+    }
+
+static void Fit(obb_t *obb, const real_t min[3], const real_t max[3])
+/* Sets the center and the half extents of obb, given the min and max projections of
+ * the object on its axes */
+    {
+    int i;
+    vec3_t v;
+    ccdVec3Set(&obb->center, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    for(i = 0; i < 3; i++)
+        {
+        obb->half.v[i] = (max[i] - min[i])/2;
+        ccdVec3Copy(&v, &obb->axis[i]);
+        ccdVec3Scale(&v, (max[i] + min[i])/2);
+        ccdVec3Add(&obb->center, &v);
+        }
+    }
+
+/*------------------------------------------------------------------------------*
+ | Native shapes                                                                |
+ *------------------------------------------------------------------------------*/
+
+static void Local(shape_t *shape)
+/* Computes the bounding sphere and the OBB of the shape in its local frame */
+    {
+    int i, k;
+    real_t r, min[3], max[3], p;
+    vec3_t d;
+    bsphere_t *sphere = &shape->lsphere;
+    obb_t *obb = &shape->lobb;
+    if(shape->bvlocal) return;
+    for(i = 0; i < 3; i++)
+        {
+        ccdVec3Set(&obb->axis[i], CCD_ZERO, CCD_ZERO, CCD_ZERO);
+        obb->axis[i].v[i] = CCD_ONE;
+        }
+    ccdVec3Set(&obb->center, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    ccdVec3Set(&sphere->center, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    switch(shape->kind)
+        {
+        case SHAPE_SPHERE:
+            sphere->radius = shape->radius;
+            ccdVec3Set(&obb->half, shape->radius, shape->radius, shape->radius);
+            break;
+        case SHAPE_CAPSULE:
+            sphere->radius = shape->radius + shape->half_height;
+            ccdVec3Set(&obb->half, shape->radius, shape->radius, shape->radius + shape->half_height);
+            break;
+        case SHAPE_BOX:
+            sphere->radius = CCD_SQRT(ccdVec3Len2(&shape->half));
+            ccdVec3Copy(&obb->half, &shape->half);
+            break;
+        case SHAPE_CONVEX:
+            PrincipalAxes(shape->points, shape->count, obb->axis);
+            for(i = 0; i < 3; i++) { min[i] = CCD_REAL_MAX; max[i] = -CCD_REAL_MAX; }
+            for(k = 0; k < shape->count; k++)
+                for(i = 0; i < 3; i++)
+                    {
+                    p = ccdVec3Dot(&shape->points[k], &obb->axis[i]);
+                    if(p < min[i]) min[i] = p;
+                    if(p > max[i]) max[i] = p;
+                    }
+            Fit(obb, min, max);
+            /* sphere centered at the center of the OBB */
+            ccdVec3Copy(&sphere->center, &obb->center);
+            sphere->radius = CCD_ZERO;
+            for(k = 0; k < shape->count; k++)
+                {
+                ccdVec3Sub2(&d, &shape->points[k], &sphere->center);
+                r = ccdVec3Len2(&d);
+                if(r > sphere->radius) sphere->radius = r;
+                }
+            sphere->radius = CCD_SQRT(sphere->radius);
+            break;
+        case SHAPE_PLANE: /* unbounded */
+        default:
+            sphere->radius = CCD_REAL_MAX;
+            ccdVec3Set(&obb->half, CCD_REAL_MAX, CCD_REAL_MAX, CCD_REAL_MAX);
+        }
+    shape->bvlocal = 1;
+    }
+
+static void ToGlobal(const shape_t *shape, vec3_t *v)
+    {
+    ccdQuatRotVec(v, &shape->quat);
+    ccdVec3Add(v, &shape->pos);
+    }
+
+void shape_bsphere(shape_t *shape, bsphere_t *sphere)
+/* Bounding sphere of the shape in its current pose */
+    {
+    Local(shape);
+    *sphere = shape->lsphere;
+    ToGlobal(shape, &sphere->center);
+    }
+
+void shape_obb(shape_t *shape, obb_t *obb)
+/* Oriented bounding box of the shape in its current pose */
+    {
+    int i;
+    Local(shape);
+    *obb = shape->lobb;
+    ToGlobal(shape, &obb->center);
+    for(i = 0; i < 3; i++) ccdQuatRotVec(&obb->axis[i], &shape->quat);
+    }
+
+void shape_kdop(const shape_t *shape, int k, kdop_t *kdop)
+/* k-DOP of the shape in its current pose */
+    {
+    int i, j, index[KDOP_MAXAXES];
+    real_t p;
+    vec3_t axis, dir, v;
+    kdop->k = k;
+    kdop->n = KdopAxes(k, index);
+    for(i = 0; i < kdop->n; i++)
+        {
+        Axis(index[i], &axis);
+        if(shape->kind == SHAPE_CONVEX) /* one pass over the points */
+            {
+            kdop->min[i] = CCD_REAL_MAX; kdop->max[i] = -CCD_REAL_MAX;
+            ccdVec3Copy(&dir, &axis);
+            ccdQuatRotVec(&dir, &shape->inv); /* axis in the local frame */
+            for(j = 0; j < shape->count; j++)
+                {
+                p = ccdVec3Dot(&shape->points[j], &dir);
+                if(p < kdop->min[i]) kdop->min[i] = p;
+                if(p > kdop->max[i]) kdop->max[i] = p;
+                }
+            p = ccdVec3Dot(&shape->pos, &axis);
+            kdop->min[i] += p; kdop->max[i] += p;
+            continue;
+            }
+        shape_support(shape, &axis, &v);
+        kdop->max[i] = ccdVec3Dot(&v, &axis);
+        ccdVec3Copy(&dir, &axis);
+        ccdVec3Scale(&dir, -CCD_ONE);
+        shape_support(shape, &dir, &v);
+        kdop->min[i] = ccdVec3Dot(&v, &axis);
+        }
+    }
+
+/*------------------------------------------------------------------------------*
+ | Overlap tests                                                                |
+ *------------------------------------------------------------------------------*/
+
+int bsphere_overlap(const bsphere_t *a, const bsphere_t *b)
+    {
+    real_t r = a->radius + b->radius;
+    return ccdVec3Dist2(&a->center, &b->center) <= r*r;
+    }
+
+int obb_separated_along(const obb_t *a, const obb_t *b, const vec3_t *axis)
+/* Returns 1 if the projections of the two OBBs on the axis do not overlap */
+    {
+    int i;
+    real_t ra = CCD_ZERO, rb = CCD_ZERO;
+    vec3_t t;
+    ccdVec3Sub2(&t, &b->center, &a->center);
+    for(i = 0; i < 3; i++)
+        {
+        ra += a->half.v[i]*CCD_FABS(ccdVec3Dot(&a->axis[i], axis));
+        rb += b->half.v[i]*CCD_FABS(ccdVec3Dot(&b->axis[i], axis));
+        }
+    return CCD_FABS(ccdVec3Dot(&t, axis)) > ra + rb;
+    }
+
+int obb_separated(const obb_t *a, const obb_t *b, vec3_t *axis)
+/* Separating axis test on the 15 candidate axes. Returns 1 if the OBBs are separated,
+ * and the separating axis in axis (if not NULL), or 0 if they overlap */
+    {
+    int i, j;
+    vec3_t l;
+    for(i = 0; i < 3; i++)
+        {
+        if(obb_separated_along(a, b, &a->axis[i]))
+            { if(axis) ccdVec3Copy(axis, &a->axis[i]); return 1; }
+        if(obb_separated_along(a, b, &b->axis[i]))
+            { if(axis) ccdVec3Copy(axis, &b->axis[i]); return 1; }
+        }
+    for(i = 0; i < 3; i++)
+        for(j = 0; j < 3; j++)
+            {
+            ccdVec3Cross(&l, &a->axis[i], &b->axis[j]);
+            if(ccdVec3Len2(&l) < CCD_EPS) continue; /* parallel edges: covered by the face axes */
+            if(obb_separated_along(a, b, &l))
+                { if(axis) ccdVec3Copy(axis, &l); return 1; }
+            }
+    return 0;
+    }
+
+int kdop_overlap(const kdop_t *a, const kdop_t *b)
+/* The two k-DOPs must have the same k */
+    {
+    int i;
+    for(i = 0; i < a->n; i++)
+        if(a->max[i] < b->min[i] || b->max[i] < a->min[i]) return 0;
+    return 1;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Support function objects                                                     |
+ *------------------------------------------------------------------------------*/
+
+static void Sample(lua_State *L, ud_t *ud, int arg, vec3_t points[2*KDOP_MAXAXES])
+/* Samples the support points of the object at arg along the 26-DOP directions
+ * (points[2*i] along Axes[i], points[2*i+1] along -Axes[i]) */
+    {
+    int i;
+    vec3_t dirs[2*KDOP_MAXAXES];
+    for(i = 0; i < KDOP_MAXAXES; i++)
+        {
+        Axis(i, &dirs[2*i]);
+        Axis(i, &dirs[2*i+1]);
+        ccdVec3Scale(&dirs[2*i+1], -CCD_ONE);
+        }
+    ccdpar_supports(L, ud, arg, dirs, 2*KDOP_MAXAXES, points);
+    }
+
+static void SampledObb(lua_State *L, ud_t *ud, int arg, obb_t *obb)
+/* OBB with the principal axes of the sampled support points, and extents given by the
+ * support points along the axes */
+    {
+    int i;
+    real_t min[3], max[3];
+    vec3_t points[2*KDOP_MAXAXES], dirs[6], ext[6];
+    Sample(L, ud, arg, points);
+    PrincipalAxes(points, 2*KDOP_MAXAXES, obb->axis);
+    for(i = 0; i < 3; i++)
+        {
+        ccdVec3Copy(&dirs[2*i], &obb->axis[i]);
+        ccdVec3Copy(&dirs[2*i+1], &obb->axis[i]);
+        ccdVec3Scale(&dirs[2*i+1], -CCD_ONE);
+        }
+    ccdpar_supports(L, ud, arg, dirs, 6, ext);
+    for(i = 0; i < 3; i++)
+        {
+        max[i] = ccdVec3Dot(&ext[2*i], &obb->axis[i]);
+        min[i] = ccdVec3Dot(&ext[2*i+1], &obb->axis[i]);
+        }
+    Fit(obb, min, max);
+    }
+
+/*------------------------------------------------------------------------------*
+ | Lua functions                                                                |
+ *------------------------------------------------------------------------------*/
+
+static shape_t *CheckObject(lua_State *L, ud_t **ud)
+/* Checks the arguments (shape) or (ccdpar, obj). Returns the shape, if any, or NULL and
+ * the ccdpar in ud */
+    {
+    shape_t *shape = testshape(L, 1, NULL);
+    if(shape)
+        {
+        if(shape->kind == SHAPE_PLANE) luaL_error(L, "unbounded shape");
+        return shape;
+        }
+    checkccd(L, 1, ud);
+    luaL_checkany(L, 2);
+    shape = testshape(L, 2, NULL);
+    if(shape && shape->kind == SHAPE_PLANE) luaL_error(L, "unbounded shape");
+    return shape;
+    }
+
+static void AxesToQuat(const vec3_t axis[3], quat_t *q)
+/* Rotation quaternion whose matrix has the given columns */
+    {
+    real_t s, t, m[3][3];
+    int i, j;
+    for(i = 0; i < 3; i++)
+        for(j = 0; j < 3; j++)
+            m[i][j] = axis[j].v[i];
+    t = m[0][0] + m[1][1] + m[2][2];
+    if(t > 0)
+        {
+        s = CCD_SQRT(t + CCD_ONE)*2;
+        ccdQuatSet(q, (m[2][1] - m[1][2])/s, (m[0][2] - m[2][0])/s, (m[1][0] - m[0][1])/s, s/4);
+        }
+    else if(m[0][0] > m[1][1] && m[0][0] > m[2][2])
+        {
+        s = CCD_SQRT(CCD_ONE + m[0][0] - m[1][1] - m[2][2])*2;
+        ccdQuatSet(q, s/4, (m[0][1] + m[1][0])/s, (m[0][2] + m[2][0])/s, (m[2][1] - m[1][2])/s);
+        }
+    else if(m[1][1] > m[2][2])
+        {
+        s = CCD_SQRT(CCD_ONE + m[1][1] - m[0][0] - m[2][2])*2;
+        ccdQuatSet(q, (m[0][1] + m[1][0])/s, s/4, (m[1][2] + m[2][1])/s, (m[0][2] - m[2][0])/s);
+        }
+    else
+        {
+        s = CCD_SQRT(CCD_ONE + m[2][2] - m[0][0] - m[1][1])*2;
+        ccdQuatSet(q, (m[0][2] + m[2][0])/s, (m[1][2] + m[2][1])/s, s/4, (m[1][0] - m[0][1])/s);
+        }
+    ccdQuatNormalize(q);
+    }
+
+static void QuatToAxes(const quat_t *q, vec3_t axis[3])
+    {
+    int i;
+    for(i = 0; i < 3; i++)
+        {
+        ccdVec3Set(&axis[i], CCD_ZERO, CCD_ZERO, CCD_ZERO);
+        axis[i].v[i] = CCD_ONE;
+        ccdQuatRotVec(&axis[i], q);
+        }
+    }
+
+static int PushObb(lua_State *L, const obb_t *obb)
+    {
+    quat_t q;
+    AxesToQuat(obb->axis, &q);
+    pushvec3(L, &obb->center);
+    pushquat(L, &q);
+    pushvec3(L, &obb->half);
+    return 3;
+    }
+
+static void CheckObb(lua_State *L, int arg, obb_t *obb)
+/* center, rot, half at arg, arg+1, arg+2 */
+    {
+    quat_t q;
+    checkvec3(L, arg, &obb->center);
+    checkquat(L, arg+1, &q);
+    ccdQuatNormalize(&q);
+    QuatToAxes(&q, obb->axis);
+    checkvec3(L, arg+2, &obb->half);
+    }
+
+static int CheckK(lua_State *L, int arg)
+    {
+    lua_Integer k = luaL_optinteger(L, arg, 26);
+    if(k != 6 && k != 14 && k != 18 && k != 26) return argerror(L, arg, ERR_VALUE);
+    return (int)k;
+    }
+
+static void CheckKdop(lua_State *L, int arg, kdop_t *kdop)
+/* {min1, max1, min2, max2, ...} */
+    {
+    int i, index[KDOP_MAXAXES];
+    if(!lua_istable(L, arg)) argerror(L, arg, ERR_TABLE);
+    kdop->k = (int)luaL_len(L, arg);
+    if(kdop->k != 6 && kdop->k != 14 && kdop->k != 18 && kdop->k != 26) argerror(L, arg, ERR_LENGTH);
+    kdop->n = KdopAxes(kdop->k, index);
+    for(i = 0; i < kdop->k; i++)
+        {
+        lua_rawgeti(L, arg, i+1);
+        if(!lua_isnumber(L, -1)) argerror(L, arg, ERR_TYPE);
+        if(i % 2 == 0) kdop->min[i/2] = lua_tonumber(L, -1);
+        else kdop->max[i/2] = lua_tonumber(L, -1);
+        lua_pop(L, 1);
+        }
+    }
+
+static int PushKdop(lua_State *L, const kdop_t *kdop)
+    {
+    int i;
+    lua_createtable(L, 2*kdop->n, 0);
+    for(i = 0; i < kdop->n; i++)
+        {
+        lua_pushnumber(L, kdop->min[i]);
+        lua_rawseti(L, -2, 2*i+1);
+        lua_pushnumber(L, kdop->max[i]);
+        lua_rawseti(L, -2, 2*i+2);
+        }
+    return 1;
+    }
+
+int bv_boundingsphere(lua_State *L)
+/* center, radius = ccd.bounding_sphere(shape)
+ * center, radius = ccd.bounding_sphere(ccdpar, obj)
+ */
+    {
+    ud_t *ud;
+    bsphere_t sphere;
+    aabb_t box;
+    shape_t *shape = CheckObject(L, &ud);
+    if(shape)
+        shape_bsphere(shape, &sphere);
+    else /* the sphere circumscribing the AABB */
+        {
+        ccdpar_aabb(L, ud, 2, &box);
+        ccdVec3Copy(&sphere.center, &box.min);
+        ccdVec3Add(&sphere.center, &box.max);
+        ccdVec3Scale(&sphere.center, CCD_REAL(0.5));
+        sphere.radius = CCD_SQRT(ccdVec3Dist2(&box.min, &box.max))/2;
+        }
+    pushvec3(L, &sphere.center);
+    lua_pushnumber(L, sphere.radius);
+    return 2;
+    }
+
+int bv_obb(lua_State *L)
+/* center, rot, half = ccd.obb(shape)
+ * center, rot, half = ccd.obb(ccdpar, obj)
+ */
+    {
+    ud_t *ud;
+    obb_t obb;
+    shape_t *shape = CheckObject(L, &ud);
+    if(shape)
+        shape_obb(shape, &obb);
+    else
+        SampledObb(L, ud, 2, &obb);
+    return PushObb(L, &obb);
+    }
+
+int bv_kdop(lua_State *L)
+/* kdop = ccd.kdop(shape, [k])
+ * kdop = ccd.kdop(ccdpar, obj, [k])
+ */
+    {
+    int i, k, index[KDOP_MAXAXES];
+    ud_t *ud;
+    kdop_t kdop;
+    vec3_t axis, points[2*KDOP_MAXAXES];
+    shape_t *shape = CheckObject(L, &ud);
+    if(shape && testshape(L, 1, NULL))
+        shape_kdop(shape, CheckK(L, 2), &kdop);
+    else if(shape)
+        shape_kdop(shape, CheckK(L, 3), &kdop);
+    else
+        {
+        k = CheckK(L, 3);
+        Sample(L, ud, 2, points);
+        kdop.k = k;
+        kdop.n = KdopAxes(k, index);
+        for(i = 0; i < kdop.n; i++)
+            {
+            Axis(index[i], &axis);
+            kdop.max[i] = ccdVec3Dot(&points[2*index[i]], &axis);
+            kdop.min[i] = ccdVec3Dot(&points[2*index[i]+1], &axis);
+            }
+        }
+    return PushKdop(L, &kdop);
+    }
+
+static int SphereOverlap(lua_State *L)
+/* boolean = ccd.sphere_overlap(center1, radius1, center2, radius2) */
+    {
+    bsphere_t a, b;
+    checkvec3(L, 1, &a.center);
+    a.radius = luaL_checknumber(L, 2);
+    checkvec3(L, 3, &b.center);
+    b.radius = luaL_checknumber(L, 4);
+    lua_pushboolean(L, bsphere_overlap(&a, &b));
+    return 1;
+    }
+
+static int ObbOverlap(lua_State *L)
+/* boolean, [axis] = ccd.obb_overlap(center1, rot1, half1, center2, rot2, half2) */
+    {
+    obb_t a, b;
+    vec3_t axis;
+    CheckObb(L, 1, &a);
+    CheckObb(L, 4, &b);
+    if(!obb_separated(&a, &b, &axis))
+        { lua_pushboolean(L, 1); return 1; }
+    lua_pushboolean(L, 0);
+    pushvec3(L, &axis);
+    return 2;
+    }
+
+static int KdopOverlap(lua_State *L)
+/* boolean = ccd.kdop_overlap(kdop1, kdop2) */
+    {
+    kdop_t a, b;
+    CheckKdop(L, 1, &a);
+    CheckKdop(L, 2, &b);
+    if(a.k != b.k) return argerror(L, 2, ERR_LENGTH);
+    lua_pushboolean(L, kdop_overlap(&a, &b));
+    return 1;
+    }
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "bounding_sphere", bv_boundingsphere },
+        { "obb", bv_obb },
+        { "kdop", bv_kdop },
+        { "sphere_overlap", SphereOverlap },
+        { "obb_overlap", ObbOverlap },
+        { "kdop_overlap", KdopOverlap },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonccd_open_bv(lua_State *L)
+    {
+    luaL_setfuncs(L, Functions, 0);
+    }
+
@@ -37,6 +37,8 @@ static void Center(const void *obj_, vec3_t *center);
 static int freeccd(lua_State *L, ud_t *ud)
     {
     ccd_t *ccd = (ccd_t*)ud->handle;
+    freechildren(L, PAIR_MT, ud);
+    if(IsValid(ud) && ud->info) midphase_reset(L, &ccdinfo(ud)->midphase);
     if(!freeuserdata(L, ud, "ccdpar")) return 0;
     Free(L, ccd);
     return 0;
@@ -52,13 +54,19 @@ static int newccd(lua_State *L, ccd_t *ccd, int ref[6])
     return 1;
     }
 
+#define AUTO_SAMPLES    16      /* default auto_samples */
+#define AUTO_MAX_ERROR  0.05    /* default auto_max_error */
+
 static int New(lua_State *L)
     {
     ccd_t ccd, *ccdp;
-    int ref[6];
+    lua_Integer samples;
+    double max_error;
+    autopen_t auto_;
+    int i, ref[6], midphase;
     int t = lua_type(L, 1);
     CCD_INIT(&ccd);
-    memset(ref, 0, 6*sizeof(int));
+    for(i = 0; i < 6; i++) ref[i] = LUA_NOREF;
     switch(t)
         {
         case LUA_TNONE:
@@ -81,6 +89,12 @@ static int New(lua_State *L)
     checkfn("center1", center1, Center, ref[3]);
     checkfn("center2", center2, Center, ref[4]);
 #undef checkfn
+    lua_getfield(L, 1, "support_batch");
+    if(lua_isfunction(L, -1))
+        Reference(L, -1, ref[5]);
+    else if(!lua_isnoneornil(L, -1))
+        return argerror(L, 1, ERR_FUNCTION);
+    lua_pop(L, 1);
     lua_getfield(L, 1, "max_iterations");
     ccd.max_iterations = luaL_optinteger(L, -1, ccd.max_iterations);
     lua_pop(L, 1);
@@ -93,9 +107,31 @@ static int New(lua_State *L)
     lua_getfield(L, 1, "dist_tolerance");
     ccd.dist_tolerance = luaL_optnumber(L, -1, ccd.dist_tolerance);
     lua_pop(L, 1);
+    lua_getfield(L, 1, "auto_samples");
+    samples = luaL_optinteger(L, -1, AUTO_SAMPLES);
+    lua_pop(L, 1);
+    lua_getfield(L, 1, "auto_max_error");
+    max_error = luaL_optnumber(L, -1, AUTO_MAX_ERROR);
+    lua_pop(L, 1);
+    if(samples < 1 || max_error < 0) return argerror(L, 1, ERR_VALUE);
+    autopen_init(&auto_, samples, max_error);
+    lua_getfield(L, 1, "auto_choices");
+    if(!lua_isnil(L, -1))
+        {
+        if(!lua_istable(L, -1)) return argerror(L, 1, ERR_TABLE);
+        autopen_setchoices(L, &auto_, lua_gettop(L));
+        }
+    lua_pop(L, 1);
+    lua_getfield(L, 1, "midphase");
+    midphase = optboolean(L, -1, 0);
+    lua_pop(L, 1);
     ccdp = Malloc(L, sizeof(ccd_t));
     memcpy(ccdp, &ccd, sizeof(ccd_t));
-    return newccd(L, ccdp, ref);
+    newccd(L, ccdp, ref);
+    UD(ccdp)->info = Malloc(L, sizeof(ccdinfo_t));
+    memcpy(&ccdinfo(UD(ccdp))->autopen, &auto_, sizeof(autopen_t));
+    ccdinfo(UD(ccdp))->midphase.enabled = midphase;
+    return 1;
     }
 
 static void FirstDir(const void *obj1, const void *obj2, vec3_t *dir)
@@ -157,23 +193,167 @@ static void Center(const void *obj_, vec3_t *center)
 #undef L
     }
 
-static int GJKIntersect(lua_State *L)
+static ccd_t *BindObjects(lua_State *L, ccd_t *c, const void **obj1, const void **obj2, int local)
+/* Copies in c the ccd_t of the ccdpar at PAR, replacing the support and center functions
+ * with the native ones for the objects that are shapes, and sets the objects to be passed
+ * to libccd in obj1 and obj2. */
     {
     ccd_t *ccd = checkccd(L, PAR, &Ud);
     luaL_checkany(L, OBJ1);
     luaL_checkany(L, OBJ2);
-    lua_pushboolean(L, ccdGJKIntersect((void*)OBJ1, (void*)OBJ2, ccd));
+    memcpy(c, ccd, sizeof(ccd_t));
+#ifdef MOONCCD_VENDORED_LIBCCD
+    arena_reset(); /* libccd frees everything it allocates within each call */
+#endif
+    *obj1 = shape_bind(L, OBJ1, c, 1, local);
+    *obj2 = shape_bind(L, OBJ2, c, 2, local);
+    return c;
+    }
+
+ccd_t *bindccd(lua_State *L, int ref, int ref1, int ref2, ccd_t *c, const void **obj1, const void **obj2)
+/* Replaces the contents of the stack with the ccdpar and the two objects referenced
+ * by ref, ref1 and ref2, so that the callbacks can find them where they expect.
+ * Returns in c the ccd_t to be passed to libccd, and in obj1 and obj2 the objects
+ * (OBJ1_ARG and OBJ2_ARG, or the native shapes). */
+    {
+    lua_settop(L, 0);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref1);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ref2);
+    return BindObjects(L, c, obj1, obj2, 0);
+    }
+
+#define Bind(L, c, obj1, obj2) BindObjects((L), (c), (obj1), (obj2), 0)
+
+static int Intersect(lua_State *L)
+    {
+    int rc;
+    real_t depth;
+    vec3_t dir, pos;
+    ccd_t c;
+    const void *obj1, *obj2;
+    Bind(L, &c, &obj1, &obj2);
+    rc = kernel_penetration(&c, obj1, obj2, &depth, &dir, &pos);
+    if(rc == KERNEL_NONE)
+        {
+        checkbounded(L, &c, obj1, obj2);
+        rc = ccdGJKIntersect(obj1, obj2, &c) ? 0 : -1;
+        }
+    return rc == 0;
+    }
+
+static int GJKIntersect(lua_State *L)
+    {
+    lua_pushboolean(L, Intersect(L));
     return 1;
     }
 
+static const shape_t *testbounded(lua_State *L, int arg)
+    {
+    shape_t *shape = testshape(L, arg, NULL);
+    return (shape && shape->kind != SHAPE_PLANE) ? shape : NULL;
+    }
+
+static int FilterPair(lua_State *L, int arg1, int arg2)
+/* Returns 0 if both objects are native shapes, and they do not pass their filters
+ * or they are both idle (static or sleeping) */
+    {
+    shape_t *shape1 = testshape(L, arg1, NULL);
+    shape_t *shape2 = testshape(L, arg2, NULL);
+    if(!shape1 || !shape2) return 1;
+    if(shape_idle(shape1) && shape_idle(shape2)) return 0;
+    return filter_accept(&shape1->filter, &shape2->filter);
+    }
+
+static int GJKIntersectBatch(lua_State *L)
+/* results = ccdpar:gjk_intersect_batch({{obj1, obj2}, ...})
+ * The pairs of native shapes that do not pass their collision filters, or that are
+ * both idle, are reported as not intersecting without running any query. The pairs of bounded native shapes
+ * are processed first, either through the midphase cascade if enabled (see midphase.c),
+ * or in parallel lanes (see lanes.c), then the other pairs are processed one at a time
+ * as by gjk_intersect.
+ */
+#define PAIRS 4
+#define RESULTS 5
+    {
+    int i, n, count = 0;
+    lanepair_t *pairs;
+    midphase_t *mp;
+    ccd_t *ccd = checkccd(L, PAR, &Ud);
+    mp = &ccdinfo(Ud)->midphase;
+    luaL_checktype(L, 2, LUA_TTABLE);
+    n = luaL_len(L, 2);
+    /* move the pairs to PAIRS, so that OBJ1 and OBJ2 can be used by the callbacks */
+    lua_settop(L, 2);
+    lua_pushnil(L);
+    lua_pushvalue(L, 2);
+    lua_newtable(L);
+    if(n == 0) return 1;
+    pairs = (lanepair_t*)Malloc(L, n*sizeof(lanepair_t));
+    for(i = 0; i < n; i++)
+        {
+        if(lua_rawgeti(L, PAIRS, i+1) != LUA_TTABLE)
+            { Free(L, pairs); return luaL_error(L, "invalid pair #%d", i+1); }
+        lua_rawgeti(L, -1, 1);
+        lua_rawgeti(L, -2, 2);
+        if(!FilterPair(L, -2, -1))
+            {
+            lua_pushboolean(L, 0);
+            lua_rawseti(L, RESULTS, i+1);
+            lua_pop(L, 3);
+            continue;
+            }
+        pairs[count].obj1 = testbounded(L, -2);
+        pairs[count].obj2 = testbounded(L, -1);
+        if(pairs[count].obj1 && pairs[count].obj2)
+            {
+            if(mp->enabled)
+                {
+                lua_pushboolean(L, midphase_intersect(L, mp, ccd,
+                        (shape_t*)pairs[count].obj1, (shape_t*)pairs[count].obj2));
+                lua_rawseti(L, RESULTS, i+1);
+                }
+            else
+                pairs[count++].index = i+1;
+            }
+        lua_pop(L, 3);
+        }
+    lanes_intersect(pairs, count, ccd->max_iterations);
+    for(i = 0; i < count; i++)
+        {
+        lua_pushboolean(L, pairs[i].hit);
+        lua_rawseti(L, RESULTS, pairs[i].index);
+        }
+    Free(L, pairs);
+    /* other pairs */
+    for(i = 0; i < n; i++)
+        {
+        if(lua_rawgeti(L, RESULTS, i+1) != LUA_TNIL) { lua_pop(L, 1); continue; }
+        lua_pop(L, 1);
+        lua_rawgeti(L, PAIRS, i+1);
+        lua_rawgeti(L, -1, 1);
+        lua_replace(L, OBJ1);
+        lua_rawgeti(L, -1, 2);
+        lua_replace(L, OBJ2);
+        lua_pop(L, 1);
+        lua_pushboolean(L, Intersect(L));
+        lua_rawseti(L, RESULTS, i+1);
+        }
+    lua_settop(L, RESULTS);
+    return 1;
+#undef PAIRS
+#undef RESULTS
+    }
+
 static int GJKSeparate(lua_State *L)
     {
     int rc;
     vec3_t sep;
-    ccd_t *ccd = checkccd(L, PAR, &Ud);
-    luaL_checkany(L, OBJ1);
-    luaL_checkany(L, OBJ2);
-    rc = ccdGJKSeparate((void*)OBJ1, (void*)OBJ2, ccd, &sep);
+    ccd_t c;
+    const void *obj1, *obj2;
+    Bind(L, &c, &obj1, &obj2);
+    checkbounded(L, &c, obj1, obj2);
+    rc = ccdGJKSeparate(obj1, obj2, &c, &sep);
     switch(rc)
         {
         case 0:     lua_pushboolean(L, 1);
@@ -190,12 +370,17 @@ static int GJKSeparate(lua_State *L)
 static int GJKPenetration(lua_State *L)
     {
     int rc;
-    double depth;
+    real_t depth;
     vec3_t dir, pos;
-    ccd_t *ccd = checkccd(L, PAR, &Ud);
-    luaL_checkany(L, OBJ1);
-    luaL_checkany(L, OBJ2);
-    rc = ccdGJKPenetration((void*)OBJ1, (void*)OBJ2, ccd, &depth,  &dir, &pos);
+    ccd_t c;
+    const void *obj1, *obj2;
+    Bind(L, &c, &obj1, &obj2);
+    rc = kernel_penetration(&c, obj1, obj2, &depth, &dir, &pos);
+    if(rc == KERNEL_NONE)
+        {
+        checkbounded(L, &c, obj1, obj2);
+        rc = ccdGJKPenetration(obj1, obj2, &c, &depth,  &dir, &pos);
+        }
     switch(rc)
         {
         case 0:     lua_pushboolean(L, 1);
@@ -213,22 +398,36 @@ static int GJKPenetration(lua_State *L)
 
 static int MPRIntersect(lua_State *L)
     {
-    ccd_t *ccd = checkccd(L, PAR, &Ud);
-    luaL_checkany(L, OBJ1);
-    luaL_checkany(L, OBJ2);
-    lua_pushboolean(L, ccdMPRIntersect((void*)OBJ1, (void*)OBJ2, ccd));
+    int rc;
+    real_t depth;
+    vec3_t dir, pos;
+    ccd_t c;
+    const void *obj1, *obj2;
+    Bind(L, &c, &obj1, &obj2);
+    rc = kernel_penetration(&c, obj1, obj2, &depth, &dir, &pos);
+    if(rc == KERNEL_NONE)
+        {
+        checkbounded(L, &c, obj1, obj2);
+        rc = ccdMPRIntersect(obj1, obj2, &c) ? 0 : -1;
+        }
+    lua_pushboolean(L, rc == 0);
     return 1;
     }
 
 static int MPRPenetration(lua_State *L)
     {
     int rc;
-    double depth;
+    real_t depth;
     vec3_t dir, pos;
-    ccd_t *ccd = checkccd(L, PAR, &Ud);
-    luaL_checkany(L, OBJ1);
-    luaL_checkany(L, OBJ2);
-    rc = ccdMPRPenetration((void*)OBJ1, (void*)OBJ2, ccd, &depth,  &dir, &pos);
+    ccd_t c;
+    const void *obj1, *obj2;
+    Bind(L, &c, &obj1, &obj2);
+    rc = kernel_penetration(&c, obj1, obj2, &depth, &dir, &pos);
+    if(rc == KERNEL_NONE)
+        {
+        checkbounded(L, &c, obj1, obj2);
+        rc = ccdMPRPenetration(obj1, obj2, &c, &depth,  &dir, &pos);
+        }
     switch(rc)
         {
         case 0:     lua_pushboolean(L, 1);
@@ -244,15 +443,288 @@ static int MPRPenetration(lua_State *L)
     return unexpected(L);
     }
 
+static int AutoPenetration(lua_State *L)
+    {
+    int rc;
+    real_t depth;
+    vec3_t dir, pos;
+    ccd_t c;
+    const void *obj1, *obj2;
+    Bind(L, &c, &obj1, &obj2);
+    if(!kernel_available(&c, obj1, obj2))
+        checkbounded(L, &c, obj1, obj2);
+    rc = autopen_penetration(&ccdinfo(Ud)->autopen, &c, obj1, obj2, &depth, &dir, &pos);
+    switch(rc)
+        {
+        case 0:     lua_pushboolean(L, 1);
+                    lua_pushnumber(L, depth);
+                    pushvec3(L, &dir);
+                    pushvec3(L, &pos);
+                    return 4;
+        case -1:    lua_pushboolean(L, 0);
+                    return 1;
+        case -2:    return errmemory(L);
+        default: break;
+        }
+    return unexpected(L);
+    }
+
+static int AutoChoices(lua_State *L)
+    {
+    ud_t *ud;
+    (void)checkccd(L, 1, &ud);
+    return autopen_pushchoices(L, &ccdinfo(ud)->autopen);
+    }
+
+static int AutoStats(lua_State *L)
+    {
+    ud_t *ud;
+    (void)checkccd(L, 1, &ud);
+    return autopen_pushstats(L, &ccdinfo(ud)->autopen);
+    }
+
+static int AutoFreeze(lua_State *L)
+    {
+    ud_t *ud;
+    (void)checkccd(L, 1, &ud);
+    if(lua_isnoneornil(L, 2))
+        autopen_freeze(&ccdinfo(ud)->autopen);
+    else
+        autopen_setchoices(L, &ccdinfo(ud)->autopen, 2);
+    return 0;
+    }
+
+static int AutoReset(lua_State *L)
+/* Discards the learned choices and statistics, keeping the frozen choices */
+    {
+    int k1, k2;
+    ud_t *ud;
+    autopen_t *a;
+    autostat_t *st;
+    (void)checkccd(L, 1, &ud);
+    a = &ccdinfo(ud)->autopen;
+    for(k1 = 0; k1 < AUTO_NKINDS; k1++)
+        for(k2 = k1; k2 < AUTO_NKINDS; k2++)
+            {
+            st = &a->stat[k1][k2];
+            if(st->frozen)
+                {
+                st->samples = st->hits = 0;
+                st->time[0] = st->time[1] = st->error = 0;
+                st->calls[0] = st->calls[1] = 0;
+                }
+            else
+                memset(st, 0, sizeof(autostat_t));
+            }
+    return 0;
+    }
+
+static int SetMidphase(lua_State *L)
+    {
+    ud_t *ud;
+    (void)checkccd(L, 1, &ud);
+    ccdinfo(ud)->midphase.enabled = checkboolean(L, 2);
+    return 0;
+    }
+
+static int MidphaseStats(lua_State *L)
+    {
+    ud_t *ud;
+    (void)checkccd(L, 1, &ud);
+    return midphase_pushstats(L, &ccdinfo(ud)->midphase);
+    }
+
+static int MidphaseReset(lua_State *L)
+/* Clears the counters and the cached separating axes */
+    {
+    ud_t *ud;
+    (void)checkccd(L, 1, &ud);
+    midphase_reset(L, &ccdinfo(ud)->midphase);
+    return 0;
+    }
+
+static int ShapeCast(lua_State *L)
+    {
+    int rc;
+    real_t toi;
+    vec3_t r, pos, normal;
+    ccd_t c;
+    const void *obj1, *obj2;
+    Bind(L, &c, &obj1, &obj2);
+    checkvec3(L, 4, &r);
+    checkbounded(L, &c, obj1, obj2);
+    rc = gjk_raycast(obj1, obj2, &c, &r, &toi, &pos, &normal);
+    if(rc != 0)
+        {
+        lua_pushboolean(L, 0);
+        if(rc == -1) return 1;
+        lua_pushstring(L, "not converged");
+        return 2;
+        }
+    lua_pushboolean(L, 1);
+    lua_pushnumber(L, toi);
+    pushvec3(L, &pos);
+    pushvec3(L, &normal);
+    return 4;
+    }
+
+void ccdpar_supports(lua_State *L, ud_t *ud, int arg, const vec3_t *dirs, int n, vec3_t *points)
+/* Computes the support points of the (non-native) object at arg along the n given
+ * directions, using the ccdpar ud: with a single call of the support_batch function,
+ * if given, or otherwise with n calls of support1.
+ */
+    {
+    int i;
+    arg = lua_absindex(L, arg);
+    if(ud->ref[5] != LUA_NOREF)
+        {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[5]);
+        lua_pushvalue(L, arg);
+        lua_createtable(L, n, 0);
+        for(i = 0; i < n; i++)
+            {
+            pushvec3(L, &dirs[i]);
+            lua_rawseti(L, -2, i+1);
+            }
+        if(lua_pcall(L, 2, 1, 0) != LUA_OK) lua_error(L);
+        if(!lua_istable(L, -1)) luaL_error(L, "support_batch must return a table");
+        for(i = 0; i < n; i++)
+            {
+            lua_rawgeti(L, -1, i+1);
+            if(testvec3(L, -1, &points[i]) != 0) luaL_error(L, "invalid support point #%d", i+1);
+            lua_pop(L, 1);
+            }
+        lua_pop(L, 1);
+        return;
+        }
+    if(!((ccd_t*)ud->handle)->support1) luaL_error(L, "missing support1 function");
+    for(i = 0; i < n; i++)
+        {
+        lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[1]);
+        lua_pushvalue(L, arg);
+        pushvec3(L, &dirs[i]);
+        if(lua_pcall(L, 2, 1, 0) != LUA_OK) lua_error(L);
+        checkvec3(L, -1, &points[i]);
+        lua_pop(L, 1);
+        }
+    }
+
+void ccdpar_aabb(lua_State *L, ud_t *ud, int arg, aabb_t *box)
+/* Computes the bounding box of the object at arg, using the ccdpar ud.
+ * For native shapes, the box is computed in closed form and cached (see shape_aabb()).
+ * For the other objects, it is computed from the support points along the six axis
+ * directions (see ccdpar_supports()).
+ */
+    {
+    int i;
+    vec3_t dirs[6], points[6];
+    shape_t *shape = testshape(L, arg, NULL);
+    if(shape) { shape_aabb(shape, box); return; }
+    for(i = 0; i < 6; i++) /* +x, -x, +y, -y, +z, -z */
+        {
+        ccdVec3Set(&dirs[i], CCD_ZERO, CCD_ZERO, CCD_ZERO);
+        dirs[i].v[i/2] = i % 2 == 0 ? CCD_ONE : -CCD_ONE;
+        }
+    ccdpar_supports(L, ud, arg, dirs, 6, points);
+    for(i = 0; i < 3; i++)
+        {
+        box->max.v[i] = points[2*i].v[i];
+        box->min.v[i] = points[2*i+1].v[i];
+        }
+    }
+
+static int Aabb(lua_State *L)
+/* min, max = ccdpar:aabb(obj)
+ * min, max = ccd.aabb(shape)
+ */
+    {
+    aabb_t box;
+    ud_t *ud;
+    shape_t *shape = testshape(L, 1, NULL);
+    if(shape)
+        shape_aabb(shape, &box);
+    else
+        {
+        checkccd(L, PAR, &ud);
+        luaL_checkany(L, OBJ1);
+        ccdpar_aabb(L, ud, OBJ1, &box);
+        }
+    pushaabb(L, &box);
+    return 2;
+    }
+
+static int WithinDistance(lua_State *L)
+    {
+    real_t dist;
+    gjk_simplex_t s;
+    ccd_t c;
+    const void *obj1, *obj2;
+    real_t margin = luaL_checknumber(L, 4);
+    Bind(L, &c, &obj1, &obj2);
+    if(margin < 0) return argerror(L, 4, ERR_VALUE);
+    checkbounded(L, &c, obj1, obj2);
+    s.count = 0;
+    if(gjk_distance(obj1, obj2, &c, &s, margin, &dist, NULL) == 1)
+        lua_pushboolean(L, 1);
+    else
+        lua_pushboolean(L, dist <= margin);
+    return 1;
+    }
+
+static int Toi(lua_State *L)
+    {
+    int rc;
+    real_t toi;
+    vec3_t pos1, pos2, normal;
+    motion_t m1, m2;
+    ccd_t c;
+    const void *obj1, *obj2;
+    real_t tolerance = luaL_optnumber(L, 6, 1e-3);
+    BindObjects(L, &c, &obj1, &obj2, 1); /* the motions replace the poses of shapes */
+    checkmotion(L, 4, &m1);
+    checkmotion(L, 5, &m2);
+    checkbounded(L, &c, obj1, obj2);
+    rc = rigid_toi(obj1, obj2, &c, &m1, &m2, tolerance, &toi, &pos1, &pos2, &normal);
+    if(rc != 0)
+        {
+        lua_pushboolean(L, 0);
+        if(rc == -1) return 1;
+        lua_pushstring(L, "not converged");
+        return 2;
+        }
+    lua_pushboolean(L, 1);
+    lua_pushnumber(L, toi);
+    pushvec3(L, &pos1);
+    pushvec3(L, &pos2);
+    pushvec3(L, &normal);
+    return 5;
+    }
+
 DESTROY_FUNC(ccd)
 
 static const struct luaL_Reg Methods[] = 
     {
         { "free", Destroy },
         { "gjk_intersect", GJKIntersect },
+        { "gjk_intersect_batch", GJKIntersectBatch },
+        { "aabb", Aabb },
+        { "bounding_sphere", bv_boundingsphere },
+        { "obb", bv_obb },
+        { "kdop", bv_kdop },
         { "gjk_separate", GJKSeparate },
         { "gjk_penetration", GJKPenetration },
         { "mpr_intersect", MPRIntersect },
+        { "auto_penetration", AutoPenetration },
+        { "auto_choices", AutoChoices },
+        { "auto_stats", AutoStats },
+        { "auto_freeze", AutoFreeze },
+        { "auto_reset", AutoReset },
+        { "set_midphase", SetMidphase },
+        { "midphase_stats", MidphaseStats },
+        { "midphase_reset", MidphaseReset },
+        { "shape_cast", ShapeCast },
+        { "toi", Toi },
+        { "within_distance", WithinDistance },
         { NULL, NULL } /* sentinel */
     };
 
@@ -267,10 +739,16 @@ static const struct luaL_Reg Functions[] =
         { "new", New },
         { "free", Destroy },
         { "gjk_intersect", GJKIntersect },
+        { "gjk_intersect_batch", GJKIntersectBatch },
+        { "aabb", Aabb },
         { "gjk_separate", GJKSeparate },
         { "gjk_penetration", GJKPenetration },
         { "mpr_intersect", MPRIntersect },
         { "mpr_penetration", MPRPenetration },
+        { "auto_penetration", AutoPenetration },
+        { "shape_cast", ShapeCast },
+        { "toi", Toi },
+        { "within_distance", WithinDistance },
         { NULL, NULL } /* sentinel */
     };
 
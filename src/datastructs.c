@@ -230,3 +230,37 @@ void pushquatlist(lua_State *L, const quat_t *vecs , int count)
         }
     }
 
+/* motion_t --------------------------------------------------------*/
+
+int testmotion(lua_State *L, int arg, motion_t *dst)
+/* motion = { pos0, quat0, pos1, quat1 } */
+    {
+    int ec;
+    int t = lua_type(L, arg);
+    switch(t)
+        {
+        case LUA_TNONE:
+        case LUA_TNIL:  return ERR_NOTPRESENT;
+        case LUA_TTABLE: break;
+        default: return ERR_TABLE;
+        }
+    arg = lua_absindex(L, arg);
+#define GET(i, testxxx, dst) do {                               \
+    lua_rawgeti(L, arg, (i)); ec = testxxx(L, -1, (dst));       \
+    lua_pop(L, 1); if(ec) return ERR_VALUE;                     \
+} while(0)
+    GET(1, testvec3, &dst->pos0);
+    GET(2, testquat, &dst->quat0);
+    GET(3, testvec3, &dst->pos1);
+    GET(4, testquat, &dst->quat1);
+#undef GET
+    return 0;
+    }
+
+int checkmotion(lua_State *L, int arg, motion_t *dst)
+    {
+    int ec = testmotion(L, arg, dst);
+    if(ec) return argerror(L, arg, ec);
+    return ec;
+    }
+
@@ -0,0 +1,167 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+#include <limits.h>
+
+/* Collision filtering.
+ *
+ * Each object has a filter_t with a category bitmask (the layers it belongs to), a mask
+ * (the layers it collides with), and a group id. Two objects pass the filter if:
+ * - they are in the same non-zero group: if the group is positive (never filtered) or
+ *   negative (always filtered), regardless of category and mask;
+ * - otherwise, if the category of each one is in the mask of the other.
+ *
+ * In addition, a broadphase can have an exclusion set of specific pairs of ids, that is
+ * an open addressing hash set of (id1, id2) keys with id1 < id2.
+ */
+
+#define EMPTY 0                 /* ids are >= 1, so no valid key is 0 */
+#define DELETED (~(uint64_t)0)  /* tombstone */
+#define Key(id1, id2) ((id1) < (id2) ? \
+        ((uint64_t)(id1) << 32 | (uint64_t)(id2)) : ((uint64_t)(id2) << 32 | (uint64_t)(id1)))
+
+void filter_default(filter_t *filter)
+    {
+    filter->category = FILTER_CATEGORY;
+    filter->mask = FILTER_MASK;
+    filter->group = 0;
+    }
+
+int filter_accept(const filter_t *f1, const filter_t *f2)
+/* Returns 1 if the two objects pass the filter, 0 otherwise */
+    {
+    if(f1->group != 0 && f1->group == f2->group) return f1->group > 0;
+    return (f1->category & f2->mask) != 0 && (f2->category & f1->mask) != 0;
+    }
+
+int filter_isdefault(const filter_t *filter)
+    {
+    return filter->category == FILTER_CATEGORY && filter->mask == FILTER_MASK && filter->group == 0;
+    }
+
+void checkfilter(lua_State *L, int arg, filter_t *filter)
+/* category, mask, [group] starting at arg. The bitmasks are 32 bit wide. */
+    {
+    lua_Integer category = luaL_checkinteger(L, arg);
+    lua_Integer mask = luaL_checkinteger(L, arg+1);
+    lua_Integer group = luaL_optinteger(L, arg+2, 0);
+    if(category < 0 || category > 0xffffffff) argerror(L, arg, ERR_RANGE);
+    if(mask < 0 || mask > 0xffffffff) argerror(L, arg+1, ERR_RANGE);
+    if(group < INT_MIN || group > INT_MAX) argerror(L, arg+2, ERR_RANGE);
+    filter->category = (uint32_t)category;
+    filter->mask = (uint32_t)mask;
+    filter->group = (int)group;
+    }
+
+int pushfilter(lua_State *L, const filter_t *filter)
+    {
+    lua_pushinteger(L, filter->category);
+    lua_pushinteger(L, filter->mask);
+    lua_pushinteger(L, filter->group);
+    return 3;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Exclusion set                                                                |
+ *------------------------------------------------------------------------------*/
+
+static int Slot(const exclset_t *set, uint64_t key)
+/* Returns the slot where key is, or where it would be inserted */
+    {
+    int i = (int)((key * 0x9E3779B97F4A7C15ULL) >> 40) & (set->size-1);
+    int tomb = -1;
+    while(set->keys[i] != EMPTY)
+        {
+        if(set->keys[i] == key) return i;
+        if(set->keys[i] == DELETED && tomb < 0) tomb = i;
+        i = (i+1) & (set->size-1);
+        }
+    return tomb >= 0 ? tomb : i;
+    }
+
+static void Rehash(lua_State *L, exclset_t *set, int size)
+    {
+    int i, n = set->size;
+    uint64_t *keys = set->keys;
+    set->keys = Malloc(L, size*sizeof(uint64_t));
+    set->size = size;
+    set->used = set->count;
+    for(i = 0; i < n; i++)
+        if(keys[i] != EMPTY && keys[i] != DELETED) set->keys[Slot(set, keys[i])] = keys[i];
+    if(keys) Free(L, keys);
+    }
+
+int exclset_has(const exclset_t *set, int id1, int id2)
+    {
+    uint64_t key = Key(id1, id2);
+    if(set->count == 0) return 0;
+    return set->keys[Slot(set, key)] == key;
+    }
+
+void exclset_add(lua_State *L, exclset_t *set, int id1, int id2)
+    {
+    int i;
+    uint64_t key = Key(id1, id2);
+    if(2*(set->used+1) > set->size) /* keep the load factor (tombstones included) <= 1/2 */
+        Rehash(L, set, set->size == 0 ? 64 : (set->count+1 > set->size/4 ? 2*set->size : set->size));
+    i = Slot(set, key);
+    if(set->keys[i] == key) return;
+    if(set->keys[i] == EMPTY) set->used++;
+    set->keys[i] = key;
+    set->count++;
+    }
+
+void exclset_remove(exclset_t *set, int id1, int id2)
+    {
+    int i;
+    uint64_t key = Key(id1, id2);
+    if(set->count == 0) return;
+    i = Slot(set, key);
+    if(set->keys[i] != key) return;
+    set->keys[i] = DELETED;
+    set->count--;
+    }
+
+void exclset_purge(exclset_t *set, int id)
+/* Removes all the pairs involving id */
+    {
+    int i;
+    uint64_t k;
+    for(i = 0; i < set->size && set->count > 0; i++)
+        {
+        k = set->keys[i];
+        if(k == EMPTY || k == DELETED) continue;
+        if((int)(k >> 32) == id || (int)(k & 0xffffffff) == id)
+            { set->keys[i] = DELETED; set->count--; }
+        }
+    }
+
+void exclset_release(lua_State *L, exclset_t *set)
+    {
+    if(set->keys) Free(L, set->keys);
+    memset(set, 0, sizeof(exclset_t));
+    }
+
@@ -0,0 +1,391 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/* GJK-based queries that are not provided by libccd.
+ *
+ * The functions here have the same calling convention as the libccd ones, i.e. they
+ * receive two opaque objects and a ccd_t with the support functions to be used for them.
+ * The simplex is kept explicitly (with the support points on both objects) so that
+ * witness points can be recovered from its barycentric coordinates.
+ */
+
+#include "internal.h"
+
+static void Support(const void *obj1, const void *obj2, const ccd_t *ccd, const vec3_t *dir, gjk_vertex_t *vert)
+/* Computes the support point of the Minkowski difference obj1 - obj2 in the direction dir */
+    {
+    vec3_t d;
+    ccdVec3Copy(&d, dir);
+    ccdVec3Normalize(&d);
+    ccdVec3Copy(&vert->d, &d);
+    ccd->support1(obj1, &d, &vert->p1);
+    ccdVec3Scale(&d, -CCD_ONE);
+    ccd->support2(obj2, &d, &vert->p2);
+    ccdVec3Sub2(&vert->v, &vert->p1, &vert->p2);
+    }
+
+/*------------------------------------------------------------------------------*
+ | Closest point of a simplex to the origin                                     |
+ *------------------------------------------------------------------------------*/
+
+static void Segment(const vec3_t *a, const vec3_t *b, real_t bary[2])
+    {
+    real_t t, len2;
+    vec3_t ab;
+    ccdVec3Sub2(&ab, b, a);
+    len2 = ccdVec3Len2(&ab);
+    t = len2 > CCD_ZERO ? -ccdVec3Dot(a, &ab)/len2 : CCD_ZERO;
+    if(t <= CCD_ZERO) { bary[0] = CCD_ONE; bary[1] = CCD_ZERO; return; }
+    if(t >= CCD_ONE) { bary[0] = CCD_ZERO; bary[1] = CCD_ONE; return; }
+    bary[0] = CCD_ONE - t;
+    bary[1] = t;
+    }
+
+static void Triangle(const vec3_t *a, const vec3_t *b, const vec3_t *c, real_t bary[3])
+/* Voronoi regions test, see Ericson, 'Real-Time Collision Detection', 5.1.5 */
+    {
+    vec3_t ab, ac;
+    real_t d1, d2, d3, d4, d5, d6, va, vb, vc, v, w, denom;
+    ccdVec3Sub2(&ab, b, a);
+    ccdVec3Sub2(&ac, c, a);
+    bary[0] = bary[1] = bary[2] = CCD_ZERO;
+    d1 = -ccdVec3Dot(&ab, a);
+    d2 = -ccdVec3Dot(&ac, a);
+    if(d1 <= CCD_ZERO && d2 <= CCD_ZERO) { bary[0] = CCD_ONE; return; }
+    d3 = -ccdVec3Dot(&ab, b);
+    d4 = -ccdVec3Dot(&ac, b);
+    if(d3 >= CCD_ZERO && d4 <= d3) { bary[1] = CCD_ONE; return; }
+    vc = d1*d4 - d3*d2;
+    if(vc <= CCD_ZERO && d1 >= CCD_ZERO && d3 <= CCD_ZERO)
+        {
+        v = d1/(d1 - d3);
+        bary[0] = CCD_ONE - v; bary[1] = v;
+        return;
+        }
+    d5 = -ccdVec3Dot(&ab, c);
+    d6 = -ccdVec3Dot(&ac, c);
+    if(d6 >= CCD_ZERO && d5 <= d6) { bary[2] = CCD_ONE; return; }
+    vb = d5*d2 - d1*d6;
+    if(vb <= CCD_ZERO && d2 >= CCD_ZERO && d6 <= CCD_ZERO)
+        {
+        w = d2/(d2 - d6);
+        bary[0] = CCD_ONE - w; bary[2] = w;
+        return;
+        }
+    va = d3*d6 - d5*d4;
+    if(va <= CCD_ZERO && (d4 - d3) >= CCD_ZERO && (d5 - d6) >= CCD_ZERO)
+        {
+        w = (d4 - d3)/((d4 - d3) + (d5 - d6));
+        bary[1] = CCD_ONE - w; bary[2] = w;
+        return;
+        }
+    denom = va + vb + vc;
+    if(denom <= CCD_ZERO) /* degenerate triangle */
+        {
+        Segment(a, b, bary);
+        return;
+        }
+    v = vb/denom;
+    w = vc/denom;
+    bary[0] = CCD_ONE - v - w; bary[1] = v; bary[2] = w;
+    }
+
+static int OutsideOfPlane(const vec3_t *a, const vec3_t *b, const vec3_t *c, const vec3_t *d)
+/* Returns 1 if the origin and d are on opposite sides of the plane through a, b, c,
+ * or if the tetrahedron abcd is degenerate. */
+    {
+    vec3_t ab, ac, n, ad;
+    real_t signp, signd;
+    ccdVec3Sub2(&ab, b, a);
+    ccdVec3Sub2(&ac, c, a);
+    ccdVec3Cross(&n, &ab, &ac);
+    ccdVec3Sub2(&ad, d, a);
+    signp = -ccdVec3Dot(a, &n);
+    signd = ccdVec3Dot(&ad, &n);
+    if(signd*signd <= CCD_EPS*CCD_EPS*ccdVec3Len2(&n)*ccdVec3Len2(&ad)) return 1;
+    return signp*signd < CCD_ZERO;
+    }
+
+static real_t Volume(const vec3_t *a, const vec3_t *b, const vec3_t *c, const vec3_t *d)
+/* Signed volume (times 6) of the tetrahedron abcd */
+    {
+    vec3_t ab, ac, ad, n;
+    ccdVec3Sub2(&ab, b, a);
+    ccdVec3Sub2(&ac, c, a);
+    ccdVec3Sub2(&ad, d, a);
+    ccdVec3Cross(&n, &ac, &ad);
+    return ccdVec3Dot(&ab, &n);
+    }
+
+static int Tetrahedron(const vec3_t y[4], real_t bary[4])
+/* Returns 1 if the origin is inside the tetrahedron, otherwise sets bary to the
+ * barycentric coordinates of the point on its boundary closest to the origin. */
+    {
+    static const int face[4][4] = { {0,1,2,3}, {0,2,3,1}, {0,3,1,2}, {1,3,2,0} };
+    int i, j, outside = 0;
+    real_t b[3], dist2, best = CCD_REAL_MAX;
+    vec3_t p, q;
+    for(i=0; i<4; i++)
+        {
+        const int *f = face[i];
+        if(!OutsideOfPlane(&y[f[0]], &y[f[1]], &y[f[2]], &y[f[3]])) continue;
+        outside = 1;
+        Triangle(&y[f[0]], &y[f[1]], &y[f[2]], b);
+        ccdVec3Set(&p, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+        for(j=0; j<3; j++)
+            { ccdVec3Copy(&q, &y[f[j]]); ccdVec3Scale(&q, b[j]); ccdVec3Add(&p, &q); }
+        dist2 = ccdVec3Len2(&p);
+        if(dist2 < best)
+            {
+            best = dist2;
+            bary[f[0]] = b[0]; bary[f[1]] = b[1]; bary[f[2]] = b[2]; bary[f[3]] = CCD_ZERO;
+            }
+        }
+    if(!outside) /* barycentric coordinates of the origin */
+        {
+        real_t vol = Volume(&y[0], &y[1], &y[2], &y[3]);
+        ccdVec3Set(&p, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+        if(vol == CCD_ZERO) { for(i=0; i<4; i++) bary[i] = CCD_REAL(0.25); return 1; }
+        bary[0] = Volume(&p, &y[1], &y[2], &y[3])/vol;
+        bary[1] = Volume(&y[0], &p, &y[2], &y[3])/vol;
+        bary[2] = Volume(&y[0], &y[1], &p, &y[3])/vol;
+        bary[3] = CCD_ONE - bary[0] - bary[1] - bary[2];
+        }
+    return !outside;
+    }
+
+int gjk_closest(gjk_simplex_t *s, const vec3_t *x, vec3_t *c)
+/* Computes the point c of the simplex s closest to the point x, and reduces s to
+ * the smallest sub-simplex containing it, setting s->bary accordingly.
+ * Returns 1 if x is contained in the simplex (tetrahedron), 0 otherwise.
+ */
+    {
+    int i, n, contained = 0;
+    vec3_t y[4], q;
+    real_t bary[4];
+    for(i=0; i<s->count; i++)
+        ccdVec3Sub2(&y[i], &s->vert[i].v, x);
+    switch(s->count)
+        {
+        case 1: bary[0] = CCD_ONE; break;
+        case 2: Segment(&y[0], &y[1], bary); break;
+        case 3: Triangle(&y[0], &y[1], &y[2], bary); break;
+        case 4: contained = Tetrahedron(y, bary); break;
+        default: return 0;
+        }
+    if(contained)
+        {
+        for(i=0; i<4; i++) s->bary[i] = bary[i];
+        ccdVec3Copy(c, x);
+        return 1;
+        }
+    n = 0;
+    ccdVec3Set(c, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    for(i=0; i<s->count; i++)
+        {
+        if(bary[i] <= CCD_ZERO) continue;
+        s->vert[n] = s->vert[i];
+        s->bary[n] = bary[i];
+        ccdVec3Copy(&q, &s->vert[i].v);
+        ccdVec3Scale(&q, bary[i]);
+        ccdVec3Add(c, &q);
+        n++;
+        }
+    s->count = n;
+    return 0;
+    }
+
+void gjk_witness(const gjk_simplex_t *s, vec3_t *p1, vec3_t *p2)
+/* Computes the witness points on the two objects from the barycentric coordinates */
+    {
+    int i;
+    vec3_t q;
+    ccdVec3Set(p1, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    ccdVec3Set(p2, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    for(i=0; i<s->count; i++)
+        {
+        ccdVec3Copy(&q, &s->vert[i].p1); ccdVec3Scale(&q, s->bary[i]); ccdVec3Add(p1, &q);
+        ccdVec3Copy(&q, &s->vert[i].p2); ccdVec3Scale(&q, s->bary[i]); ccdVec3Add(p2, &q);
+        }
+    }
+
+static int IsInSimplex(const gjk_simplex_t *s, const vec3_t *v)
+    {
+    int i;
+    for(i=0; i<s->count; i++)
+        if(ccdVec3Eq(&s->vert[i].v, v)) return 1;
+    return 0;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Distance                                                                     |
+ *------------------------------------------------------------------------------*/
+
+int gjk_distance(const void *obj1, const void *obj2, const ccd_t *ccd, gjk_simplex_t *s,
+            real_t margin, real_t *dist, vec3_t *dir)
+/* Computes the distance between obj1 and obj2 (van den Bergen, 'A Fast and Robust GJK
+ * Implementation for Collision Detection of Convex Objects').
+ *
+ * Returns 1 if the objects intersect, 0 otherwise. In the latter case, *dist is the
+ * distance and s holds the simplex whose barycentric coordinates give the witness points
+ * (see gjk_witness()). Returns -2 if the iteration runs out of max_iterations before
+ * converging, with *dist set to the current estimate, which is only an upper bound for
+ * the distance. If dir is not NULL, it is set to the last search direction, i.e. the
+ * closest point of the Minkowski difference obj1 - obj2 to the origin.
+ *
+ * If margin >= 0, the iteration stops as soon as it is known whether the distance is
+ * greater than the margin or not. In this case *dist is a lower bound for the distance
+ * if this is greater than the margin, and an upper bound otherwise.
+ *
+ * If s->count > 0, the iteration is warm-started from the simplex s (typically the
+ * terminating simplex of a previous query on the same objects), whose vertices are
+ * re-evaluated with fresh support points in the same search directions. Otherwise,
+ * s->count must be 0 and the iteration starts from ccd->first_dir.
+ */
+    {
+    int i;
+    unsigned long iter;
+    real_t vv, vw, lower = CCD_ZERO, tol;
+    vec3_t v, d;
+    gjk_vertex_t p;
+
+    tol = ccd->dist_tolerance;
+    if(s->count > 0)
+        {
+        for(i=0; i<s->count; i++)
+            {
+            ccdVec3Copy(&d, &s->vert[i].d);
+            Support(obj1, obj2, ccd, &d, &s->vert[i]);
+            }
+        if(gjk_closest(s, ccd_vec3_origin, &v))
+            { *dist = CCD_ZERO; if(dir) ccdVec3Copy(dir, &v); return 1; }
+        }
+    else
+        {
+        ccd->first_dir(obj1, obj2, &d);
+        if(ccdVec3Len2(&d) == CCD_ZERO) ccdVec3Set(&d, CCD_ONE, CCD_ZERO, CCD_ZERO);
+        Support(obj1, obj2, ccd, &d, &p);
+        s->vert[s->count] = p;
+        s->bary[s->count++] = CCD_ONE;
+        ccdVec3Copy(&v, &p.v);
+        }
+
+    for(iter = 0; iter < ccd->max_iterations; iter++)
+        {
+        vv = ccdVec3Len2(&v);
+        if(vv <= tol*tol) break; /* touching */
+        if(margin >= CCD_ZERO && vv <= margin*margin)
+            { *dist = CCD_SQRT(vv); if(dir) ccdVec3Copy(dir, &v); return 0; }
+        ccdVec3Copy(&d, &v);
+        ccdVec3Scale(&d, -CCD_ONE);
+        Support(obj1, obj2, ccd, &d, &p);
+        vw = ccdVec3Dot(&v, &p.v);
+        if(vw > CCD_ZERO && vw*vw > lower*lower*vv) lower = vw/CCD_SQRT(vv);
+        if(margin >= CCD_ZERO && lower > margin)
+            { *dist = lower; if(dir) ccdVec3Copy(dir, &v); return 0; }
+        if(vv - vw <= tol*vv || IsInSimplex(s, &p.v)) /* converged */
+            { *dist = CCD_SQRT(vv); if(dir) ccdVec3Copy(dir, &v); return 0; }
+        s->vert[s->count++] = p;
+        if(gjk_closest(s, ccd_vec3_origin, &v)) break;
+        }
+    if(ccdVec3Len2(&v) > tol*tol) /* out of iterations */
+        { *dist = CCD_SQRT(ccdVec3Len2(&v)); if(dir) ccdVec3Copy(dir, &v); return -2; }
+    *dist = CCD_ZERO;
+    if(dir) ccdVec3Copy(dir, &v);
+    return 1;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Ray casting on the Minkowski difference                                      |
+ *------------------------------------------------------------------------------*/
+
+int gjk_raycast(const void *obj1, const void *obj2, const ccd_t *ccd, const vec3_t *r,
+            real_t *toi, vec3_t *pos, vec3_t *normal)
+/* Sweeps obj1 along the translation r against obj2 (van den Bergen, 'Ray Casting
+ * against General Convex Objects with Application to Continuous Collision Detection').
+ *
+ * Obj1 translated by t*r touches obj2 iff -t*r is in the Minkowski difference C = obj1 - obj2,
+ * so we cast the ray x(t) = -t*r from the origin against C.
+ * Returns 0 on hit, with the time of impact in toi (in [0,1], 0 if the objects already
+ * overlap), the contact point on obj2 in pos and the contact normal (from obj1 to obj2)
+ * in normal. Returns -1 if the objects do not touch within the sweep, and -2 if the
+ * iteration runs out of max_iterations before converging (a new support point already in
+ * the simplex means that x is on the boundary of C, i.e. convergence at contact).
+ */
+    {
+    unsigned long iter;
+    int hit = 0;
+    real_t lambda = CCD_ZERO, vw, vr, maxw2, eps2;
+    vec3_t x, v, w, rr, c, p1, p2;
+    gjk_simplex_t s;
+    gjk_vertex_t p;
+
+    ccdVec3Copy(&rr, r);
+    ccdVec3Scale(&rr, -CCD_ONE); /* ray direction */
+    ccdVec3Set(&x, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    ccdVec3Set(normal, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    eps2 = ccd->dist_tolerance*ccd->dist_tolerance;
+    s.count = 0;
+    /* v = x - (any point of C) */
+    if(ccdVec3Len2(r) > CCD_ZERO) Support(obj1, obj2, ccd, r, &p);
+    else { ccdVec3Set(&v, CCD_ONE, CCD_ZERO, CCD_ZERO); Support(obj1, obj2, ccd, &v, &p); }
+    ccdVec3Sub2(&v, &x, &p.v);
+    maxw2 = ccdVec3Len2(&v);
+
+    for(iter = 0; iter < ccd->max_iterations; iter++)
+        {
+        if(ccdVec3Len2(&v) <= eps2*(maxw2 > CCD_ONE ? maxw2 : CCD_ONE))
+            { hit = 1; break; } /* converged */
+        Support(obj1, obj2, ccd, &v, &p);
+        ccdVec3Sub2(&w, &x, &p.v);
+        vw = ccdVec3Dot(&v, &w);
+        if(vw > CCD_ZERO)
+            {
+            vr = ccdVec3Dot(&v, &rr);
+            if(vr >= CCD_ZERO) return -1; /* moving away */
+            lambda = lambda - vw/vr;
+            if(lambda > CCD_ONE) return -1; /* beyond the sweep */
+            ccdVec3Copy(&x, &rr);
+            ccdVec3Scale(&x, lambda);
+            ccdVec3Copy(normal, &v);
+            }
+        else if(IsInSimplex(&s, &p.v))
+            { hit = 1; break; } /* no progress: v.w >= |v|^2, so |v| is at rounding level */
+        s.vert[s.count++] = p;
+        if(gjk_closest(&s, &x, &c))
+            { hit = 1; break; } /* x inside C */
+        ccdVec3Sub2(&v, &x, &c);
+        ccdVec3Sub2(&w, &x, &p.v);
+        if(ccdVec3Len2(&w) > maxw2) maxw2 = ccdVec3Len2(&w);
+        }
+    if(!hit) return -2; /* out of iterations */
+
+    *toi = lambda;
+    gjk_witness(&s, &p1, &p2);
+    ccdVec3Copy(pos, &p2);
+    if(ccdVec3Len2(normal) > CCD_ZERO) ccdVec3Normalize(normal);
+    return 0;
+    }
+
@@ -0,0 +1,356 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* Uniform spatial hash broadphase.
+ *
+ * Space is divided in cubic cells of a given size, and each object is assigned to the
+ * cells overlapped by its box. The occupied cells are kept in an open-addressing hash
+ * table (linear probing), indexed by their integer coordinates.
+ *
+ * The structure is rebuilt from scratch at the first query after any change, which for
+ * objects that all move at every frame is cheaper than incremental updates. The rebuild
+ * is a counting sort: a first pass counts the objects in each cell, a prefix sum gives the
+ * start of each cell in a single array of ids, and a second pass scatters the ids there,
+ * so that the ids of each cell are contiguous in memory.
+ *
+ * A pair is reported only by the cell containing the min corner of the intersection of
+ * the two boxes, so that it is reported once even if the boxes share several cells.
+ * Objects overlapping too many cells (e.g. planes) are kept aside in a list, and tested
+ * against all the others.
+ */
+
+#define MAXCELLS 64 /* max number of cells per object (more = big object) */
+
+typedef struct {
+    int x, y, z;        /* cell coordinates */
+    int count;          /* number of ids in the cell (0 = empty slot) */
+    int start;          /* position of the first id in cellids */
+} cell_t;
+
+typedef struct {
+    int lo[3], hi[3];   /* range of cells */
+} range_t;
+
+typedef struct {
+    real_t cellsize;
+    int dirty;          /* 1 if the table must be rebuilt */
+    cell_t *cells;      /* hash table */
+    int tablesize;      /* number of slots (power of 2) */
+    int *entries;       /* slot of each (object, cell) entry, in rebuild order */
+    int *cellids;       /* ids, grouped by cell */
+    int nentries;       /* number of entries */
+    int entriessize;    /* allocated entries (and cellids) */
+    idbuf_t big;        /* ids of the big objects */
+    idbuf_t scan;       /* scratch buffer for broadphase_scan() */
+    unsigned char *isbig; /* isbig[id] = 1 if id is in big */
+    unsigned int *mark; /* mark[id] = stamp of the last query that found id */
+    unsigned int stamp;
+    int slots;          /* allocated ids (= bp->size) */
+} hash_t;
+
+static unsigned int Hash(int x, int y, int z)
+    {
+    return ((unsigned int)x*73856093u) ^ ((unsigned int)y*19349663u) ^ ((unsigned int)z*83492791u);
+    }
+
+static int Range(const hash_t *hash, const aabb_t *box, range_t *r)
+/* Computes the range of cells overlapped by box, and returns the number of cells
+ * (or MAXCELLS+1 if it is out of bounds or too large) */
+    {
+    int i;
+    double lo, hi;
+    long n = 1;
+    for(i = 0; i < 3; i++)
+        {
+        lo = floor(box->min.v[i]/hash->cellsize);
+        hi = floor(box->max.v[i]/hash->cellsize);
+        if(!(lo > -1e9 && hi < 1e9 && hi - lo < MAXCELLS)) /* also catches NaNs and infinities */
+            return MAXCELLS+1;
+        r->lo[i] = (int)lo;
+        r->hi[i] = (int)hi;
+        n *= r->hi[i] - r->lo[i] + 1;
+        }
+    return n > MAXCELLS ? MAXCELLS+1 : (int)n;
+    }
+
+static int Lookup(const hash_t *hash, int x, int y, int z)
+/* Returns the slot for the cell (x, y, z), which is either the slot where the
+ * cell is, or the empty slot where it should be inserted */
+    {
+    unsigned int mask = hash->tablesize - 1;
+    unsigned int slot = Hash(x, y, z) & mask;
+    cell_t *cell;
+    for(;;)
+        {
+        cell = &hash->cells[slot];
+        if(cell->count == 0 || (cell->x == x && cell->y == y && cell->z == z)) return slot;
+        slot = (slot + 1) & mask;
+        }
+    }
+
+static void Rebuild(lua_State *L, broadphase_t *bp)
+    {
+    hash_t *hash = (hash_t*)bp->data;
+    int id, x, y, z, k, slot, n, size, start;
+    range_t r;
+    cell_t *cell;
+
+    /* count the entries, and collect the big objects */
+    hash->big.count = 0;
+    n = 0;
+    for(id = 1; id <= bp->size; id++)
+        {
+        if(!bp->used[id]) continue;
+        k = Range(hash, &bp->aabb[id], &r);
+        hash->isbig[id] = k > MAXCELLS;
+        if(hash->isbig[id]) idbuf_add(L, &hash->big, id);
+        else n += k;
+        }
+    if(n > hash->entriessize)
+        {
+        size = hash->entriessize ? hash->entriessize : 64;
+        while(size < n) size *= 2;
+        hash->entries = Realloc(L, hash->entries, hash->entriessize*sizeof(int), size*sizeof(int));
+        hash->cellids = Realloc(L, hash->cellids, hash->entriessize*sizeof(int), size*sizeof(int));
+        hash->entriessize = size;
+        }
+    /* the table is kept at most half full */
+    size = hash->tablesize ? hash->tablesize : 64;
+    while(size < 2*n) size *= 2;
+    if(size > hash->tablesize)
+        {
+        if(hash->cells) Free(L, hash->cells);
+        hash->cells = Malloc(L, size*sizeof(cell_t));
+        hash->tablesize = size;
+        }
+    else
+        memset(hash->cells, 0, hash->tablesize*sizeof(cell_t));
+    hash->nentries = n;
+
+    /* first pass: find or insert the cells, and count their ids */
+    k = 0;
+    for(id = 1; id <= bp->size; id++)
+        {
+        if(!bp->used[id] || hash->isbig[id]) continue;
+        Range(hash, &bp->aabb[id], &r);
+        for(x = r.lo[0]; x <= r.hi[0]; x++)
+            for(y = r.lo[1]; y <= r.hi[1]; y++)
+                for(z = r.lo[2]; z <= r.hi[2]; z++)
+                    {
+                    slot = Lookup(hash, x, y, z);
+                    cell = &hash->cells[slot];
+                    if(cell->count++ == 0)
+                        { cell->x = x; cell->y = y; cell->z = z; }
+                    hash->entries[k++] = slot;
+                    }
+        }
+
+    /* prefix sum (start is used as cursor in the second pass, and restored after) */
+    start = 0;
+    for(slot = 0; slot < hash->tablesize; slot++)
+        {
+        hash->cells[slot].start = start;
+        start += hash->cells[slot].count;
+        }
+
+    /* second pass: scatter the ids, in the same order as the entries */
+    k = 0;
+    for(id = 1; id <= bp->size; id++)
+        {
+        if(!bp->used[id] || hash->isbig[id]) continue;
+        n = Range(hash, &bp->aabb[id], &r);
+        while(n-- > 0)
+            hash->cellids[hash->cells[hash->entries[k++]].start++] = id;
+        }
+    for(slot = 0; slot < hash->tablesize; slot++)
+        hash->cells[slot].start -= hash->cells[slot].count;
+    hash->dirty = 0;
+    }
+
+static int Owner(const hash_t *hash, const aabb_t *a, const aabb_t *b, const cell_t *cell)
+/* 1 if cell contains the min corner of the intersection of the boxes a and b */
+    {
+    return floor(CCD_FMAX(a->min.v[0], b->min.v[0])/hash->cellsize) == cell->x &&
+           floor(CCD_FMAX(a->min.v[1], b->min.v[1])/hash->cellsize) == cell->y &&
+           floor(CCD_FMAX(a->min.v[2], b->min.v[2])/hash->cellsize) == cell->z;
+    }
+
+static unsigned int NewStamp(hash_t *hash)
+    {
+    if(++hash->stamp == 0)
+        {
+        memset(hash->mark, 0, (hash->slots+1)*sizeof(unsigned int));
+        hash->stamp = 1;
+        }
+    return hash->stamp;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Hooks                                                                        |
+ *------------------------------------------------------------------------------*/
+
+static void HashFree(lua_State *L, broadphase_t *bp)
+    {
+    hash_t *hash = (hash_t*)bp->data;
+    if(hash->cells) Free(L, hash->cells);
+    if(hash->entries) Free(L, hash->entries);
+    if(hash->cellids) Free(L, hash->cellids);
+    if(hash->big.ids) Free(L, hash->big.ids);
+    if(hash->scan.ids) Free(L, hash->scan.ids);
+    if(hash->isbig) Free(L, hash->isbig);
+    if(hash->mark) Free(L, hash->mark);
+    Free(L, hash);
+    }
+
+static void HashResize(lua_State *L, broadphase_t *bp)
+    {
+    hash_t *hash = (hash_t*)bp->data;
+    hash->isbig = Realloc(L, hash->isbig, hash->slots+1, bp->size+1);
+    hash->mark = Realloc(L, hash->mark, (hash->slots+1)*sizeof(unsigned int), (bp->size+1)*sizeof(unsigned int));
+    hash->slots = bp->size;
+    }
+
+static void HashChanged(lua_State *L, broadphase_t *bp, int id)
+/* insert, remove and update hook */
+    {
+    (void)L; (void)id;
+    ((hash_t*)bp->data)->dirty = 1;
+    }
+
+static void HashPairs(lua_State *L, broadphase_t *bp, pairbuf_t *buf)
+    {
+    hash_t *hash = (hash_t*)bp->data;
+    int slot, i, j, k, a, b, *ids;
+    cell_t *cell;
+    if(hash->dirty) Rebuild(L, bp);
+    for(slot = 0; slot < hash->tablesize; slot++)
+        {
+        cell = &hash->cells[slot];
+        if(cell->count < 2) continue;
+        ids = hash->cellids + cell->start;
+        for(i = 0; i < cell->count; i++)
+            {
+            a = ids[i];
+            for(j = i+1; j < cell->count; j++)
+                {
+                b = ids[j];
+                if(aabb_overlap(&bp->aabb[a], &bp->aabb[b]) &&
+                        Owner(hash, &bp->aabb[a], &bp->aabb[b], cell) &&
+                        broadphase_accept(bp, a, b))
+                    pairbuf_add(L, buf, a, b);
+                }
+            }
+        }
+    /* big objects vs all the others */
+    for(k = 0; k < hash->big.count; k++)
+        {
+        a = hash->big.ids[k];
+        hash->scan.count = 0;
+        broadphase_scan(L, bp, &bp->aabb[a], &hash->scan);
+        for(i = 0; i < hash->scan.count; i++)
+            {
+            b = hash->scan.ids[i];
+            if(b != a && !(hash->isbig[b] && b < a) && broadphase_accept(bp, a, b))
+                pairbuf_add(L, buf, a, b);
+            }
+        }
+    }
+
+static void Add(lua_State *L, broadphase_t *bp, const cell_t *cell, const aabb_t *box, idbuf_t *buf)
+    {
+    hash_t *hash = (hash_t*)bp->data;
+    int i, id;
+    for(i = 0; i < cell->count; i++)
+        {
+        id = hash->cellids[cell->start + i];
+        if(hash->mark[id] == hash->stamp) continue;
+        hash->mark[id] = hash->stamp;
+        if(aabb_overlap(&bp->aabb[id], box)) idbuf_add(L, buf, id);
+        }
+    }
+
+static void HashQuery(lua_State *L, broadphase_t *bp, const aabb_t *box, idbuf_t *buf)
+    {
+    hash_t *hash = (hash_t*)bp->data;
+    int k, x, y, z, slot;
+    range_t r;
+    cell_t *cell;
+    if(hash->dirty) Rebuild(L, bp);
+    NewStamp(hash);
+    k = Range(hash, box, &r);
+    if(k > MAXCELLS)
+        {
+        /* large region: visit all the occupied cells */
+        for(slot = 0; slot < hash->tablesize; slot++)
+            if(hash->cells[slot].count > 0) Add(L, bp, &hash->cells[slot], box, buf);
+        }
+    else
+        {
+        for(x = r.lo[0]; x <= r.hi[0]; x++)
+            for(y = r.lo[1]; y <= r.hi[1]; y++)
+                for(z = r.lo[2]; z <= r.hi[2]; z++)
+                    {
+                    cell = &hash->cells[Lookup(hash, x, y, z)];
+                    if(cell->count > 0) Add(L, bp, cell, box, buf);
+                    }
+        }
+    for(k = 0; k < hash->big.count; k++)
+        if(aabb_overlap(&bp->aabb[hash->big.ids[k]], box)) idbuf_add(L, buf, hash->big.ids[k]);
+    }
+
+static const bpclass_t HashClass = {
+    "spatial_hash", HashFree, HashResize, HashChanged, HashChanged, HashChanged, HashPairs, HashQuery, NULL
+};
+
+/*------------------------------------------------------------------------------*
+ | Constructor                                                                  |
+ *------------------------------------------------------------------------------*/
+
+static int NewHash(lua_State *L)
+/* bp = ccd.spatial_hash(cellsize) */
+    {
+    hash_t *hash;
+    real_t cellsize = luaL_checknumber(L, 1);
+    if(!(cellsize > 0)) return argerror(L, 1, ERR_VALUE);
+    hash = Malloc(L, sizeof(hash_t));
+    hash->cellsize = cellsize;
+    hash->dirty = 1;
+    broadphase_new(L, &HashClass, hash);
+    return 1;
+    }
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "spatial_hash", NewHash },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonccd_open_hash(lua_State *L)
+    {
+    luaL_setfuncs(L, Functions, 0);
+    }
+
@@ -0,0 +1,341 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* Hierarchical grid broadphase.
+ *
+ * The grid has several levels, with cells of size cellsize*2^level. Each object lives
+ * in a single cell: the one containing the center of its box, at the lowest level whose
+ * cells are at least as large as the box. An object may thus only overlap objects whose
+ * centers are in the cells around its own, at its level or at higher levels, and each
+ * object is tested only against those (objects at lower levels test themselves against
+ * it), so that each pair is found once.
+ *
+ * The cells of all levels share a single hash table of buckets, each being a doubly
+ * linked list of ids (different cells may share a bucket), so that inserting, removing
+ * and moving an object are O(1). The table is doubled when the number of objects exceeds
+ * the number of buckets. Objects too large for the top level (e.g. planes) are kept aside
+ * and tested against all the others.
+ * (See C.Ericson, "Real-Time Collision Detection", 7.2.)
+ */
+
+#define MAXLEVELS 24
+#define NIL 0           /* ids start from 1 */
+#define BIG (-1)        /* level of big objects */
+
+typedef struct {
+    int x, y, z;        /* cell coordinates, at its level */
+    int level;          /* level, or BIG */
+    int bucket;         /* bucket (or -1 if big) */
+    int next, prev;     /* links in the bucket list (or in the big list) */
+} entry_t;
+
+typedef struct {
+    real_t cellsize;    /* cell size at level 0 */
+    int *buckets;       /* first id in each bucket (NIL = empty) */
+    int nbuckets;       /* number of buckets (power of 2) */
+    entry_t *entry;     /* entry[id] */
+    int slots;          /* allocated ids (= bp->size) */
+    int occupied[MAXLEVELS]; /* number of objects at each level */
+    int big;            /* first id in the big list */
+    int nbig;
+    idbuf_t scan;       /* scratch buffer for broadphase_scan() */
+} hgrid_t;
+
+static unsigned int Bucket(const hgrid_t *hgrid, int x, int y, int z, int level)
+    {
+    return (((unsigned int)x*73856093u) ^ ((unsigned int)y*19349663u) ^
+            ((unsigned int)z*83492791u) ^ ((unsigned int)level*67867979u)) & (hgrid->nbuckets - 1);
+    }
+
+static real_t Size(const hgrid_t *hgrid, int level)
+    {
+    return hgrid->cellsize*(real_t)(1u << level);
+    }
+
+static void Place(const hgrid_t *hgrid, const aabb_t *box, entry_t *e)
+/* Computes the level and the cell of an object */
+    {
+    int i;
+    real_t extent = 0, size;
+    double c[3];
+    for(i = 0; i < 3; i++)
+        if(box->max.v[i] - box->min.v[i] > extent) extent = box->max.v[i] - box->min.v[i];
+    size = hgrid->cellsize;
+    for(e->level = 0; e->level < MAXLEVELS && size < extent; e->level++) size *= 2;
+    if(e->level == MAXLEVELS)
+        { e->level = BIG; return; }
+    for(i = 0; i < 3; i++)
+        {
+        c[i] = floor((box->min.v[i] + box->max.v[i])/2/size);
+        if(!(c[i] > -1e9 && c[i] < 1e9)) /* also catches NaNs and infinities */
+            { e->level = BIG; return; }
+        }
+    e->x = (int)c[0]; e->y = (int)c[1]; e->z = (int)c[2];
+    }
+
+static void Link(hgrid_t *hgrid, int id)
+    {
+    entry_t *e = &hgrid->entry[id];
+    int *head;
+    if(e->level == BIG)
+        {
+        e->bucket = -1;
+        head = &hgrid->big;
+        hgrid->nbig++;
+        }
+    else
+        {
+        e->bucket = Bucket(hgrid, e->x, e->y, e->z, e->level);
+        head = &hgrid->buckets[e->bucket];
+        hgrid->occupied[e->level]++;
+        }
+    e->prev = NIL;
+    e->next = *head;
+    if(*head != NIL) hgrid->entry[*head].prev = id;
+    *head = id;
+    }
+
+static void Unlink(hgrid_t *hgrid, int id)
+    {
+    entry_t *e = &hgrid->entry[id];
+    int *head;
+    if(e->level == BIG)
+        {
+        head = &hgrid->big;
+        hgrid->nbig--;
+        }
+    else
+        {
+        head = &hgrid->buckets[e->bucket];
+        hgrid->occupied[e->level]--;
+        }
+    if(e->prev != NIL) hgrid->entry[e->prev].next = e->next;
+    else *head = e->next;
+    if(e->next != NIL) hgrid->entry[e->next].prev = e->prev;
+    }
+
+static void Rehash(lua_State *L, broadphase_t *bp)
+/* Doubles the number of buckets, and relinks all the objects */
+    {
+    hgrid_t *hgrid = (hgrid_t*)bp->data;
+    int id;
+    Free(L, hgrid->buckets);
+    hgrid->nbuckets *= 2;
+    hgrid->buckets = Malloc(L, hgrid->nbuckets*sizeof(int));
+    memset(hgrid->occupied, 0, sizeof(hgrid->occupied));
+    hgrid->big = NIL;
+    hgrid->nbig = 0;
+    for(id = 1; id <= bp->size; id++)
+        if(bp->used[id]) Link(hgrid, id);
+    }
+
+static int Range(const hgrid_t *hgrid, const aabb_t *box, int level, int lo[3], int hi[3], int limit)
+/* Computes the range of cells at the given level containing the centers of the boxes
+ * that may overlap box, and returns 0 if it has more than limit cells */
+    {
+    int i;
+    real_t size = Size(hgrid, level);
+    double l, h;
+    long n = 1;
+    for(i = 0; i < 3; i++)
+        {
+        l = floor((box->min.v[i] - size/2)/size);
+        h = floor((box->max.v[i] + size/2)/size);
+        if(!(l > -1e9 && h < 1e9)) return 0;
+        lo[i] = (int)l;
+        hi[i] = (int)h;
+        n *= hi[i] - lo[i] + 1;
+        if(n > limit) return 0;
+        }
+    return 1;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Hooks                                                                        |
+ *------------------------------------------------------------------------------*/
+
+static void HgridFree(lua_State *L, broadphase_t *bp)
+    {
+    hgrid_t *hgrid = (hgrid_t*)bp->data;
+    if(hgrid->buckets) Free(L, hgrid->buckets);
+    if(hgrid->entry) Free(L, hgrid->entry);
+    if(hgrid->scan.ids) Free(L, hgrid->scan.ids);
+    Free(L, hgrid);
+    }
+
+static void HgridResize(lua_State *L, broadphase_t *bp)
+    {
+    hgrid_t *hgrid = (hgrid_t*)bp->data;
+    hgrid->entry = Realloc(L, hgrid->entry, (hgrid->slots+1)*sizeof(entry_t), (bp->size+1)*sizeof(entry_t));
+    hgrid->slots = bp->size;
+    }
+
+static void HgridInsert(lua_State *L, broadphase_t *bp, int id)
+    {
+    hgrid_t *hgrid = (hgrid_t*)bp->data;
+    Place(hgrid, &bp->aabb[id], &hgrid->entry[id]);
+    Link(hgrid, id);
+    if(bp->count > hgrid->nbuckets) Rehash(L, bp);
+    }
+
+static void HgridRemove(lua_State *L, broadphase_t *bp, int id)
+    {
+    (void)L;
+    Unlink((hgrid_t*)bp->data, id);
+    }
+
+static void HgridUpdate(lua_State *L, broadphase_t *bp, int id)
+    {
+    hgrid_t *hgrid = (hgrid_t*)bp->data;
+    entry_t *e = &hgrid->entry[id];
+    entry_t moved;
+    (void)L;
+    Place(hgrid, &bp->aabb[id], &moved);
+    if(moved.level == e->level && (moved.level == BIG ||
+                (moved.x == e->x && moved.y == e->y && moved.z == e->z)))
+        return; /* still in the same cell */
+    Unlink(hgrid, id);
+    e->level = moved.level;
+    e->x = moved.x; e->y = moved.y; e->z = moved.z;
+    Link(hgrid, id);
+    }
+
+static void Visit(lua_State *L, broadphase_t *bp, const aabb_t *box, int level, int self,
+                    pairbuf_t *pairs, idbuf_t *ids)
+/* Visits the cells at the given level that may contain objects overlapping box.
+ * If self > 0, box is the box of the object self, and the pairs (self, id) are added
+ * to pairs (at its own level, only for id > self), otherwise the ids are added to ids. */
+    {
+    hgrid_t *hgrid = (hgrid_t*)bp->data;
+    int i, x, y, z, id, lo[3], hi[3];
+    entry_t *e;
+    if(!Range(hgrid, box, level, lo, hi, bp->count))
+        {
+        /* more cells than objects: scan all the objects, and keep those at this level */
+        hgrid->scan.count = 0;
+        broadphase_scan(L, bp, box, &hgrid->scan);
+        for(i = 0; i < hgrid->scan.count; i++)
+            {
+            id = hgrid->scan.ids[i];
+            if(hgrid->entry[id].level != level) continue;
+            if(self == 0)
+                idbuf_add(L, ids, id);
+            else if(id != self && (id > self || hgrid->entry[self].level != level) &&
+                    broadphase_accept(bp, self, id))
+                pairbuf_add(L, pairs, self, id);
+            }
+        return;
+        }
+    for(x = lo[0]; x <= hi[0]; x++)
+        for(y = lo[1]; y <= hi[1]; y++)
+            for(z = lo[2]; z <= hi[2]; z++)
+                {
+                id = hgrid->buckets[Bucket(hgrid, x, y, z, level)];
+                for( ; id != NIL; id = e->next)
+                    {
+                    e = &hgrid->entry[id];
+                    if(e->level != level || e->x != x || e->y != y || e->z != z) continue;
+                    if(!aabb_overlap(&bp->aabb[id], box)) continue;
+                    if(self == 0)
+                        idbuf_add(L, ids, id);
+                    else if(id != self && (id > self || hgrid->entry[self].level != level) &&
+                            broadphase_accept(bp, self, id))
+                        pairbuf_add(L, pairs, self, id);
+                    }
+                }
+    }
+
+static void HgridPairs(lua_State *L, broadphase_t *bp, pairbuf_t *buf)
+    {
+    hgrid_t *hgrid = (hgrid_t*)bp->data;
+    int i, id, other, level;
+    for(id = 1; id <= bp->size; id++)
+        {
+        if(!bp->used[id]) continue;
+        level = hgrid->entry[id].level;
+        if(level == BIG)
+            {
+            /* big objects vs all the others */
+            hgrid->scan.count = 0;
+            broadphase_scan(L, bp, &bp->aabb[id], &hgrid->scan);
+            for(i = 0; i < hgrid->scan.count; i++)
+                {
+                other = hgrid->scan.ids[i];
+                if(other != id && !(hgrid->entry[other].level == BIG && other < id) &&
+                        broadphase_accept(bp, id, other))
+                    pairbuf_add(L, buf, id, other);
+                }
+            continue;
+            }
+        for( ; level < MAXLEVELS; level++)
+            if(hgrid->occupied[level] > 0) Visit(L, bp, &bp->aabb[id], level, id, buf, NULL);
+        }
+    }
+
+static void HgridQuery(lua_State *L, broadphase_t *bp, const aabb_t *box, idbuf_t *buf)
+    {
+    hgrid_t *hgrid = (hgrid_t*)bp->data;
+    int id, level;
+    for(level = 0; level < MAXLEVELS; level++)
+        if(hgrid->occupied[level] > 0) Visit(L, bp, box, level, 0, NULL, buf);
+    for(id = hgrid->big; id != NIL; id = hgrid->entry[id].next)
+        if(aabb_overlap(&bp->aabb[id], box)) idbuf_add(L, buf, id);
+    }
+
+static const bpclass_t HgridClass = {
+    "hgrid", HgridFree, HgridResize, HgridInsert, HgridRemove, HgridUpdate, HgridPairs, HgridQuery, NULL
+};
+
+/*------------------------------------------------------------------------------*
+ | Constructor                                                                  |
+ *------------------------------------------------------------------------------*/
+
+static int NewHgrid(lua_State *L)
+/* bp = ccd.hgrid(cellsize) */
+    {
+    hgrid_t *hgrid;
+    real_t cellsize = luaL_checknumber(L, 1);
+    if(!(cellsize > 0)) return argerror(L, 1, ERR_VALUE);
+    hgrid = Malloc(L, sizeof(hgrid_t));
+    hgrid->cellsize = cellsize;
+    hgrid->nbuckets = 1024;
+    hgrid->buckets = Malloc(L, hgrid->nbuckets*sizeof(int));
+    broadphase_new(L, &HgridClass, hgrid);
+    return 1;
+    }
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "hgrid", NewHgrid },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonccd_open_hgrid(lua_State *L)
+    {
+    luaL_setfuncs(L, Functions, 0);
+    }
+
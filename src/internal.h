@@ -70,6 +70,8 @@ int notavailable(lua_State *L, ...);
 void *Malloc(lua_State *L, size_t size);
 #define MallocNoErr moonccd_MallocNoErr
 void *MallocNoErr(lua_State *L, size_t size);
+#define Realloc moonccd_Realloc
+void *Realloc(lua_State *L, void *ptr, size_t oldsize, size_t newsize);
 #define Strdup moonccd_Strdup
 char *Strdup(lua_State *L, const char *s);
 #define Free moonccd_Free
@@ -124,6 +126,509 @@ void pushquat(lua_State *L, const quat_t *val);
 quat_t *checkquatlist(lua_State *L, int arg, int *countp, int *err);
 #define pushquatlist moonccd_pushquatlist
 void pushquatlist(lua_State *L, const quat_t *vecs , int count);
+#define motion_t moonccd_motion_t
+typedef struct {
+    vec3_t pos0, pos1;  /* start and end positions */
+    quat_t quat0, quat1; /* start and end rotations */
+} motion_t;
+#define testmotion moonccd_testmotion
+int testmotion(lua_State *L, int arg, motion_t *dst);
+#define checkmotion moonccd_checkmotion
+int checkmotion(lua_State *L, int arg, motion_t *dst);
+
+/* gjk.c */
+#define gjk_vertex_t moonccd_gjk_vertex_t
+typedef struct {
+    vec3_t v;   /* point of the Minkowski difference obj1 - obj2 */
+    vec3_t p1;  /* support point on obj1 */
+    vec3_t p2;  /* support point on obj2 */
+    vec3_t d;   /* search direction the support points were computed for */
+} gjk_vertex_t;
+#define gjk_simplex_t moonccd_gjk_simplex_t
+typedef struct {
+    int count;
+    gjk_vertex_t vert[4];
+    real_t bary[4]; /* barycentric coordinates of the closest point */
+} gjk_simplex_t;
+#define gjk_closest moonccd_gjk_closest
+int gjk_closest(gjk_simplex_t *s, const vec3_t *x, vec3_t *c);
+#define gjk_witness moonccd_gjk_witness
+void gjk_witness(const gjk_simplex_t *s, vec3_t *p1, vec3_t *p2);
+#define gjk_distance moonccd_gjk_distance
+int gjk_distance(const void *obj1, const void *obj2, const ccd_t *ccd, gjk_simplex_t *s,
+            real_t margin, real_t *dist, vec3_t *dir);
+#define gjk_raycast moonccd_gjk_raycast
+int gjk_raycast(const void *obj1, const void *obj2, const ccd_t *ccd, const vec3_t *r,
+            real_t *toi, vec3_t *pos, vec3_t *normal);
+
+/* motion.c */
+#define posed_t moonccd_posed_t
+typedef struct {
+    const void *obj;        /* the wrapped object */
+    ccd_support_fn support; /* its support function (in its local frame) */
+    ccd_center_fn center;   /* its center function (may be NULL) */
+    vec3_t pos;             /* position */
+    quat_t quat;            /* rotation */
+    quat_t inv;             /* inverse rotation */
+} posed_t;
+#define posed_init moonccd_posed_init
+void posed_init(posed_t *p, const void *obj, ccd_support_fn support, ccd_center_fn center);
+#define posed_set moonccd_posed_set
+void posed_set(posed_t *p, const vec3_t *pos, const quat_t *quat);
+#define posed_support moonccd_posed_support
+void posed_support(const void *obj, const vec3_t *dir, vec3_t *vec);
+#define posed_center moonccd_posed_center
+void posed_center(const void *obj, vec3_t *center);
+#define rigid_toi moonccd_rigid_toi
+int rigid_toi(const void *obj1, const void *obj2, const ccd_t *ccd,
+        const motion_t *m1, const motion_t *m2, real_t tolerance,
+        real_t *toi, vec3_t *pos1, vec3_t *pos2, vec3_t *normal);
+
+#define aabb_t moonccd_aabb_t
+typedef struct {
+    vec3_t min, max;
+} aabb_t;
+#define bsphere_t moonccd_bsphere_t
+typedef struct {
+    vec3_t center;
+    real_t radius;
+} bsphere_t;
+#define obb_t moonccd_obb_t
+typedef struct {
+    vec3_t center;
+    vec3_t axis[3];     /* orthonormal, right-handed */
+    vec3_t half;        /* half extents along the axes */
+} obb_t;
+#define KDOP_MAXAXES 13
+#define kdop_t moonccd_kdop_t
+typedef struct {
+    int k;              /* 6, 14, 18 or 26 */
+    int n;              /* number of axes (k/2) */
+    real_t min[KDOP_MAXAXES], max[KDOP_MAXAXES]; /* projections on the axes (see bv.c) */
+} kdop_t;
+
+/* ccd.c */
+#define OBJ1_ARG ((void*)2) /* the stack positions of obj1 and obj2, as passed to libccd */
+#define OBJ2_ARG ((void*)3)
+#define bindccd moonccd_bindccd
+ccd_t *bindccd(lua_State *L, int ref, int ref1, int ref2, ccd_t *c, const void **obj1, const void **obj2);
+#define ccdpar_supports moonccd_ccdpar_supports
+void ccdpar_supports(lua_State *L, ud_t *ud, int arg, const vec3_t *dirs, int n, vec3_t *points);
+#define ccdpar_aabb moonccd_ccdpar_aabb
+void ccdpar_aabb(lua_State *L, ud_t *ud, int arg, aabb_t *box);
+
+/* filter.c */
+#define FILTER_CATEGORY 0x00000001 /* default category */
+#define FILTER_MASK     0xffffffff /* default mask (collides with everything) */
+#define filter_t moonccd_filter_t
+typedef struct {
+    uint32_t category;  /* layers the object belongs to */
+    uint32_t mask;      /* layers the object collides with */
+    int group;          /* same positive group: always collide, same negative group: never */
+} filter_t;
+#define exclset_t moonccd_exclset_t
+typedef struct {
+    uint64_t *keys;     /* (id1 << 32 | id2), with id1 < id2 */
+    int size;           /* number of slots (a power of 2, or 0) */
+    int count;          /* number of pairs */
+    int used;           /* number of non-empty slots (pairs and tombstones) */
+} exclset_t;
+#define filter_default moonccd_filter_default
+void filter_default(filter_t *filter);
+#define filter_accept moonccd_filter_accept
+int filter_accept(const filter_t *f1, const filter_t *f2);
+#define filter_isdefault moonccd_filter_isdefault
+int filter_isdefault(const filter_t *filter);
+#define checkfilter moonccd_checkfilter
+void checkfilter(lua_State *L, int arg, filter_t *filter);
+#define pushfilter moonccd_pushfilter
+int pushfilter(lua_State *L, const filter_t *filter);
+#define exclset_has moonccd_exclset_has
+int exclset_has(const exclset_t *set, int id1, int id2);
+#define exclset_add moonccd_exclset_add
+void exclset_add(lua_State *L, exclset_t *set, int id1, int id2);
+#define exclset_remove moonccd_exclset_remove
+void exclset_remove(exclset_t *set, int id1, int id2);
+#define exclset_purge moonccd_exclset_purge
+void exclset_purge(exclset_t *set, int id);
+#define exclset_release moonccd_exclset_release
+void exclset_release(lua_State *L, exclset_t *set);
+
+/* shape.c */
+#define SHAPE_SPHERE    0
+#define SHAPE_CAPSULE   1
+#define SHAPE_BOX       2
+#define SHAPE_PLANE     3
+#define SHAPE_CONVEX    4
+#define SHAPE_NKINDS    5
+#define BODY_DYNAMIC    0 /* moves, and can sleep */
+#define BODY_KINEMATIC  1 /* moves, and never sleeps */
+#define BODY_STATIC     2 /* does not move */
+#define shape_t moonccd_shape_t
+typedef struct {
+    int kind;           /* SHAPE_XXX */
+    vec3_t pos;         /* position */
+    quat_t quat;        /* rotation */
+    quat_t inv;         /* inverse rotation */
+    real_t radius;      /* sphere, capsule */
+    real_t half_height; /* capsule (half length of the inner segment, along the local z axis) */
+    vec3_t half;        /* box (half extents) */
+    int count;          /* convex (number of points) */
+    vec3_t *points;     /* convex (points, Malloc()'d) */
+    vec3_t centroid;    /* convex (average of the points) */
+    filter_t filter;    /* collision filter */
+    int body;           /* BODY_XXX */
+    int asleep;         /* 1 if the shape is sleeping (dynamic only) */
+    unsigned int version;    /* pose version (incremented at each pose change) */
+    unsigned int boxversion; /* pose version the cached box refers to */
+    aabb_t box;              /* cached bounding box */
+    int bvlocal;        /* 1 if lsphere and lobb are computed */
+    bsphere_t lsphere;  /* bounding sphere, in the local frame */
+    obb_t lobb;         /* oriented bounding box, in the local frame */
+} shape_t;
+#define shape_touch(shape) do { (shape)->version++; } while(0) /* call after a pose change */
+/* 1 if the shape is static or sleeping (pairs of idle shapes are not tested) */
+#define shape_idle(shape) ((shape)->body == BODY_STATIC || (shape)->asleep)
+#define shape_local_support moonccd_shape_local_support
+void shape_local_support(const void *obj, const vec3_t *dir, vec3_t *vec);
+#define shape_local_center moonccd_shape_local_center
+void shape_local_center(const void *obj, vec3_t *center);
+#define shape_support moonccd_shape_support
+void shape_support(const void *obj, const vec3_t *dir, vec3_t *vec);
+#define shape_center moonccd_shape_center
+void shape_center(const void *obj, vec3_t *center);
+#define shape_bind moonccd_shape_bind
+const void *shape_bind(lua_State *L, int arg, ccd_t *ccd, int which, int local);
+#define isshape moonccd_isshape
+int isshape(const ccd_t *ccd, int which);
+#define shape_kindname moonccd_shape_kindname
+const char *shape_kindname(int kind);
+#define shape_kindof moonccd_shape_kindof
+int shape_kindof(const char *name);
+#define checkbounded moonccd_checkbounded
+void checkbounded(lua_State *L, const ccd_t *ccd, const void *obj1, const void *obj2);
+
+/* bv.c */
+#define shape_bsphere moonccd_shape_bsphere
+void shape_bsphere(shape_t *shape, bsphere_t *sphere);
+#define shape_obb moonccd_shape_obb
+void shape_obb(shape_t *shape, obb_t *obb);
+#define shape_kdop moonccd_shape_kdop
+void shape_kdop(const shape_t *shape, int k, kdop_t *kdop);
+#define bsphere_overlap moonccd_bsphere_overlap
+int bsphere_overlap(const bsphere_t *a, const bsphere_t *b);
+#define obb_separated moonccd_obb_separated
+int obb_separated(const obb_t *a, const obb_t *b, vec3_t *axis);
+#define obb_separated_along moonccd_obb_separated_along
+int obb_separated_along(const obb_t *a, const obb_t *b, const vec3_t *axis);
+#define kdop_overlap moonccd_kdop_overlap
+int kdop_overlap(const kdop_t *a, const kdop_t *b);
+#define bv_boundingsphere moonccd_bv_boundingsphere
+int bv_boundingsphere(lua_State *L);
+#define bv_obb moonccd_bv_obb
+int bv_obb(lua_State *L);
+#define bv_kdop moonccd_bv_kdop
+int bv_kdop(lua_State *L);
+
+/* arena.c */
+#define arena_reset moonccd_arena_reset
+void arena_reset(void);
+#define arena_release moonccd_arena_release
+void arena_release(void);
+/* hooks for libccd's malloc(), calloc(), realloc() and free() (see the Makefile) */
+void *moonccd_ccd_malloc(size_t size);
+void *moonccd_ccd_calloc(size_t nmemb, size_t size);
+void *moonccd_ccd_realloc(void *ptr, size_t size);
+void moonccd_ccd_free(void *ptr);
+
+/* aabb.c */
+#define aabb_overlap(a, b) /* 1 if the boxes a and b overlap (or touch) */    \
+    ((a)->min.v[0] <= (b)->max.v[0] && (b)->min.v[0] <= (a)->max.v[0] &&    \
+     (a)->min.v[1] <= (b)->max.v[1] && (b)->min.v[1] <= (a)->max.v[1] &&    \
+     (a)->min.v[2] <= (b)->max.v[2] && (b)->min.v[2] <= (a)->max.v[2])
+#define testaabb moonccd_testaabb
+int testaabb(lua_State *L, int arg, aabb_t *box);
+#define checkaabb moonccd_checkaabb
+int checkaabb(lua_State *L, int arg, aabb_t *box);
+#define pushaabb moonccd_pushaabb
+void pushaabb(lua_State *L, const aabb_t *box);
+#define aabb_distance moonccd_aabb_distance
+real_t aabb_distance(const aabb_t *a, const aabb_t *b);
+#define aabb_support moonccd_aabb_support
+void aabb_support(const void *obj, ccd_support_fn support, aabb_t *box);
+#define shape_aabb moonccd_shape_aabb
+void shape_aabb(shape_t *shape, aabb_t *box);
+
+#define idbuf_t moonccd_idbuf_t
+typedef struct { /* list of ids (see idbuf_add) */
+    int *ids;
+    int count;      /* number of ids */
+    int size;       /* allocated ids */
+} idbuf_t;
+
+#define knn_t moonccd_knn_t
+typedef struct { /* k nearest neighbors search (see broadphase_nearest) */
+    aabb_t box;         /* box of the query object */
+    int k;              /* max number of neighbors */
+    real_t maxdist;     /* max distance */
+    real_t (*distance)(void *data, int id, real_t bound); /* exact distance from the query object
+                            to the object id (any value greater than bound if farther than bound,
+                            or a negative value if the object is to be skipped) */
+    void *data;
+    int count;          /* number of neighbors found */
+    int *ids;           /* ids of the neighbors, by increasing distance */
+    real_t *dist;       /* their distances */
+    int ksize;          /* allocated ids and dist */
+    struct { real_t key; int item; } *heap; /* priority queue (min-heap) */
+    int hcount, hsize;
+} knn_t;
+#define knn_bound moonccd_knn_bound
+real_t knn_bound(const knn_t *nn);
+#define knn_closer moonccd_knn_closer
+int knn_closer(const knn_t *nn, real_t key);
+#define knn_push moonccd_knn_push
+void knn_push(lua_State *L, knn_t *nn, real_t key, int item);
+#define knn_pop moonccd_knn_pop
+int knn_pop(knn_t *nn, real_t *key, int *item);
+#define knn_test moonccd_knn_test
+void knn_test(knn_t *nn, int id);
+#define knn_release moonccd_knn_release
+void knn_release(lua_State *L, knn_t *nn);
+
+/* bounds.c */
+#define bounds_t moonccd_bounds_t
+typedef struct {
+    real_t *v[6];   /* min x, y, z and max x, y, z of the box i are v[0][i] ... v[5][i] */
+    int count;      /* number of boxes */
+    int size;       /* allocated boxes (a multiple of the SIMD width) */
+} bounds_t;
+#define bounds_resize moonccd_bounds_resize
+void bounds_resize(lua_State *L, bounds_t *bounds, int count);
+#define bounds_release moonccd_bounds_release
+void bounds_release(lua_State *L, bounds_t *bounds);
+#define bounds_set moonccd_bounds_set
+void bounds_set(bounds_t *bounds, int i, const aabb_t *box);
+#define bounds_get moonccd_bounds_get
+void bounds_get(const bounds_t *bounds, int i, aabb_t *box);
+#define bounds_clear moonccd_bounds_clear
+void bounds_clear(bounds_t *bounds, int i);
+#define bounds_query moonccd_bounds_query
+void bounds_query(lua_State *L, const bounds_t *bounds, const aabb_t *box, int base, idbuf_t *buf);
+#define bounds_pairs moonccd_bounds_pairs
+void bounds_pairs(lua_State *L, const bounds_t *a, const bounds_t *b, int base, idbuf_t *buf);
+
+/* broadphase.c */
+#define pairbuf_t moonccd_pairbuf_t
+typedef struct {
+    int *ids;       /* id1, id2 of each pair (with id1 < id2) */
+    int count;      /* number of pairs */
+    int size;       /* allocated pairs */
+} pairbuf_t;
+#define broadphase_t moonccd_broadphase_t
+typedef struct moonccd_broadphase_s broadphase_t;
+#define bpclass_t moonccd_bpclass_t
+typedef struct {
+    const char *name; /* kind */
+    /* hooks for the acceleration structure (bp->aabb[id] is already set on insert and update) */
+    void (*free)(lua_State *L, broadphase_t *bp); /* releases bp->data */
+    void (*resize)(lua_State *L, broadphase_t *bp); /* bp->size has grown */
+    void (*insert)(lua_State *L, broadphase_t *bp, int id);
+    void (*remove)(lua_State *L, broadphase_t *bp, int id);
+    void (*update)(lua_State *L, broadphase_t *bp, int id);
+    void (*pairs)(lua_State *L, broadphase_t *bp, pairbuf_t *buf); /* adds the overlapping pairs to buf */
+    void (*query)(lua_State *L, broadphase_t *bp, const aabb_t *box, idbuf_t *buf); /* adds the ids whose
+                                                    boxes overlap box to buf (NULL = linear scan) */
+    void (*nearest)(lua_State *L, broadphase_t *bp, knn_t *nn); /* k nearest neighbors search
+                                                    (NULL = best-first over all the boxes) */
+} bpclass_t;
+struct moonccd_broadphase_s {
+    const bpclass_t *cls;
+    void *data;             /* acceleration structure */
+    int size;               /* number of slots for ids (ids are 1..size) */
+    int count;              /* number of ids in use */
+    aabb_t *aabb;           /* aabb[id], for id = 1..size */
+    unsigned char *used;    /* used[id] = 1 if id is in use */
+    int *next;              /* free ids list (0-terminated) */
+    int freeid;             /* first free id */
+    pairbuf_t pairs;        /* result of the last pairs query */
+    idbuf_t hits;           /* result of the last region query */
+    bounds_t bounds;        /* copy of aabb[] in SoA form (box id-1 = aabb[id], or empty) */
+    filter_t *filter;       /* filter[id], for id = 1..size */
+    exclset_t excluded;     /* excluded pairs */
+    unsigned char *idle;    /* idle[id] = 1 if the object is static or sleeping */
+    int filtering;          /* 1 if any filter is not the default, any pair is excluded,
+                               or any object is idle */
+};
+/* 1 if the pair (id1, id2) passes the filters and is not idle (safe to use in worker threads) */
+#define broadphase_accept(bp, id1, id2) \
+    (!(bp)->filtering || broadphase_filter((bp), (id1), (id2)))
+#define broadphase_new moonccd_broadphase_new
+broadphase_t *broadphase_new(lua_State *L, const bpclass_t *cls, void *data);
+#define broadphase_filter moonccd_broadphase_filter
+int broadphase_filter(const broadphase_t *bp, int id1, int id2);
+#define broadphase_setfilter moonccd_broadphase_setfilter
+void broadphase_setfilter(broadphase_t *bp, int id, const filter_t *filter);
+#define broadphase_setidle moonccd_broadphase_setidle
+void broadphase_setidle(broadphase_t *bp, int id, int idle);
+#define pairbuf_add moonccd_pairbuf_add
+void pairbuf_add(lua_State *L, pairbuf_t *buf, int id1, int id2);
+#define idbuf_add moonccd_idbuf_add
+void idbuf_add(lua_State *L, idbuf_t *buf, int id);
+#define broadphase_checkid moonccd_broadphase_checkid
+int broadphase_checkid(lua_State *L, broadphase_t *bp, int arg);
+#define broadphase_insert moonccd_broadphase_insert
+int broadphase_insert(lua_State *L, broadphase_t *bp, ud_t *ud, int arg, const aabb_t *box);
+#define broadphase_remove moonccd_broadphase_remove
+void broadphase_remove(lua_State *L, broadphase_t *bp, ud_t *ud, int id);
+#define broadphase_update moonccd_broadphase_update
+void broadphase_update(lua_State *L, broadphase_t *bp, int id, const aabb_t *box);
+#define broadphase_pairs moonccd_broadphase_pairs
+void broadphase_pairs(lua_State *L, broadphase_t *bp);
+#define broadphase_query moonccd_broadphase_query
+void broadphase_query(lua_State *L, broadphase_t *bp, const aabb_t *box);
+#define broadphase_nearest moonccd_broadphase_nearest
+void broadphase_nearest(lua_State *L, broadphase_t *bp, knn_t *nn);
+#define broadphase_pushobjects moonccd_broadphase_pushobjects
+void broadphase_pushobjects(lua_State *L, ud_t *ud);
+#define broadphase_scan moonccd_broadphase_scan
+void broadphase_scan(lua_State *L, broadphase_t *bp, const aabb_t *box, idbuf_t *buf);
+#define broadphase_axis moonccd_broadphase_axis
+int broadphase_axis(broadphase_t *bp);
+#define optaxis moonccd_optaxis
+int optaxis(lua_State *L, int arg);
+#define pushpairs moonccd_pushpairs
+int pushpairs(lua_State *L, ud_t *ud, const pairbuf_t *buf, int ids);
+
+/* aabbtree.c */
+#define aabbtree_new moonccd_aabbtree_new
+broadphase_t *aabbtree_new(lua_State *L, real_t margin, real_t prediction);
+
+/* lanes.c */
+#define lanepair_t moonccd_lanepair_t
+typedef struct {
+    const shape_t *obj1, *obj2;
+    int index;      /* position of the pair in the batch */
+    int hit;        /* result */
+} lanepair_t;
+#define lanes_width moonccd_lanes_width
+int lanes_width(void);
+#define lanes_intersect moonccd_lanes_intersect
+void lanes_intersect(lanepair_t *pairs, int n, unsigned long max_iterations);
+
+/* kernels.c */
+#define KERNEL_NONE 1 /* no closed-form kernel for the pair */
+#define kernel_available moonccd_kernel_available
+int kernel_available(const ccd_t *ccd, const void *obj1, const void *obj2);
+#define kernel_penetration moonccd_kernel_penetration
+int kernel_penetration(const ccd_t *ccd, const void *obj1, const void *obj2,
+                real_t *depth, vec3_t *dir, vec3_t *pos);
+
+/* autopen.c */
+#define AUTO_NONE   0 /* not decided yet (learning) */
+#define AUTO_GJK    1 /* GJK+EPA */
+#define AUTO_MPR    2 /* MPR */
+#define AUTO_NKINDS (SHAPE_NKINDS+1) /* shape kinds + user-defined objects */
+#define autostat_t moonccd_autostat_t
+typedef struct {
+    int choice;             /* AUTO_XXX */
+    int frozen;             /* 1 if the choice was set by configuration (no learning) */
+    unsigned int samples;   /* number of samples where both algorithms were run */
+    unsigned int hits;      /* number of samples where both reported penetration */
+    double time[2];         /* total execution time of GJK+EPA and MPR (seconds) */
+    unsigned long calls[2]; /* total number of support function calls of GJK+EPA and MPR */
+    double error;           /* max relative depth difference of MPR w.r.t. GJK+EPA */
+} autostat_t;
+#define autopen_t moonccd_autopen_t
+typedef struct {
+    unsigned int samples;   /* number of samples before choosing */
+    double max_error;       /* max relative depth error tolerated for MPR */
+    autostat_t stat[AUTO_NKINDS][AUTO_NKINDS]; /* indexed by kinds, with k1 <= k2 */
+} autopen_t;
+#define autopen_init moonccd_autopen_init
+void autopen_init(autopen_t *a, unsigned int samples, double max_error);
+#define autopen_penetration moonccd_autopen_penetration
+int autopen_penetration(autopen_t *a, const ccd_t *ccd, const void *obj1, const void *obj2,
+                real_t *depth, vec3_t *dir, vec3_t *pos);
+#define autopen_freeze moonccd_autopen_freeze
+void autopen_freeze(autopen_t *a);
+#define autopen_setchoices moonccd_autopen_setchoices
+int autopen_setchoices(lua_State *L, autopen_t *a, int arg);
+#define autopen_pushchoices moonccd_autopen_pushchoices
+int autopen_pushchoices(lua_State *L, const autopen_t *a);
+#define autopen_pushstats moonccd_autopen_pushstats
+int autopen_pushstats(lua_State *L, const autopen_t *a);
+
+/* midphase.c */
+#define axisentry_t moonccd_axisentry_t
+typedef struct {
+    const void *obj1, *obj2;    /* the pair of shapes (obj1 < obj2), NULL if the entry is free */
+    vec3_t axis;                /* separating axis, oriented from obj2 to obj1 (zero if none) */
+} axisentry_t;
+#define midphase_t moonccd_midphase_t
+typedef struct {
+    int enabled;            /* 1 if the cascade is enabled */
+    unsigned long pairs;    /* number of pairs submitted to the cascade */
+    unsigned long sphere;   /* number of pairs rejected by the bounding sphere test */
+    unsigned long obb;      /* ... by the OBB test */
+    unsigned long axis;     /* ... by the cached separating axis test */
+    unsigned long narrow;   /* number of pairs passed to the narrowphase */
+    unsigned long hits;     /* number of pairs found intersecting by the narrowphase */
+    axisentry_t *cache;     /* separating axis cache (hash table) */
+    size_t size, count;
+} midphase_t;
+#define midphase_reject moonccd_midphase_reject
+int midphase_reject(lua_State *L, midphase_t *mp, shape_t *s1, shape_t *s2);
+#define midphase_intersect moonccd_midphase_intersect
+int midphase_intersect(lua_State *L, midphase_t *mp, const ccd_t *ccd, shape_t *s1, shape_t *s2);
+#define midphase_reset moonccd_midphase_reset
+void midphase_reset(lua_State *L, midphase_t *mp);
+#define midphase_pushstats moonccd_midphase_pushstats
+int midphase_pushstats(lua_State *L, const midphase_t *mp);
+
+/* ccdpar info (ud->info) */
+#define ccdinfo_t moonccd_ccdinfo_t
+typedef struct {
+    autopen_t autopen;
+    midphase_t midphase;
+} ccdinfo_t;
+#define ccdinfo(ud) ((ccdinfo_t*)(ud)->info)
+
+/* manifold.c */
+#define MANIFOLD_MAX 4 /* max number of points in a contact manifold */
+#define contact_t moonccd_contact_t
+typedef struct {
+    vec3_t pos1, pos2;      /* contact points on obj1 and obj2 (global coordinates) */
+    vec3_t local1, local2;  /* the same, in the local frames of obj1 and obj2 */
+    real_t depth;           /* penetration depth along the normal (negative if separated) */
+} contact_t;
+#define manifold_t moonccd_manifold_t
+typedef struct {
+    int count;              /* number of contact points */
+    contact_t point[MANIFOLD_MAX];
+    vec3_t normal;          /* contact normal (from obj1 to obj2) */
+    real_t threshold;       /* contact breaking threshold */
+    int perturbations;      /* number of perturbed queries for a new contact (0=none) */
+} manifold_t;
+#define manifold_init moonccd_manifold_init
+void manifold_init(manifold_t *m, real_t threshold, int perturbations);
+#define manifold_refresh moonccd_manifold_refresh
+void manifold_refresh(manifold_t *m, const vec3_t *pos1, const quat_t *quat1,
+                const vec3_t *pos2, const quat_t *quat2);
+#define manifold_update moonccd_manifold_update
+int manifold_update(manifold_t *m, const void *obj1, const void *obj2, const ccd_t *ccd,
+                const vec3_t *pos1, const quat_t *quat1, const vec3_t *pos2, const quat_t *quat2);
+
+/* pair.c */
+#define pair_t moonccd_pair_t
+typedef struct {
+    int has_axis;   /* 1 if axis is valid */
+    vec3_t axis;    /* last separating axis (from obj1 to obj2) */
+    vec3_t p1, p2;  /* last support points on obj1 and obj2 */
+    int has_dir;    /* 1 if dir is valid */
+    vec3_t dir;     /* last known direction from obj1 to obj2 (separation or penetration) */
+    gjk_simplex_t simplex; /* terminating simplex of the last GJK run (count=0 if none) */
+    manifold_t manifold; /* persistent contact manifold */
+} pair_t;
 
 /* Internal error codes */
 #define ERR_NOTPRESENT       1
@@ -158,6 +663,18 @@ int luaopen_moonccd(lua_State *L);
 void moonccd_open_tracing(lua_State *L);
 void moonccd_open_misc(lua_State *L);
 void moonccd_open_ccd(lua_State *L);
+void moonccd_open_pair(lua_State *L);
+void moonccd_open_shape(lua_State *L);
+void moonccd_open_arena(lua_State *L);
+void moonccd_open_broadphase(lua_State *L);
+void moonccd_open_sap(lua_State *L);
+void moonccd_open_aabbtree(lua_State *L);
+void moonccd_open_hash(lua_State *L);
+void moonccd_open_hgrid(lua_State *L);
+void moonccd_open_psap(lua_State *L);
+void moonccd_open_bounds(lua_State *L);
+void moonccd_open_world(lua_State *L);
+void moonccd_open_bv(lua_State *L);
 
 /*------------------------------------------------------------------------------*
  | Debug and other utilities                                                    |
@@ -0,0 +1,385 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* Closed-form penetration kernels for pairs of native shapes.
+ * The kernels follow the conventions of ccdGJKPenetration(): they return 0 if the shapes
+ * intersect, with the penetration depth, the direction of penetration (from s1 to s2,
+ * so that translating s1 by -depth*dir separates them), and the position halfway between
+ * the deepest points of the two shapes. They return -1 otherwise.
+ */
+
+typedef int (*kernel_fn)(const shape_t *s1, const shape_t *s2, real_t *depth, vec3_t *dir, vec3_t *pos);
+
+#define EDGE_TOLERANCE CCD_REAL(1e-5) /* box/box: prefer face axes to equivalent edge axes */
+
+static void Axis(const shape_t *s, int i, vec3_t *axis)
+/* The i-th axis of the local frame of s, in global coordinates */
+    {
+    ccdVec3Set(axis, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    axis->v[i] = CCD_ONE;
+    ccdQuatRotVec(axis, &s->quat);
+    }
+
+static void Segment(const shape_t *s, vec3_t *a, vec3_t *b)
+/* End points of the inner segment of a capsule */
+    {
+    vec3_t h;
+    Axis(s, 2, &h);
+    ccdVec3Scale(&h, s->half_height);
+    ccdVec3Copy(a, &s->pos);
+    ccdVec3Add(a, &h);
+    ccdVec3Sub2(b, &s->pos, &h);
+    }
+
+static real_t Clamp01(real_t x)
+    {
+    return x < CCD_ZERO ? CCD_ZERO : (x > CCD_ONE ? CCD_ONE : x);
+    }
+
+static void ClosestSegment(const vec3_t *a, const vec3_t *b, const vec3_t *p, vec3_t *c)
+/* Closest point to p on the segment ab */
+    {
+    real_t t, l2;
+    vec3_t ab, ap;
+    ccdVec3Sub2(&ab, b, a);
+    ccdVec3Sub2(&ap, p, a);
+    l2 = ccdVec3Len2(&ab);
+    t = l2 > CCD_EPS ? Clamp01(ccdVec3Dot(&ap, &ab)/l2) : CCD_ZERO;
+    ccdVec3Scale(&ab, t);
+    ccdVec3Copy(c, a);
+    ccdVec3Add(c, &ab);
+    }
+
+static void ClosestSegments(const vec3_t *p1, const vec3_t *q1, const vec3_t *p2, const vec3_t *q2,
+                vec3_t *c1, vec3_t *c2)
+/* Closest points between the segments p1q1 and p2q2 (Ericson, 'Real-Time Collision
+ * Detection', 5.1.9) */
+    {
+    real_t a, b, c, e, f, s, t, denom;
+    vec3_t d1, d2, r;
+    ccdVec3Sub2(&d1, q1, p1);
+    ccdVec3Sub2(&d2, q2, p2);
+    ccdVec3Sub2(&r, p1, p2);
+    a = ccdVec3Len2(&d1);
+    e = ccdVec3Len2(&d2);
+    f = ccdVec3Dot(&d2, &r);
+    if(a <= CCD_EPS && e <= CCD_EPS)
+        s = t = CCD_ZERO;
+    else if(a <= CCD_EPS)
+        { s = CCD_ZERO; t = Clamp01(f/e); }
+    else
+        {
+        c = ccdVec3Dot(&d1, &r);
+        if(e <= CCD_EPS)
+            { t = CCD_ZERO; s = Clamp01(-c/a); }
+        else
+            {
+            b = ccdVec3Dot(&d1, &d2);
+            denom = a*e - b*b;
+            s = denom > CCD_EPS ? Clamp01((b*f - c*e)/denom) : CCD_ZERO;
+            t = (b*s + f)/e;
+            if(t < CCD_ZERO)
+                { t = CCD_ZERO; s = Clamp01(-c/a); }
+            else if(t > CCD_ONE)
+                { t = CCD_ONE; s = Clamp01((b - c)/a); }
+            }
+        }
+    ccdVec3Scale(&d1, s);
+    ccdVec3Copy(c1, p1);
+    ccdVec3Add(c1, &d1);
+    ccdVec3Scale(&d2, t);
+    ccdVec3Copy(c2, p2);
+    ccdVec3Add(c2, &d2);
+    }
+
+static int Spheres(const vec3_t *c1, real_t r1, const vec3_t *c2, real_t r2, const vec3_t *fallback,
+                real_t *depth, vec3_t *dir, vec3_t *pos)
+/* Penetration of the spheres (c1, r1) and (c2, r2). The fallback direction is used if
+ * the centers coincide. */
+    {
+    real_t dist, r = r1 + r2;
+    ccdVec3Sub2(dir, c2, c1);
+    dist = ccdVec3Len2(dir);
+    if(dist >= r*r) return -1;
+    dist = CCD_SQRT(dist);
+    if(dist > CCD_EPS)
+        ccdVec3Scale(dir, CCD_ONE/dist);
+    else
+        ccdVec3Copy(dir, fallback);
+    *depth = r - dist;
+    /* halfway between c1 + r1*dir and c2 - r2*dir */
+    ccdVec3Copy(pos, dir);
+    ccdVec3Scale(pos, r1 - *depth/2);
+    ccdVec3Add(pos, c1);
+    return 0;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Kernels                                                                      |
+ *------------------------------------------------------------------------------*/
+
+static int SphereSphere(const shape_t *s1, const shape_t *s2, real_t *depth, vec3_t *dir, vec3_t *pos)
+    {
+    vec3_t fallback;
+    ccdVec3Set(&fallback, CCD_ZERO, CCD_ZERO, CCD_ONE);
+    return Spheres(&s1->pos, s1->radius, &s2->pos, s2->radius, &fallback, depth, dir, pos);
+    }
+
+static int SphereCapsule(const shape_t *s1, const shape_t *s2, real_t *depth, vec3_t *dir, vec3_t *pos)
+    {
+    vec3_t a, b, c, fallback;
+    Segment(s2, &a, &b);
+    ClosestSegment(&a, &b, &s1->pos, &c);
+    Axis(s2, 0, &fallback);
+    return Spheres(&s1->pos, s1->radius, &c, s2->radius, &fallback, depth, dir, pos);
+    }
+
+static int CapsuleCapsule(const shape_t *s1, const shape_t *s2, real_t *depth, vec3_t *dir, vec3_t *pos)
+    {
+    vec3_t a1, b1, a2, b2, c1, c2, u, v, fallback;
+    Segment(s1, &a1, &b1);
+    Segment(s2, &a2, &b2);
+    ClosestSegments(&a1, &b1, &a2, &b2, &c1, &c2);
+    /* if the segments intersect, separate along the normal to both */
+    Axis(s1, 2, &u);
+    Axis(s2, 2, &v);
+    ccdVec3Cross(&fallback, &u, &v);
+    if(ccdIsZero(ccdVec3Len2(&fallback)))
+        Axis(s1, 0, &fallback);
+    else
+        ccdVec3Normalize(&fallback);
+    return Spheres(&c1, s1->radius, &c2, s2->radius, &fallback, depth, dir, pos);
+    }
+
+static int SphereBox(const shape_t *s1, const shape_t *s2, real_t *depth, vec3_t *dir, vec3_t *pos)
+    {
+    int i, k = 0, inside = 1;
+    real_t r = s1->radius, dist, mind = CCD_REAL_MAX, d;
+    vec3_t c, q, n;
+    /* sphere center in the local frame of the box, and closest point q of the box */
+    ccdVec3Sub2(&c, &s1->pos, &s2->pos);
+    ccdQuatRotVec(&c, &s2->inv);
+    for(i = 0; i < 3; i++)
+        {
+        q.v[i] = c.v[i];
+        if(q.v[i] > s2->half.v[i]) { q.v[i] = s2->half.v[i]; inside = 0; }
+        else if(q.v[i] < -s2->half.v[i]) { q.v[i] = -s2->half.v[i]; inside = 0; }
+        }
+    if(!inside)
+        {
+        ccdVec3Sub2(&n, &q, &c);
+        dist = ccdVec3Len2(&n);
+        if(dist >= r*r) return -1;
+        dist = CCD_SQRT(dist);
+        ccdVec3Scale(&n, CCD_ONE/dist);
+        *depth = r - dist;
+        ccdVec3Copy(pos, &n);
+        ccdVec3Scale(pos, r - *depth/2);
+        ccdVec3Add(pos, &c);
+        }
+    else
+        { /* center inside the box: push the sphere out through the nearest face */
+        for(i = 0; i < 3; i++)
+            {
+            d = s2->half.v[i] - CCD_FABS(c.v[i]);
+            if(d < mind) { mind = d; k = i; }
+            }
+        ccdVec3Set(&n, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+        n.v[k] = c.v[k] >= CCD_ZERO ? -CCD_ONE : CCD_ONE;
+        *depth = r + mind;
+        /* halfway between the deepest point of the sphere and its projection on the face */
+        ccdVec3Copy(pos, &c);
+        pos->v[k] = (c.v[k] + n.v[k]*r - n.v[k]*s2->half.v[k])/2;
+        }
+    ccdVec3Copy(dir, &n);
+    ccdQuatRotVec(dir, &s2->quat);
+    ccdQuatRotVec(pos, &s2->quat);
+    ccdVec3Add(pos, &s2->pos);
+    return 0;
+    }
+
+static real_t Projection(const vec3_t axes[3], const vec3_t *half, const vec3_t *l)
+/* Half length of the projection of a box on the axis l */
+    {
+    return half->v[0]*CCD_FABS(ccdVec3Dot(&axes[0], l))
+         + half->v[1]*CCD_FABS(ccdVec3Dot(&axes[1], l))
+         + half->v[2]*CCD_FABS(ccdVec3Dot(&axes[2], l));
+    }
+
+static void Edge(const shape_t *s, const vec3_t axes[3], int i, const vec3_t *dir, vec3_t *a, vec3_t *b)
+/* The edge of the box s parallel to its i-th axis that is extreme in the direction dir */
+    {
+    int k;
+    vec3_t e;
+    ccdVec3Copy(a, &s->pos);
+    for(k = 0; k < 3; k++)
+        {
+        if(k == i) continue;
+        ccdVec3Copy(&e, &axes[k]);
+        ccdVec3Scale(&e, ccdVec3Dot(&axes[k], dir) >= CCD_ZERO ? s->half.v[k] : -s->half.v[k]);
+        ccdVec3Add(a, &e);
+        }
+    ccdVec3Copy(&e, &axes[i]);
+    ccdVec3Scale(&e, s->half.v[i]);
+    ccdVec3Sub2(b, a, &e);
+    ccdVec3Add(a, &e);
+    }
+
+static int BoxBox(const shape_t *s1, const shape_t *s2, real_t *depth, vec3_t *dir, vec3_t *pos)
+/* Separating axis test on the 15 candidate axes (3+3 face normals, 9 edge cross products).
+ * The penetration is along the axis with the minimum overlap. */
+    {
+    int i, j, besti = -1, bestj = -1;
+    real_t overlap, d, best = CCD_REAL_MAX;
+    vec3_t a[3], b[3], t, l, p, q, c1, c2;
+
+    for(i = 0; i < 3; i++)
+        { Axis(s1, i, &a[i]); Axis(s2, i, &b[i]); }
+    ccdVec3Sub2(&t, &s2->pos, &s1->pos);
+
+#define TEST(axis, is_edge, i_, j_) do {                                        \
+    d = ccdVec3Dot(&t, (axis));                                                 \
+    overlap = Projection(a, &s1->half, (axis)) + Projection(b, &s2->half, (axis)) - CCD_FABS(d); \
+    if(overlap <= CCD_ZERO) return -1; /* separating axis */                    \
+    if((is_edge) ? overlap < best - EDGE_TOLERANCE : overlap < best)            \
+        {                                                                       \
+        best = overlap; besti = (i_); bestj = (j_);                             \
+        ccdVec3Copy(dir, (axis));                                               \
+        if(d < CCD_ZERO) ccdVec3Scale(dir, -CCD_ONE);                           \
+        }                                                                       \
+} while(0)
+    for(i = 0; i < 3; i++)
+        TEST(&a[i], 0, i, -1);
+    for(j = 0; j < 3; j++)
+        TEST(&b[j], 0, -1, j);
+    for(i = 0; i < 3; i++)
+        for(j = 0; j < 3; j++)
+            {
+            ccdVec3Cross(&l, &a[i], &b[j]);
+            if(ccdVec3Len2(&l) < CCD_EPS) continue; /* parallel edges */
+            ccdVec3Normalize(&l);
+            TEST(&l, 1, i, j);
+            }
+#undef TEST
+
+    *depth = best;
+    if(bestj < 0)
+        { /* face of s1: deepest point of s2 */
+        ccdVec3Scale(dir, -CCD_ONE);
+        shape_support(s2, dir, pos);
+        ccdVec3Scale(dir, -CCD_ONE);
+        ccdVec3Copy(&p, dir);
+        ccdVec3Scale(&p, best/2);
+        ccdVec3Add(pos, &p);
+        }
+    else if(besti < 0)
+        { /* face of s2: deepest point of s1 */
+        shape_support(s1, dir, pos);
+        ccdVec3Copy(&p, dir);
+        ccdVec3Scale(&p, -best/2);
+        ccdVec3Add(pos, &p);
+        }
+    else
+        { /* edge-edge: closest points of the two edges */
+        Edge(s1, a, besti, dir, &p, &q);
+        ccdVec3Copy(&l, dir);
+        ccdVec3Scale(&l, -CCD_ONE);
+        Edge(s2, b, bestj, &l, &c1, &c2);
+        ClosestSegments(&p, &q, &c1, &c2, &t, &l);
+        ccdVec3Add(&t, &l);
+        ccdVec3Scale(&t, CCD_REAL(0.5));
+        ccdVec3Copy(pos, &t);
+        }
+    return 0;
+    }
+
+static int ShapePlane(const shape_t *s1, const shape_t *s2, real_t *depth, vec3_t *dir, vec3_t *pos)
+/* Any bounded shape vs. a plane (the half-space below the local xy plane of s2) */
+    {
+    real_t dist;
+    vec3_t n, x, d;
+    Axis(s2, 2, &n);
+    ccdVec3Copy(&d, &n);
+    ccdVec3Scale(&d, -CCD_ONE);
+    shape_support(s1, &d, &x); /* deepest point of s1 */
+    ccdVec3Sub2(&d, &x, &s2->pos);
+    dist = ccdVec3Dot(&d, &n);
+    if(dist >= CCD_ZERO) return -1;
+    *depth = -dist;
+    ccdVec3Copy(dir, &n);
+    ccdVec3Scale(dir, -CCD_ONE);
+    ccdVec3Copy(pos, &n);
+    ccdVec3Scale(pos, *depth/2);
+    ccdVec3Add(pos, &x);
+    return 0;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Dispatch                                                                     |
+ *------------------------------------------------------------------------------*/
+
+/* Kernel[k1][k2] handles (k1, k2) pairs. The (k2, k1) pairs are handled by the same
+ * kernel, with the shapes swapped and the direction reversed. */
+static const kernel_fn Kernel[SHAPE_NKINDS][SHAPE_NKINDS] = {
+    [SHAPE_SPHERE][SHAPE_SPHERE] = SphereSphere,
+    [SHAPE_SPHERE][SHAPE_CAPSULE] = SphereCapsule,
+    [SHAPE_CAPSULE][SHAPE_CAPSULE] = CapsuleCapsule,
+    [SHAPE_SPHERE][SHAPE_BOX] = SphereBox,
+    [SHAPE_BOX][SHAPE_BOX] = BoxBox,
+    [SHAPE_SPHERE][SHAPE_PLANE] = ShapePlane,
+    [SHAPE_CAPSULE][SHAPE_PLANE] = ShapePlane,
+    [SHAPE_BOX][SHAPE_PLANE] = ShapePlane,
+    [SHAPE_CONVEX][SHAPE_PLANE] = ShapePlane,
+};
+
+int kernel_available(const ccd_t *ccd, const void *obj1, const void *obj2)
+/* Returns 1 if a closed-form kernel is available for the pair, 0 otherwise */
+    {
+    const shape_t *s1 = (const shape_t*)obj1;
+    const shape_t *s2 = (const shape_t*)obj2;
+    if(!isshape(ccd, 1) || !isshape(ccd, 2)) return 0;
+    return Kernel[s1->kind][s2->kind] || Kernel[s2->kind][s1->kind];
+    }
+
+int kernel_penetration(const ccd_t *ccd, const void *obj1, const void *obj2,
+                real_t *depth, vec3_t *dir, vec3_t *pos)
+/* Executes the closed-form kernel for the pair, if both objects are native shapes and
+ * a kernel is available for their kinds. Returns KERNEL_NONE if not, otherwise the same
+ * values as ccdGJKPenetration(). */
+    {
+    int rc;
+    const shape_t *s1 = (const shape_t*)obj1;
+    const shape_t *s2 = (const shape_t*)obj2;
+    if(!isshape(ccd, 1) || !isshape(ccd, 2)) return KERNEL_NONE;
+    if(Kernel[s1->kind][s2->kind])
+        return Kernel[s1->kind][s2->kind](s1, s2, depth, dir, pos);
+    if(!Kernel[s2->kind][s1->kind]) return KERNEL_NONE;
+    rc = Kernel[s2->kind][s1->kind](s2, s1, depth, dir, pos);
+    if(rc == 0) ccdVec3Scale(dir, -CCD_ONE);
+    return rc;
+    }
+
@@ -0,0 +1,433 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+#include "simd.h"
+
+/* Boolean GJK on several pairs of native shapes in parallel.
+ *
+ * The pairs are grouped by kinds, and each group is processed LANES pairs at a time,
+ * with one pair per lane of a SIMD vector (the vectors are in SoA form, i.e. one vector
+ * per coordinate). All the lanes execute the same instructions: the branches of the
+ * simplex subalgorithm are evaluated for all of them and the results are blended by
+ * masks, and a lane that has terminated is masked out until all the lanes in the
+ * group have terminated (or the max number of iterations is reached).
+ */
+
+typedef struct { vreal_t x, y, z; } vvec_t;
+typedef struct { vreal_t x, y, z, w; } vquat_t;
+
+/*------------------------------------------------------------------------------*
+ | Vector utilities                                                             |
+ *------------------------------------------------------------------------------*/
+
+static vreal_t Splat(real_t s)
+    {
+    int i;
+    vreal_t v;
+    for(i = 0; i < LANES; i++) v[i] = s;
+    return v;
+    }
+
+static vreal_t Sel(vmask_t m, vreal_t a, vreal_t b)
+/* a where m is set, b elsewhere */
+    {
+    return (vreal_t)(((vmask_t)a & m) | ((vmask_t)b & ~m));
+    }
+
+static vmask_t MSel(vmask_t m, vmask_t a, vmask_t b)
+    {
+    return (a & m) | (b & ~m);
+    }
+
+static vvec_t VSel(vmask_t m, vvec_t a, vvec_t b)
+    {
+    vvec_t v;
+    v.x = Sel(m, a.x, b.x);
+    v.y = Sel(m, a.y, b.y);
+    v.z = Sel(m, a.z, b.z);
+    return v;
+    }
+
+static vvec_t VSub(vvec_t a, vvec_t b)
+    {
+    vvec_t v;
+    v.x = a.x - b.x; v.y = a.y - b.y; v.z = a.z - b.z;
+    return v;
+    }
+
+static vvec_t VAdd(vvec_t a, vvec_t b)
+    {
+    vvec_t v;
+    v.x = a.x + b.x; v.y = a.y + b.y; v.z = a.z + b.z;
+    return v;
+    }
+
+static vvec_t VNeg(vvec_t a)
+    {
+    vvec_t v;
+    v.x = -a.x; v.y = -a.y; v.z = -a.z;
+    return v;
+    }
+
+static vvec_t VScale(vvec_t a, vreal_t k)
+    {
+    vvec_t v;
+    v.x = a.x*k; v.y = a.y*k; v.z = a.z*k;
+    return v;
+    }
+
+static vreal_t VDot(vvec_t a, vvec_t b)
+    {
+    return a.x*b.x + a.y*b.y + a.z*b.z;
+    }
+
+static vvec_t VCross(vvec_t a, vvec_t b)
+    {
+    vvec_t v;
+    v.x = a.y*b.z - a.z*b.y;
+    v.y = a.z*b.x - a.x*b.z;
+    v.z = a.x*b.y - a.y*b.x;
+    return v;
+    }
+
+static vvec_t VTriple(vvec_t a, vvec_t b)
+/* (a x b) x a, i.e. the component of b orthogonal to a (scaled by |a|^2) */
+    {
+    return VCross(VCross(a, b), a);
+    }
+
+static vvec_t VRotate(vquat_t q, vvec_t v)
+/* Rotates v by the unit quaternion q */
+    {
+    vvec_t u, t;
+    u.x = q.x; u.y = q.y; u.z = q.z;
+    t = VCross(u, v);
+    t = VAdd(t, t);
+    return VAdd(VAdd(v, VScale(t, q.w)), VCross(u, t));
+    }
+
+static vreal_t VSqrt(vreal_t a)
+    {
+    int i;
+    vreal_t v;
+    for(i = 0; i < LANES; i++) v[i] = CCD_SQRT(a[i]);
+    return v;
+    }
+
+static int Any(vmask_t m)
+    {
+    int i;
+    for(i = 0; i < LANES; i++)
+        if(m[i]) return 1;
+    return 0;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Support functions                                                            |
+ *------------------------------------------------------------------------------*/
+
+typedef struct {
+    int kind;
+    const shape_t *shape[LANES];
+    vvec_t pos;
+    vquat_t quat, inv;
+    vreal_t radius, half_height;
+    vvec_t half;
+} vshape_t;
+
+static void Load(vshape_t *vs, int lane, const shape_t *s)
+    {
+    vs->shape[lane] = s;
+    vs->pos.x[lane] = s->pos.v[0];
+    vs->pos.y[lane] = s->pos.v[1];
+    vs->pos.z[lane] = s->pos.v[2];
+    vs->quat.x[lane] = s->quat.q[0];
+    vs->quat.y[lane] = s->quat.q[1];
+    vs->quat.z[lane] = s->quat.q[2];
+    vs->quat.w[lane] = s->quat.q[3];
+    vs->inv.x[lane] = s->inv.q[0];
+    vs->inv.y[lane] = s->inv.q[1];
+    vs->inv.z[lane] = s->inv.q[2];
+    vs->inv.w[lane] = s->inv.q[3];
+    vs->radius[lane] = s->radius;
+    vs->half_height[lane] = s->half_height;
+    vs->half.x[lane] = s->half.v[0];
+    vs->half.y[lane] = s->half.v[1];
+    vs->half.z[lane] = s->half.v[2];
+    }
+
+static void Fill(vshape_t *vs, int from)
+/* Fills the unused lanes with copies of lane 0 (their results are discarded) */
+    {
+    int i;
+    for(i = from; i < LANES; i++)
+        Load(vs, i, vs->shape[0]);
+    }
+
+static vvec_t Normalized(vvec_t d)
+/* d/|d|, or (0, 0, 1) if d is zero (as in shape_local_support) */
+    {
+    vreal_t len2 = VDot(d, d);
+    vmask_t zero = len2 == Splat(CCD_ZERO);
+    vreal_t k = Splat(CCD_ONE)/VSqrt(Sel(zero, Splat(CCD_ONE), len2));
+    vvec_t n = VScale(d, k);
+    n.x = Sel(zero, Splat(CCD_ZERO), n.x);
+    n.y = Sel(zero, Splat(CCD_ZERO), n.y);
+    n.z = Sel(zero, Splat(CCD_ONE), n.z);
+    return n;
+    }
+
+static vvec_t LocalSupport(const vshape_t *vs, vvec_t d)
+    {
+    int i;
+    vvec_t s, n;
+    vec3_t ld, ls;
+    switch(vs->kind)
+        {
+        case SHAPE_SPHERE:
+            return VScale(Normalized(d), vs->radius);
+        case SHAPE_CAPSULE:
+            n = Normalized(d);
+            s = VScale(n, vs->radius);
+            s.z += Sel(n.z >= Splat(CCD_ZERO), vs->half_height, -vs->half_height);
+            return s;
+        case SHAPE_BOX:
+            s.x = Sel(d.x >= Splat(CCD_ZERO), vs->half.x, -vs->half.x);
+            s.y = Sel(d.y >= Splat(CCD_ZERO), vs->half.y, -vs->half.y);
+            s.z = Sel(d.z >= Splat(CCD_ZERO), vs->half.z, -vs->half.z);
+            return s;
+        default: /* convex: one lane at a time */
+            for(i = 0; i < LANES; i++)
+                {
+                ccdVec3Set(&ld, d.x[i], d.y[i], d.z[i]);
+                shape_local_support(vs->shape[i], &ld, &ls);
+                s.x[i] = ls.v[0]; s.y[i] = ls.v[1]; s.z[i] = ls.v[2];
+                }
+            return s;
+        }
+    }
+
+static vvec_t Support(const vshape_t *vs, vvec_t d)
+/* Support function in the global frame (see shape_support) */
+    {
+    vvec_t s = LocalSupport(vs, VRotate(vs->inv, d));
+    return VAdd(VRotate(vs->quat, s), vs->pos);
+    }
+
+static vvec_t MinkowskiSupport(const vshape_t *vs1, const vshape_t *vs2, vvec_t d)
+/* Support function of the Minkowski difference obj1 - obj2 */
+    {
+    return VSub(Support(vs1, d), Support(vs2, VNeg(d)));
+    }
+
+/*------------------------------------------------------------------------------*
+ | GJK                                                                          |
+ *------------------------------------------------------------------------------*/
+
+typedef struct {
+    vvec_t a, b, c, d;  /* simplex (a is the last added point) */
+    vmask_t count;      /* number of points in the simplex */
+    vvec_t dir;         /* next search direction */
+} vsimplex_t;
+
+static vmask_t DoSimplex(vsimplex_t *s, vmask_t active)
+/* Updates the simplex and the search direction in the active lanes, and returns the
+ * mask of the lanes where the simplex contains the origin.
+ * The cases are the same as in the scalar boolean GJK (tetrahedron, triangle, segment),
+ * but each case is evaluated for all the lanes, in this order, so that a lane reduced
+ * to a lower case by the previous one is completed by the next one.
+ */
+    {
+    vvec_t ao, ab, ac, ad, abc, acd, adb, b;
+    vmask_t m4, m3, m2, inside, oabc, oacd, oadb, c1, c1a, c2, eac, above, t;
+    vmask_t two = (vmask_t){0} + 2, three = (vmask_t){0} + 3;
+    vreal_t zero = Splat(CCD_ZERO);
+
+    /* Tetrahedron: if the origin is outside one of the faces containing a, reduce to
+     * that face, otherwise the origin is inside */
+    m4 = active & (s->count == two + 2);
+    ao = VNeg(s->a);
+    ab = VSub(s->b, s->a);
+    ac = VSub(s->c, s->a);
+    ad = VSub(s->d, s->a);
+    abc = VCross(ab, ac);
+    acd = VCross(ac, ad);
+    adb = VCross(ad, ab);
+    oabc = VDot(abc, ao) > zero;
+    oacd = VDot(acd, ao) > zero;
+    oadb = VDot(adb, ao) > zero;
+    inside = m4 & ~oabc & ~oacd & ~oadb;
+    m4 &= ~inside;
+    /* abc: (b, c) unchanged, acd: (b, c) = (c, d), adb: (b, c) = (d, b) */
+    t = m4 & ~oabc;
+    b = s->b;
+    s->b = VSel(t, VSel(oacd, s->c, s->d), b);
+    s->c = VSel(t, VSel(oacd, s->d, b), s->c);
+    s->count = MSel(m4, three, s->count);
+
+    /* Triangle */
+    m3 = active & ~inside & (s->count == three);
+    ab = VSub(s->b, s->a);
+    ac = VSub(s->c, s->a);
+    abc = VCross(ab, ac);
+    c1 = VDot(VCross(abc, ac), ao) > zero;
+    c1a = VDot(ac, ao) > zero;
+    c2 = VDot(VCross(ab, abc), ao) > zero;
+    above = VDot(abc, ao) > zero;
+    /* region of edge ac */
+    eac = m3 & c1 & c1a;
+    s->b = VSel(eac, s->c, s->b);
+    s->dir = VSel(eac, VTriple(ac, ao), s->dir);
+    /* region of the triangle (above or below it) */
+    t = m3 & ~c1 & ~c2;
+    s->dir = VSel(t & above, abc, VSel(t, VNeg(abc), s->dir));
+    b = s->b; /* swap b and c if below */
+    s->b = VSel(t & ~above, s->c, b);
+    s->c = VSel(t & ~above, b, s->c);
+    /* otherwise reduce to the segment ab */
+    s->count = MSel(m3 & ~t, two, s->count);
+
+    /* Segment (including the triangles reduced to ab, but not those reduced to ac) */
+    m2 = active & ~inside & ~eac & (s->count == two);
+    ab = VSub(s->b, s->a);
+    t = VDot(ab, ao) > zero;
+    s->dir = VSel(m2 & t, VTriple(ab, ao), VSel(m2, ao, s->dir));
+    s->count = MSel(m2 & ~t, two - 1, s->count);
+    return inside;
+    }
+
+static vmask_t OnSimplex(const vsimplex_t *s, vmask_t active)
+/* Returns the mask of the active lanes where the origin is on the simplex, i.e. its
+ * distance from the simplex along the search direction is negligible with respect to the
+ * size of the simplex. The search direction is a cross or triple product, so its length
+ * says nothing about that distance, and only an exactly zero direction is degenerate.
+ */
+    {
+    vvec_t ab = VSub(s->b, s->a);
+    vreal_t zero = Splat(CCD_ZERO);
+    vreal_t dd = VDot(s->dir, s->dir);
+    vmask_t degenerate = dd == zero;
+    vreal_t dist = VDot(s->dir, s->a)/VSqrt(Sel(degenerate, Splat(CCD_ONE), dd));
+    return active & (degenerate | (dist*dist <= Splat(CCD_EPS)*VDot(ab, ab)));
+    }
+
+static vmask_t Intersect(const vshape_t *vs1, const vshape_t *vs2, unsigned long max_iterations)
+/* Returns the mask of the lanes where the two shapes intersect */
+    {
+    unsigned long iter;
+    vsimplex_t s;
+    vvec_t p, dir;
+    vmask_t active, hit, miss, touch;
+    vmask_t one = (vmask_t){0} + 1;
+    vreal_t zero = Splat(CCD_ZERO);
+
+    /* first direction: from the position of obj2 to that of obj1 */
+    dir = VSub(vs1->pos, vs2->pos);
+    touch = VDot(dir, dir) == zero;
+    dir.x = Sel(touch, Splat(CCD_ONE), dir.x);
+    s.a = MinkowskiSupport(vs1, vs2, dir);
+    s.count = one;
+    s.dir = VNeg(s.a);
+    hit = VDot(s.dir, s.dir) == zero; /* the origin is on the boundary */
+    active = ~hit;
+
+    for(iter = 0; iter < max_iterations && Any(active); iter++)
+        {
+        dir = s.dir;
+        p = MinkowskiSupport(vs1, vs2, dir);
+        miss = active & (VDot(p, dir) < zero); /* the origin is beyond p */
+        active &= ~miss;
+        s.d = VSel(active, s.c, s.d);
+        s.c = VSel(active, s.b, s.c);
+        s.b = VSel(active, s.a, s.b);
+        s.a = VSel(active, p, s.a);
+        s.count = MSel(active, s.count + one, s.count);
+        touch = DoSimplex(&s, active);
+        touch |= OnSimplex(&s, active);
+        hit |= touch;
+        active &= ~touch;
+        }
+    return hit; /* lanes still active after max_iterations count as misses */
+    }
+
+/*------------------------------------------------------------------------------*
+ | Batches                                                                      |
+ *------------------------------------------------------------------------------*/
+
+static int GroupOf(const lanepair_t *p)
+    {
+    return p->obj1->kind*SHAPE_NKINDS + p->obj2->kind;
+    }
+
+static int Compare(const void *a, const void *b)
+    {
+    return GroupOf((const lanepair_t*)a) - GroupOf((const lanepair_t*)b);
+    }
+
+static void Run(lanepair_t *pairs, int n, unsigned long max_iterations)
+/* Processes n <= LANES pairs of the same kinds */
+    {
+    int i;
+    vmask_t hit;
+    vshape_t vs1, vs2;
+    vs1.kind = pairs[0].obj1->kind;
+    vs2.kind = pairs[0].obj2->kind;
+    for(i = 0; i < n; i++)
+        {
+        Load(&vs1, i, pairs[i].obj1);
+        Load(&vs2, i, pairs[i].obj2);
+        }
+    Fill(&vs1, n);
+    Fill(&vs2, n);
+    hit = Intersect(&vs1, &vs2, max_iterations);
+    for(i = 0; i < n; i++)
+        pairs[i].hit = hit[i] != 0;
+    }
+
+int lanes_width(void)
+    {
+    return LANES;
+    }
+
+void lanes_intersect(lanepair_t *pairs, int n, unsigned long max_iterations)
+/* Computes the boolean intersection of n pairs of bounded native shapes, setting
+ * pairs[i].hit. The pairs are reordered by kinds (use pairs[i].index to map them back). */
+    {
+    int i, j;
+    const shape_t *tmp;
+    for(i = 0; i < n; i++)
+        {
+        if(pairs[i].obj1->kind > pairs[i].obj2->kind) /* intersection is symmetric */
+            { tmp = pairs[i].obj1; pairs[i].obj1 = pairs[i].obj2; pairs[i].obj2 = tmp; }
+        }
+    qsort(pairs, n, sizeof(lanepair_t), Compare);
+    for(i = 0; i < n; i = j)
+        {
+        for(j = i + 1; j < n && j - i < LANES && GroupOf(&pairs[j]) == GroupOf(&pairs[i]); j++);
+        Run(&pairs[i], j - i, max_iterations);
+        }
+    }
+
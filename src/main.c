@@ -33,6 +33,7 @@ static void AtExit(void)
         {
         moonccd_L = NULL;
         }
+    arena_release();
     }
  
 static int AddVersions(lua_State *L)
@@ -44,6 +45,10 @@ static int AddVersions(lua_State *L)
     lua_pushstring(L, "_LIBCCD_VERSION");
     lua_pushfstring(L, "libccd %s", VERSION);
     lua_settable(L, -3);
+
+    lua_pushstring(L, "_PRECISION");
+    lua_pushstring(L, MOONCCD_PRECISION);
+    lua_settable(L, -3);
     return 0;
     }
   
@@ -54,6 +59,9 @@ static int AddConstants(lua_State *L)
 
     lua_pushnumber(L, CCD_REAL_MAX);
     lua_setfield(L, -2, "REAL_MAX");
+
+    lua_pushinteger(L, lanes_width());
+    lua_setfield(L, -2, "LANES");
     return 0;
     }
 
@@ -92,6 +100,18 @@ int luaopen_moonccd(lua_State *L)
     moonccd_open_tracing(L);
     moonccd_open_misc(L);
     moonccd_open_ccd(L);
+    moonccd_open_pair(L);
+    moonccd_open_shape(L);
+    moonccd_open_arena(L);
+    moonccd_open_broadphase(L);
+    moonccd_open_sap(L);
+    moonccd_open_aabbtree(L);
+    moonccd_open_hash(L);
+    moonccd_open_hgrid(L);
+    moonccd_open_psap(L);
+    moonccd_open_bounds(L);
+    moonccd_open_world(L);
+    moonccd_open_bv(L);
 
 #if 0 //@@
     /* Add functions implemented in Lua */
@@ -0,0 +1,344 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* A manifold_t accumulates up to MANIFOLD_MAX contact points between two objects across
+ * queries (Bullet-style persistent manifold). The points are stored also in the local
+ * frames of the objects, so that they can be tracked as the objects move, and are dropped
+ * when they separate or drift tangentially by more than the threshold.
+ * When a contact is first detected, the manifold is filled at once by repeating the query
+ * with obj1 slightly rotated about the contact point in a few directions.
+ */
+
+#define PERTURBATION_ANGLE_MAX  CCD_REAL(0.39269908169872414) /* pi/8 */
+#define NORMAL_COS_MIN          CCD_REAL(0.95) /* clear the manifold if the normal changes more */
+
+void manifold_init(manifold_t *m, real_t threshold, int perturbations)
+    {
+    m->count = 0;
+    ccdVec3Set(&m->normal, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    m->threshold = threshold;
+    m->perturbations = perturbations;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Contact points                                                               |
+ *------------------------------------------------------------------------------*/
+
+static void ToLocal(vec3_t *local, const vec3_t *world, const vec3_t *pos, const quat_t *quat)
+    {
+    quat_t inv;
+    ccdQuatInvert2(&inv, quat);
+    ccdVec3Sub2(local, world, pos);
+    ccdQuatRotVec(local, &inv);
+    }
+
+static void ToWorld(vec3_t *world, const vec3_t *local, const vec3_t *pos, const quat_t *quat)
+    {
+    ccdVec3Copy(world, local);
+    ccdQuatRotVec(world, quat);
+    ccdVec3Add(world, pos);
+    }
+
+static real_t Depth(const manifold_t *m, const contact_t *c)
+/* Penetration depth along the normal (negative if separated) */
+    {
+    vec3_t d;
+    ccdVec3Sub2(&d, &c->pos1, &c->pos2);
+    return ccdVec3Dot(&d, &m->normal);
+    }
+
+static void SetContact(manifold_t *m, contact_t *c, const vec3_t *pos1, const quat_t *quat1,
+                const vec3_t *pos2, const quat_t *quat2)
+/* Completes c, given its global positions */
+    {
+    c->depth = Depth(m, c);
+    ToLocal(&c->local1, &c->pos1, pos1, quat1);
+    ToLocal(&c->local2, &c->pos2, pos2, quat2);
+    }
+
+static void Remove(manifold_t *m, int i)
+    {
+    m->count--;
+    if(i < m->count) m->point[i] = m->point[m->count];
+    }
+
+void manifold_refresh(manifold_t *m, const vec3_t *pos1, const quat_t *quat1,
+                const vec3_t *pos2, const quat_t *quat2)
+/* Updates the global positions and the depths of the contact points according to the
+ * current poses of the objects, and drops the stale ones. */
+    {
+    int i;
+    vec3_t d;
+    contact_t *c;
+    real_t thr2 = m->threshold*m->threshold;
+    for(i = m->count-1; i >= 0; i--)
+        {
+        c = &m->point[i];
+        ToWorld(&c->pos1, &c->local1, pos1, quat1);
+        ToWorld(&c->pos2, &c->local2, pos2, quat2);
+        c->depth = Depth(m, c);
+        if(c->depth < -m->threshold) /* separated */
+            { Remove(m, i); continue; }
+        /* tangential drift: pos1 projected on the contact plane, vs pos2 */
+        ccdVec3Copy(&d, &m->normal);
+        ccdVec3Scale(&d, -c->depth);
+        ccdVec3Add(&d, &c->pos1);
+        if(ccdVec3Dist2(&d, &c->pos2) > thr2)
+            Remove(m, i);
+        }
+    }
+
+static real_t Area(const vec3_t *p0, const vec3_t *p1, const vec3_t *p2, const vec3_t *p3)
+/* Measure of the area of the quadrilateral with the given vertices, taken in any order
+ * (squared length of the cross product of the diagonals, for the best pairing). */
+    {
+    real_t a, best = CCD_ZERO;
+    vec3_t d1, d2, n;
+#define TRY(a0, a1, b0, b1) do {                                        \
+    ccdVec3Sub2(&d1, (a0), (a1)); ccdVec3Sub2(&d2, (b0), (b1));         \
+    ccdVec3Cross(&n, &d1, &d2); a = ccdVec3Len2(&n);                    \
+    if(a > best) best = a;                                              \
+} while(0)
+    TRY(p0, p1, p2, p3);
+    TRY(p0, p2, p1, p3);
+    TRY(p0, p3, p1, p2);
+#undef TRY
+    return best;
+    }
+
+static int ReplaceIndex(const manifold_t *m, const contact_t *c)
+/* Selects the point to be replaced by c in a full manifold: the deepest point is kept,
+ * and among the others we replace the one that gives the largest area. */
+    {
+    int i, k, deepest = 0, best = 0;
+    real_t area, maxarea = -CCD_ONE;
+    const vec3_t *q[MANIFOLD_MAX];
+    for(i = 1; i < MANIFOLD_MAX; i++)
+        if(m->point[i].depth > m->point[deepest].depth) deepest = i;
+    if(c->depth > m->point[deepest].depth) deepest = -1; /* the new one is the deepest */
+    for(k = 0; k < MANIFOLD_MAX; k++)
+        {
+        if(k == deepest) continue;
+        for(i = 0; i < MANIFOLD_MAX; i++)
+            q[i] = (i == k) ? &c->pos1 : &m->point[i].pos1;
+        area = Area(q[0], q[1], q[2], q[3]);
+        if(area > maxarea) { maxarea = area; best = k; }
+        }
+    return best;
+    }
+
+static void AddPoint(manifold_t *m, const contact_t *c)
+    {
+    int i, nearest = -1;
+    real_t dist2, mindist2 = m->threshold*m->threshold;
+    for(i = 0; i < m->count; i++)
+        {
+        dist2 = ccdVec3Dist2(&m->point[i].local1, &c->local1);
+        if(dist2 < mindist2) { mindist2 = dist2; nearest = i; }
+        }
+    if(nearest >= 0) /* same point as an existing one */
+        { m->point[nearest] = *c; return; }
+    if(m->count < MANIFOLD_MAX)
+        { m->point[m->count++] = *c; return; }
+    m->point[ReplaceIndex(m, c)] = *c;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Update                                                                       |
+ *------------------------------------------------------------------------------*/
+
+static int Penetration(const void *obj1, const void *obj2, const ccd_t *ccd,
+                real_t *depth, vec3_t *dir, vec3_t *pos)
+/* Closed-form kernel if available, else MPR if the center functions are available,
+ * otherwise GJK+EPA */
+    {
+    int rc = kernel_penetration(ccd, obj1, obj2, depth, dir, pos);
+    if(rc != KERNEL_NONE) return rc;
+    if(ccd->center1 && ccd->center2)
+        return ccdMPRPenetration(obj1, obj2, ccd, depth, dir, pos);
+    return ccdGJKPenetration(obj1, obj2, ccd, depth, dir, pos);
+    }
+
+static real_t Radius(const void *obj, ccd_support_fn support)
+/* Half the diagonal of the bounding box of obj */
+    {
+    int i;
+    real_t e, r2 = CCD_ZERO;
+    vec3_t d, p, q;
+    for(i = 0; i < 3; i++)
+        {
+        ccdVec3Set(&d, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+        d.v[i] = CCD_ONE;
+        support(obj, &d, &p);
+        d.v[i] = -CCD_ONE;
+        support(obj, &d, &q);
+        e = (p.v[i] - q.v[i])/2;
+        r2 += e*e;
+        }
+    return CCD_SQRT(r2);
+    }
+
+static int Perturb(manifold_t *m, const void *obj1, const void *obj2, const ccd_t *ccd,
+                const vec3_t *pivot, const vec3_t *plane,
+                const vec3_t *pos1, const quat_t *quat1, const vec3_t *pos2, const quat_t *quat2)
+/* Repeats the query with obj1 rotated about the pivot by a small angle, around axes
+ * evenly spaced in the contact plane (offset by half a step, so that with 4 of them a
+ * face contact between boxes tilts one corner at a time). The deepest point of the
+ * rotated obj1 is mapped back onto obj1, and paired with its projection on the contact
+ * plane of obj2 (the plane through the given point, orthogonal to the normal).
+ * Native shapes are rotated by changing the pose of a copy, so that the closed-form
+ * kernels can still be used; other objects are wrapped in a posed_t. */
+    {
+    int i, rc, native;
+    real_t a, angle, radius, depth;
+    vec3_t u, v, axis, dir, pos, p;
+    quat_t rot, inv;
+    posed_t posed;
+    shape_t shape;
+    ccd_t c;
+    contact_t contact;
+    const void *perturbed;
+
+    radius = Radius(obj1, ccd->support1);
+    if(ccdIsZero(radius)) /* unbounded (plane) */
+        radius = Radius(obj2, ccd->support2);
+    if(ccdIsZero(radius)) return 0;
+    angle = m->threshold/radius; /* moves the farthest point of obj1 by about threshold */
+    if(angle > PERTURBATION_ANGLE_MAX) angle = PERTURBATION_ANGLE_MAX;
+
+    /* u, v = orthonormal basis of the contact plane */
+    if(CCD_FABS(m->normal.v[0]) > CCD_REAL(0.57735))
+        ccdVec3Set(&u, m->normal.v[1], -m->normal.v[0], CCD_ZERO);
+    else
+        ccdVec3Set(&u, CCD_ZERO, m->normal.v[2], -m->normal.v[1]);
+    ccdVec3Normalize(&u);
+    ccdVec3Cross(&v, &m->normal, &u);
+
+    memcpy(&c, ccd, sizeof(ccd_t));
+    native = isshape(ccd, 1);
+    if(native)
+        {
+        memcpy(&shape, obj1, sizeof(shape_t));
+        perturbed = &shape;
+        }
+    else
+        {
+        c.support1 = posed_support;
+        c.center1 = ccd->center1 ? posed_center : NULL;
+        c.first_dir = ccdFirstDirDefault; /* a custom one may not know about the wrapper */
+        posed_init(&posed, obj1, ccd->support1, ccd->center1);
+        perturbed = &posed;
+        }
+    for(i = 0; i < m->perturbations; i++)
+        {
+        a = M_PI*(2*i + 1)/m->perturbations;
+        ccdVec3Copy(&axis, &u);
+        ccdVec3Scale(&axis, cos(a));
+        ccdVec3Copy(&p, &v);
+        ccdVec3Scale(&p, sin(a));
+        ccdVec3Add(&axis, &p);
+        ccdQuatSetAngleAxis(&rot, angle, &axis);
+        ccdQuatInvert2(&inv, &rot);
+        /* x' = pivot + rot*(x - pivot) */
+        if(native)
+            {
+            const shape_t *s1 = (const shape_t*)obj1;
+            ccdVec3Sub2(&p, &s1->pos, pivot);
+            ccdQuatRotVec(&p, &rot);
+            ccdVec3Copy(&shape.pos, pivot);
+            ccdVec3Add(&shape.pos, &p);
+            ccdQuatMul2(&shape.quat, &rot, &s1->quat);
+            ccdQuatInvert2(&shape.inv, &shape.quat);
+            }
+        else
+            {
+            ccdVec3Copy(&p, pivot);
+            ccdQuatRotVec(&p, &rot);
+            ccdVec3Sub2(&pos, pivot, &p);
+            posed_set(&posed, &pos, &rot);
+            }
+        rc = Penetration(perturbed, obj2, &c, &depth, &dir, &p);
+        if(rc == -2) return rc;
+        if(rc != 0) continue;
+        /* deepest point of the rotated obj1 */
+        ccdVec3Scale(&dir, depth/2);
+        ccdVec3Add(&p, &dir);
+        /* back to obj1: x = pivot + inv*(x' - pivot) */
+        ccdVec3Sub(&p, pivot);
+        ccdQuatRotVec(&p, &inv);
+        ccdVec3Add(&p, pivot);
+        ccdVec3Copy(&contact.pos1, &p);
+        ccdVec3Sub2(&p, &contact.pos1, plane);
+        depth = ccdVec3Dot(&p, &m->normal);
+        if(depth < -m->threshold) continue;
+        ccdVec3Copy(&contact.pos2, &m->normal);
+        ccdVec3Scale(&contact.pos2, -depth);
+        ccdVec3Add(&contact.pos2, &contact.pos1);
+        SetContact(m, &contact, pos1, quat1, pos2, quat2);
+        AddPoint(m, &contact);
+        }
+    return 0;
+    }
+
+int manifold_update(manifold_t *m, const void *obj1, const void *obj2, const ccd_t *ccd,
+                const vec3_t *pos1, const quat_t *quat1, const vec3_t *pos2, const quat_t *quat2)
+/* Refreshes the manifold for the given poses of the objects, and adds to it the contact
+ * point found by a penetration query, if any. The support and center functions in ccd
+ * are expressed in global coordinates, while the poses are used only to track the points.
+ * Returns 0 on success, or -2 on memory allocation failure (from libccd).
+ */
+    {
+    int i, rc, fill;
+    real_t depth;
+    vec3_t dir, pos, d;
+    contact_t contact;
+
+    manifold_refresh(m, pos1, quat1, pos2, quat2);
+    rc = Penetration(obj1, obj2, ccd, &depth, &dir, &pos);
+    if(rc == -2) return rc;
+    if(rc != 0) return 0; /* no new point: keep the refreshed ones, if any */
+
+    if(m->count > 0 && ccdVec3Dot(&dir, &m->normal) < NORMAL_COS_MIN)
+        m->count = 0; /* the contact configuration changed */
+    ccdVec3Copy(&m->normal, &dir);
+    for(i = 0; i < m->count; i++)
+        m->point[i].depth = Depth(m, &m->point[i]);
+    fill = (m->count == 0);
+
+    /* pos is halfway between the deepest points of the two objects */
+    ccdVec3Copy(&d, &dir);
+    ccdVec3Scale(&d, depth/2);
+    ccdVec3Copy(&contact.pos1, &pos);
+    ccdVec3Add(&contact.pos1, &d);
+    ccdVec3Sub2(&contact.pos2, &pos, &d);
+    SetContact(m, &contact, pos1, quat1, pos2, quat2);
+    AddPoint(m, &contact);
+    if(fill && m->perturbations > 0)
+        return Perturb(m, obj1, obj2, ccd, &pos, &contact.pos2, pos1, quat1, pos2, quat2);
+    return 0;
+    }
+
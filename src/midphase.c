@@ -0,0 +1,235 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* Midphase culling cascade.
+ *
+ * Before the narrowphase, a pair of bounded native shapes goes through a sequence of
+ * increasingly expensive tests, each of which may prove that the shapes are separated:
+ *
+ * 1) the bounding sphere test (one distance),
+ * 2) the OBB test (separating axis test on 15 axes),
+ * 3) the cached separating axis test (2 support function calls, see below),
+ *
+ * and only the pairs that survive all of them are passed to the narrowphase (GJK).
+ *
+ * The separating axis found by the OBB test or by the narrowphase for a separated pair
+ * is cached, and tested first on the next query on the same pair: if the shapes moved
+ * little, it is likely to still separate them. Any axis along which the projections of
+ * the two shapes do not overlap proves that they are separated, so a stale entry (e.g.
+ * one left by a freed shape, whose memory was reused by another one) may cost a test but
+ * never causes a wrong rejection.
+ *
+ * Each stage counts the pairs it rejects.
+ */
+
+#define CACHE_MINSIZE   64          /* initial size of the axis cache */
+#define CACHE_MAXSIZE   (1 << 16)   /* max size (the cache is cleared when full) */
+
+/*------------------------------------------------------------------------------*
+ | Separating axis cache                                                        |
+ *------------------------------------------------------------------------------*/
+
+/* The cache is an open addressing hash table (linear probing) keyed by the ordered pair
+ * of shape pointers. The axes are stored oriented from the second to the first shape,
+ * so that the first is on the positive side. Entries are never removed: an axis that no
+ * longer separates the pair is zeroed instead. */
+
+static size_t Hash(const void *obj1, const void *obj2, size_t size)
+    {
+    uint64_t h = (uint64_t)(uintptr_t)obj1 * 0x9e3779b97f4a7c15ULL;
+    h ^= (uint64_t)(uintptr_t)obj2 + 0x7f4a7c159e3779b9ULL + (h << 6) + (h >> 2);
+    h ^= h >> 29;
+    return (size_t)(h & (size - 1));
+    }
+
+static axisentry_t *Lookup(midphase_t *mp, const void *obj1, const void *obj2)
+    {
+    size_t i;
+    axisentry_t *e;
+    if(mp->size == 0) return NULL;
+    i = Hash(obj1, obj2, mp->size);
+    for(;;)
+        {
+        e = &mp->cache[i];
+        if(e->obj1 == NULL) return NULL;
+        if(e->obj1 == obj1 && e->obj2 == obj2) return e;
+        i = (i + 1) & (mp->size - 1);
+        }
+    }
+
+static axisentry_t *Insert(lua_State *L, midphase_t *mp, const void *obj1, const void *obj2)
+    {
+    size_t i, j, oldsize;
+    axisentry_t *e, *old;
+    e = Lookup(mp, obj1, obj2);
+    if(e) return e;
+    if(2*(mp->count + 1) > mp->size) /* keep the load factor below 1/2 */
+        {
+        if(mp->size >= CACHE_MAXSIZE)
+            { memset(mp->cache, 0, mp->size*sizeof(axisentry_t)); mp->count = 0; }
+        else
+            {
+            old = mp->cache;
+            oldsize = mp->size;
+            mp->size = oldsize > 0 ? 2*oldsize : CACHE_MINSIZE;
+            mp->cache = (axisentry_t*)Malloc(L, mp->size*sizeof(axisentry_t));
+            for(j = 0; j < oldsize; j++)
+                {
+                if(old[j].obj1 == NULL) continue;
+                i = Hash(old[j].obj1, old[j].obj2, mp->size);
+                while(mp->cache[i].obj1 != NULL) i = (i + 1) & (mp->size - 1);
+                mp->cache[i] = old[j];
+                }
+            if(old) Free(L, old);
+            }
+        }
+    i = Hash(obj1, obj2, mp->size);
+    while(mp->cache[i].obj1 != NULL) i = (i + 1) & (mp->size - 1);
+    e = &mp->cache[i];
+    e->obj1 = obj1;
+    e->obj2 = obj2;
+    mp->count++;
+    return e;
+    }
+
+static void Order(shape_t **s1, shape_t **s2, real_t *sign)
+    {
+    shape_t *s;
+    *sign = CCD_ONE;
+    if((uintptr_t)*s1 > (uintptr_t)*s2)
+        { s = *s1; *s1 = *s2; *s2 = s; *sign = -CCD_ONE; }
+    }
+
+static void Store(lua_State *L, midphase_t *mp, shape_t *s1, shape_t *s2, const vec3_t *axis)
+/* Caches the axis separating s1 and s2 (oriented from s2 to s1) */
+    {
+    real_t sign;
+    axisentry_t *e;
+    Order(&s1, &s2, &sign);
+    e = Insert(L, mp, s1, s2);
+    ccdVec3Copy(&e->axis, axis);
+    ccdVec3Scale(&e->axis, sign);
+    }
+
+static int CachedSeparated(midphase_t *mp, shape_t *s1, shape_t *s2)
+/* Returns 1 if the cached axis (if any) separates s1 and s2 */
+    {
+    real_t sign;
+    vec3_t d, p1, p2;
+    axisentry_t *e;
+    Order(&s1, &s2, &sign);
+    e = Lookup(mp, s1, s2);
+    if(!e || ccdVec3Len2(&e->axis) == CCD_ZERO) return 0;
+    /* s1 is expected on the positive side: min(s1) > max(s2) along the axis */
+    ccdVec3Copy(&d, &e->axis);
+    shape_support(s2, &d, &p2);
+    ccdVec3Scale(&d, -CCD_ONE);
+    shape_support(s1, &d, &p1);
+    if(ccdVec3Dot(&e->axis, &p1) > ccdVec3Dot(&e->axis, &p2)) return 1;
+    ccdVec3Set(&e->axis, CCD_ZERO, CCD_ZERO, CCD_ZERO); /* no longer separating */
+    return 0;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Cascade                                                                      |
+ *------------------------------------------------------------------------------*/
+
+int midphase_reject(lua_State *L, midphase_t *mp, shape_t *s1, shape_t *s2)
+/* Runs the cheap stages of the cascade on a pair of bounded shapes.
+ * Returns 1 if the pair is rejected (i.e. the shapes are separated), 0 otherwise.
+ */
+    {
+    bsphere_t b1, b2;
+    obb_t o1, o2;
+    vec3_t axis, t;
+    mp->pairs++;
+    shape_bsphere(s1, &b1);
+    shape_bsphere(s2, &b2);
+    if(!bsphere_overlap(&b1, &b2))
+        { mp->sphere++; return 1; }
+    shape_obb(s1, &o1);
+    shape_obb(s2, &o2);
+    if(obb_separated(&o1, &o2, &axis))
+        {
+        /* orient the axis from s2 to s1 */
+        ccdVec3Sub2(&t, &o1.center, &o2.center);
+        if(ccdVec3Dot(&t, &axis) < CCD_ZERO) ccdVec3Scale(&axis, -CCD_ONE);
+        Store(L, mp, s1, s2, &axis);
+        mp->obb++;
+        return 1;
+        }
+    if(CachedSeparated(mp, s1, s2))
+        { mp->axis++; return 1; }
+    return 0;
+    }
+
+int midphase_intersect(lua_State *L, midphase_t *mp, const ccd_t *ccd, shape_t *s1, shape_t *s2)
+/* Runs the whole cascade on a pair of bounded shapes, with GJK as narrowphase.
+ * Returns 1 if the shapes intersect, 0 otherwise.
+ */
+    {
+    ccd_t c;
+    gjk_simplex_t s;
+    real_t dist;
+    vec3_t dir;
+    if(midphase_reject(L, mp, s1, s2)) return 0;
+    memcpy(&c, ccd, sizeof(ccd_t));
+    c.first_dir = ccdFirstDirDefault;
+    c.support1 = c.support2 = shape_support;
+    c.center1 = c.center2 = shape_center;
+    s.count = 0;
+    mp->narrow++;
+    /* with a zero margin, GJK stops as soon as it finds a separating direction */
+    if(gjk_distance(s1, s2, &c, &s, CCD_ZERO, &dist, &dir) == 1)
+        { mp->hits++; return 1; }
+    if(ccdVec3Len2(&dir) > CCD_ZERO)
+        Store(L, mp, s1, s2, &dir); /* dir is the closest point of s1 - s2: it points to s1 */
+    return 0;
+    }
+
+void midphase_reset(lua_State *L, midphase_t *mp)
+/* Clears the counters and the axis cache */
+    {
+    if(mp->cache) Free(L, mp->cache);
+    mp->cache = NULL;
+    mp->size = mp->count = 0;
+    mp->pairs = mp->sphere = mp->obb = mp->axis = mp->narrow = mp->hits = 0;
+    }
+
+int midphase_pushstats(lua_State *L, const midphase_t *mp)
+    {
+    lua_newtable(L);
+    lua_pushinteger(L, mp->pairs); lua_setfield(L, -2, "pairs");
+    lua_pushinteger(L, mp->sphere); lua_setfield(L, -2, "sphere");
+    lua_pushinteger(L, mp->obb); lua_setfield(L, -2, "obb");
+    lua_pushinteger(L, mp->axis); lua_setfield(L, -2, "axis");
+    lua_pushinteger(L, mp->narrow); lua_setfield(L, -2, "narrowphase");
+    lua_pushinteger(L, mp->hits); lua_setfield(L, -2, "hits");
+    lua_pushinteger(L, mp->count); lua_setfield(L, -2, "cached");
+    return 1;
+    }
+
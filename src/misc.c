@@ -39,22 +39,22 @@ static int Points_on_sphere(lua_State *L)
 
 static int Sign(lua_State *L)
     {
-    double val = luaL_checknumber(L, 1);
+    real_t val = luaL_checknumber(L, 1);
     lua_pushinteger(L, ccdSign(val));
     return 1;
     }
 
 static int IsZero(lua_State *L)
     {
-    double val = luaL_checknumber(L, 1);
+    real_t val = luaL_checknumber(L, 1);
     lua_pushboolean(L, ccdIsZero(val));
     return 1;
     }
 
 static int Eq(lua_State *L)
     {
-    double a = luaL_checknumber(L, 1);
-    double b = luaL_checknumber(L, 2);
+    real_t a = luaL_checknumber(L, 1);
+    real_t b = luaL_checknumber(L, 2);
     lua_pushboolean(L, ccdEq(a, b));
     return 1;
     }
@@ -117,7 +117,7 @@ static int Vec3Add(lua_State *L)
 static int Vec3Scale(lua_State *L)
     {
     vec3_t v;
-    double k = luaL_checknumber(L, 2);
+    real_t k = luaL_checknumber(L, 2);
     checkvec3(L, 1, &v);
     ccdVec3Scale(&v, k); /* d = d * k; */
     pushvec3(L, &v);
@@ -215,7 +215,7 @@ static int QuatSetAngleAxis(lua_State *L)
     {
     quat_t q;
     vec3_t axis;
-    double angle = luaL_checknumber(L, 1);
+    real_t angle = luaL_checknumber(L, 1);
     checkvec3(L, 2, &axis);
     ccdQuatSetAngleAxis(&q, angle, &axis);
     pushquat(L, &q);
@@ -225,7 +225,7 @@ static int QuatSetAngleAxis(lua_State *L)
 static int QuatScale(lua_State *L)
     {
     quat_t q;
-    double k = luaL_checknumber(L, 2);
+    real_t k = luaL_checknumber(L, 2);
     checkquat(L, 1, &q);
     ccdQuatScale(&q, k);
     pushquat(L, &q);
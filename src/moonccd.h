@@ -36,8 +36,14 @@
 #include <ccd/vec3.h>
 #include <ccd/quat.h>
 
-#ifndef CCD_DOUBLE
-#error("MoonCCD requires CCD_DOUBLE")
+/* MoonCCD works with either precision, as configured in ccd/config.h (Lua numbers
+ * are converted at the boundary). */
+#if defined(CCD_SINGLE)
+#define MOONCCD_PRECISION "single"
+#elif defined(CCD_DOUBLE)
+#define MOONCCD_PRECISION "double"
+#else
+#error("MoonCCD requires either CCD_SINGLE or CCD_DOUBLE")
 #endif
 
 #define MOONCCD_VERSION      "0.1"
@@ -0,0 +1,208 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/*------------------------------------------------------------------------------*
+ | Posed objects                                                                |
+ *------------------------------------------------------------------------------*/
+
+/* A posed_t wraps an object whose support function is expressed in its local frame,
+ * and places it in the global frame according to a pose (position + rotation).
+ * Use posed_support() and posed_center() as support and center functions for it.
+ */
+
+void posed_init(posed_t *p, const void *obj, ccd_support_fn support, ccd_center_fn center)
+    {
+    p->obj = obj;
+    p->support = support;
+    p->center = center;
+    ccdVec3Set(&p->pos, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    ccdQuatSet(&p->quat, CCD_ZERO, CCD_ZERO, CCD_ZERO, CCD_ONE);
+    ccdQuatSet(&p->inv, CCD_ZERO, CCD_ZERO, CCD_ZERO, CCD_ONE);
+    }
+
+void posed_set(posed_t *p, const vec3_t *pos, const quat_t *quat)
+    {
+    ccdVec3Copy(&p->pos, pos);
+    ccdQuatCopy(&p->quat, quat);
+    ccdQuatInvert2(&p->inv, quat);
+    }
+
+void posed_support(const void *obj, const vec3_t *dir, vec3_t *vec)
+    {
+    const posed_t *p = (const posed_t*)obj;
+    vec3_t d;
+    ccdVec3Copy(&d, dir);
+    ccdQuatRotVec(&d, &p->inv);
+    p->support(p->obj, &d, vec);
+    ccdQuatRotVec(vec, &p->quat);
+    ccdVec3Add(vec, &p->pos);
+    }
+
+void posed_center(const void *obj, vec3_t *center)
+    {
+    const posed_t *p = (const posed_t*)obj;
+    if(p->center)
+        {
+        p->center(p->obj, center);
+        ccdQuatRotVec(center, &p->quat);
+        }
+    else
+        ccdVec3Set(center, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    ccdVec3Add(center, &p->pos);
+    }
+
+/*------------------------------------------------------------------------------*
+ | Rigid motion                                                                 |
+ *------------------------------------------------------------------------------*/
+
+typedef struct {
+    vec3_t pos0, vel;   /* initial position and linear velocity */
+    quat_t quat0;       /* initial rotation */
+    vec3_t axis;        /* rotation axis */
+    real_t omega;       /* angular velocity (rad per unit time) */
+} screw_t;
+
+static void ScrewInit(screw_t *screw, const motion_t *m)
+/* Interpolates the motion with constant linear and angular velocities, in unit time */
+    {
+    quat_t dq, inv;
+    real_t w, s;
+    ccdVec3Copy(&screw->pos0, &m->pos0);
+    ccdVec3Sub2(&screw->vel, &m->pos1, &m->pos0);
+    ccdQuatCopy(&screw->quat0, &m->quat0);
+    ccdQuatInvert2(&inv, &m->quat0);
+    ccdQuatMul2(&dq, &m->quat1, &inv); /* dq = quat1 * quat0^-1 */
+    ccdQuatNormalize(&dq);
+    if(dq.q[3] < CCD_ZERO) ccdQuatScale(&dq, -CCD_ONE); /* shortest arc */
+    w = dq.q[3] > CCD_ONE ? CCD_ONE : dq.q[3];
+    s = CCD_SQRT(CCD_ONE - w*w);
+    if(s < CCD_EPS)
+        {
+        screw->omega = CCD_ZERO;
+        ccdVec3Set(&screw->axis, CCD_ONE, CCD_ZERO, CCD_ZERO);
+        return;
+        }
+    screw->omega = 2*acos(w);
+    ccdVec3Set(&screw->axis, dq.q[0]/s, dq.q[1]/s, dq.q[2]/s);
+    }
+
+static void ScrewPose(const screw_t *screw, real_t t, vec3_t *pos, quat_t *quat)
+    {
+    quat_t dq;
+    ccdVec3Copy(pos, &screw->vel);
+    ccdVec3Scale(pos, t);
+    ccdVec3Add(pos, &screw->pos0);
+    if(screw->omega == CCD_ZERO)
+        { ccdQuatCopy(quat, &screw->quat0); return; }
+    ccdQuatSetAngleAxis(&dq, t*screw->omega, &screw->axis);
+    ccdQuatMul2(quat, &dq, &screw->quat0);
+    }
+
+static real_t Extent(const void *obj, ccd_support_fn support)
+/* Upper bound for the distance of the points of obj from the origin of its local frame,
+ * computed from its support points along the coordinate axes. */
+    {
+    int i;
+    real_t e, r2 = CCD_ZERO;
+    vec3_t d, p, q;
+    for(i=0; i<3; i++)
+        {
+        ccdVec3Set(&d, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+        d.v[i] = CCD_ONE;
+        support(obj, &d, &p);
+        d.v[i] = -CCD_ONE;
+        support(obj, &d, &q);
+        e = CCD_FMAX(CCD_FABS(p.v[i]), CCD_FABS(q.v[i]));
+        r2 += e*e;
+        }
+    return CCD_SQRT(r2);
+    }
+
+int rigid_toi(const void *obj1, const void *obj2, const ccd_t *ccd,
+        const motion_t *m1, const motion_t *m2, real_t tolerance,
+        real_t *toi, vec3_t *pos1, vec3_t *pos2, vec3_t *normal)
+/* Computes the time of impact of two objects moving with the given rigid motions in
+ * unit time, using conservative advancement (Mirtich, 'Impulse-based Dynamic Simulation
+ * of Rigid Body Systems'). The support functions in ccd are expressed in the objects'
+ * local frames.
+ * Returns 0 on hit, with the time of impact (in [0, 1]), the witness points on the two
+ * objects and the contact normal (from obj1 to obj2) at that time, in global coordinates.
+ * Returns -1 if the objects do not come into contact during the motion, and -2 if the
+ * iteration runs out of max_iterations before deciding.
+ */
+    {
+    unsigned long iter;
+    int rc;
+    real_t t = CCD_ZERO, dist, bound, r1, r2;
+    screw_t s1, s2;
+    posed_t p1, p2;
+    vec3_t pos, vrel;
+    quat_t quat;
+    ccd_t c;
+    gjk_simplex_t s;
+
+    posed_init(&p1, obj1, ccd->support1, ccd->center1);
+    posed_init(&p2, obj2, ccd->support2, ccd->center2);
+    memcpy(&c, ccd, sizeof(ccd_t));
+    c.support1 = c.support2 = posed_support;
+    c.center1 = c.center2 = posed_center;
+    ScrewInit(&s1, m1);
+    ScrewInit(&s2, m2);
+    r1 = s1.omega > CCD_ZERO ? Extent(obj1, ccd->support1) : CCD_ZERO;
+    r2 = s2.omega > CCD_ZERO ? Extent(obj2, ccd->support2) : CCD_ZERO;
+    ccdVec3Sub2(&vrel, &s1.vel, &s2.vel);
+    s.count = 0; /* warm-started across iterations */
+
+    for(iter = 0; iter < ccd->max_iterations; iter++)
+        {
+        ScrewPose(&s1, t, &pos, &quat); posed_set(&p1, &pos, &quat);
+        ScrewPose(&s2, t, &pos, &quat); posed_set(&p2, &pos, &quat);
+        rc = gjk_distance(&p1, &p2, &c, &s, -CCD_ONE, &dist, NULL);
+        if(rc == 1) /* already in contact (keep the last normal and witnesses, if any) */
+            {
+            if(iter == 0)
+                {
+                gjk_witness(&s, pos1, pos2);
+                ccdVec3Set(normal, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+                }
+            *toi = t;
+            return 0;
+            }
+        if(rc == -2) return -2; /* dist is only an upper bound: advancing by it could skip the contact */
+        gjk_witness(&s, pos1, pos2);
+        ccdVec3Sub2(normal, pos2, pos1);
+        if(ccdVec3Len2(normal) > CCD_ZERO) ccdVec3Normalize(normal);
+        if(dist <= tolerance) { *toi = t; return 0; }
+        /* upper bound for the approach velocity along the normal */
+        bound = ccdVec3Dot(&vrel, normal) + s1.omega*r1 + s2.omega*r2;
+        if(bound <= CCD_ZERO) return -1;
+        t += (dist - tolerance/2)/bound; /* stop just short of touching */
+        if(t > CCD_ONE) return -1;
+        }
+    return -2; /* not converged */
+    }
+
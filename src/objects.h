@@ -36,6 +36,11 @@
 
 /* Objects' metatable names */
 #define CCDPAR_MT "moonccd_ccdpar" /* ccd_t */ 
+#define PAIR_MT "moonccd_pair" /* pair_t */
+#define SHAPE_MT "moonccd_shape" /* shape_t */
+#define BROADPHASE_MT "moonccd_broadphase" /* broadphase_t */
+#define BOUNDS_MT "moonccd_bounds" /* bounds_t */
+#define WORLD_MT "moonccd_world" /* world_t */
 
 /* Userdata memory associated with objects */
 #define ud_t moonccd_ud_t
@@ -110,6 +115,36 @@ void** checkxxxlist(lua_State *L, int arg, int *count, int *err, const char *mt)
 #define pushccd(L, handle) pushxxx((L), (void*)(handle))
 #define checkccdlist(L, arg, count, err) checkxxxlist((L), (arg), (count), (err), CCDPAR_MT)
 
+/* pair.c */
+#define checkpair(L, arg, udp) (pair_t*)checkxxx((L), (arg), (udp), PAIR_MT)
+#define testpair(L, arg, udp) (pair_t*)testxxx((L), (arg), (udp), PAIR_MT)
+#define optpair(L, arg, udp) (pair_t*)optxxx((L), (arg), (udp), PAIR_MT)
+#define pushpair(L, handle) pushxxx((L), (void*)(handle))
+
+/* shape.c */
+#define checkshape(L, arg, udp) (shape_t*)checkxxx((L), (arg), (udp), SHAPE_MT)
+#define testshape(L, arg, udp) (shape_t*)testxxx((L), (arg), (udp), SHAPE_MT)
+#define optshape(L, arg, udp) (shape_t*)optxxx((L), (arg), (udp), SHAPE_MT)
+#define pushshape(L, handle) pushxxx((L), (void*)(handle))
+
+/* broadphase.c */
+#define checkbroadphase(L, arg, udp) (broadphase_t*)checkxxx((L), (arg), (udp), BROADPHASE_MT)
+#define testbroadphase(L, arg, udp) (broadphase_t*)testxxx((L), (arg), (udp), BROADPHASE_MT)
+#define optbroadphase(L, arg, udp) (broadphase_t*)optxxx((L), (arg), (udp), BROADPHASE_MT)
+#define pushbroadphase(L, handle) pushxxx((L), (void*)(handle))
+
+/* bounds.c */
+#define checkbounds(L, arg, udp) (bounds_t*)checkxxx((L), (arg), (udp), BOUNDS_MT)
+#define testbounds(L, arg, udp) (bounds_t*)testxxx((L), (arg), (udp), BOUNDS_MT)
+#define optbounds(L, arg, udp) (bounds_t*)optxxx((L), (arg), (udp), BOUNDS_MT)
+#define pushbounds(L, handle) pushxxx((L), (void*)(handle))
+
+/* world.c */
+#define checkworld(L, arg, udp) (world_t*)checkxxx((L), (arg), (udp), WORLD_MT)
+#define testworld(L, arg, udp) (world_t*)testxxx((L), (arg), (udp), WORLD_MT)
+#define optworld(L, arg, udp) (world_t*)optxxx((L), (arg), (udp), WORLD_MT)
+#define pushworld(L, handle) pushxxx((L), (void*)(handle))
+
 #define RAW_FUNC(xxx)                       \
 static int Raw(lua_State *L)                \
     {                                       \
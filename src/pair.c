@@ -0,0 +1,349 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* A pair object binds two objects to a ccdpar, and keeps information about the pair
+ * across queries, to exploit temporal coherence.
+ */
+
+static int freepair(lua_State *L, ud_t *ud)
+    {
+    pair_t *pair = (pair_t*)ud->handle;
+    if(!freeuserdata(L, ud, "pair")) return 0;
+    Free(L, pair);
+    return 0;
+    }
+
+static int New(lua_State *L)
+    {
+    int i, perturbations = 4;
+    real_t threshold = CCD_REAL(0.02);
+    ud_t *ud, *ccd_ud;
+    pair_t *pair;
+    (void)checkccd(L, 1, &ccd_ud);
+    luaL_checkany(L, 2);
+    luaL_checkany(L, 3);
+    if(!lua_isnoneornil(L, 4))
+        {
+        if(!lua_istable(L, 4)) return argerror(L, 4, ERR_TABLE);
+        lua_getfield(L, 4, "contact_threshold");
+        threshold = luaL_optnumber(L, -1, threshold);
+        lua_pop(L, 1);
+        lua_getfield(L, 4, "perturbations");
+        perturbations = luaL_optinteger(L, -1, perturbations);
+        lua_pop(L, 1);
+        if(threshold <= 0) return argerror(L, 4, ERR_VALUE);
+        if(perturbations < 0) return argerror(L, 4, ERR_VALUE);
+        }
+    pair = Malloc(L, sizeof(pair_t));
+    manifold_init(&pair->manifold, threshold, perturbations);
+    ud = newuserdata(L, pair, PAIR_MT, "pair");
+    ud->parent_ud = ccd_ud;
+    ud->destructor = freepair;
+    for(i=0; i<6; i++) ud->ref[i] = LUA_NOREF;
+    Reference(L, 1, ud->ref[0]);
+    Reference(L, 2, ud->ref[1]);
+    Reference(L, 3, ud->ref[2]);
+    return 1;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Warm start                                                                   |
+ *------------------------------------------------------------------------------*/
+
+static pair_t *Pair = NULL; /* the pair being queried */
+static const ccd_t *Ccd = NULL; /* its ccd_t */
+static const void *Obj1, *Obj2; /* its objects, as passed to libccd */
+
+static void FirstDir(const void *obj1, const void *obj2, vec3_t *dir)
+/* Default first direction for pairs: the last known direction from obj1 to obj2,
+ * or the difference between the centers, if available. */
+    {
+    vec3_t c1;
+    if(Pair->has_axis) { ccdVec3Copy(dir, &Pair->axis); return; }
+    if(Pair->has_dir) { ccdVec3Copy(dir, &Pair->dir); return; }
+    if(Ccd->center1 && Ccd->center2)
+        {
+        Ccd->center1(obj1, &c1);
+        Ccd->center2(obj2, dir);
+        ccdVec3Sub(dir, &c1);
+        if(!ccdIsZero(ccdVec3Len2(dir))) return;
+        }
+    ccdFirstDirDefault(obj1, obj2, dir);
+    }
+
+static ccd_t *Bind(lua_State *L, ccd_t *c)
+/* Binds the pair at arg 1 and returns in c the ccd_t to be used for it */
+    {
+    ud_t *ud;
+    Pair = checkpair(L, 1, &ud);
+    Ccd = bindccd(L, ud->ref[0], ud->ref[1], ud->ref[2], c, &Obj1, &Obj2);
+    if(c->first_dir == ccdFirstDirDefault) /* not overridden by the script */
+        c->first_dir = FirstDir;
+    return c;
+    }
+
+static void SetDir(pair_t *pair, const vec3_t *dir)
+    {
+    if(ccdIsZero(ccdVec3Len2(dir))) return;
+    ccdVec3Copy(&pair->dir, dir);
+    ccdVec3Normalize(&pair->dir);
+    pair->has_dir = 1;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Queries                                                                      |
+ *------------------------------------------------------------------------------*/
+
+static void SetAxis(pair_t *pair, const vec3_t *v)
+/* v is the closest point of obj1 - obj2 to the origin, so -v separates obj1 from obj2 */
+    {
+    ccdVec3Copy(&pair->axis, v);
+    ccdVec3Scale(&pair->axis, -CCD_ONE);
+    ccdVec3Normalize(&pair->axis);
+    gjk_witness(&pair->simplex, &pair->p1, &pair->p2);
+    pair->has_axis = 1;
+    SetDir(pair, &pair->axis);
+    }
+
+static int Intersect(lua_State *L)
+    {
+    int rc;
+    ccd_t c, *ccd;
+    real_t dist;
+    vec3_t v, pos;
+    pair_t *pair;
+    ccd = Bind(L, &c);
+    pair = Pair;
+    rc = kernel_penetration(ccd, Obj1, Obj2, &dist, &v, &pos);
+    if(rc != KERNEL_NONE) /* closed-form: no need for caching */
+        {
+        lua_pushboolean(L, rc == 0);
+        return 1;
+        }
+    checkbounded(L, ccd, Obj1, Obj2);
+    if(pair->has_axis)
+        { /* first try with the last separating axis */
+        ccd->support1(Obj1, &pair->axis, &pair->p1);
+        ccdVec3Copy(&v, &pair->axis);
+        ccdVec3Scale(&v, -CCD_ONE);
+        ccd->support2(Obj2, &v, &pair->p2);
+        if(ccdVec3Dot(&pair->axis, &pair->p1) < ccdVec3Dot(&pair->axis, &pair->p2))
+            { lua_pushboolean(L, 0); return 1; }
+        }
+    if(gjk_distance(Obj1, Obj2, ccd, &pair->simplex, CCD_ZERO, &dist, &v) == 1)
+        {
+        pair->has_axis = 0;
+        lua_pushboolean(L, 1);
+        return 1;
+        }
+    SetAxis(pair, &v);
+    lua_pushboolean(L, 0);
+    return 1;
+    }
+
+static int Distance(lua_State *L)
+    {
+    ccd_t c, *ccd;
+    real_t dist;
+    vec3_t v, p1, p2;
+    pair_t *pair;
+    ccd = Bind(L, &c);
+    pair = Pair;
+    checkbounded(L, ccd, Obj1, Obj2);
+    if(gjk_distance(Obj1, Obj2, ccd, &pair->simplex, -CCD_ONE, &dist, &v) == 1)
+        {
+        pair->has_axis = 0;
+        lua_pushnumber(L, 0);
+        return 1;
+        }
+    SetAxis(pair, &v);
+    gjk_witness(&pair->simplex, &p1, &p2);
+    lua_pushnumber(L, dist);
+    pushvec3(L, &p1);
+    pushvec3(L, &p2);
+    return 3;
+    }
+
+static int GJKSeparate(lua_State *L)
+    {
+    int rc;
+    ccd_t c, *ccd;
+    vec3_t sep;
+    ccd = Bind(L, &c);
+    checkbounded(L, ccd, Obj1, Obj2);
+    rc = ccdGJKSeparate(Obj1, Obj2, ccd, &sep);
+    switch(rc)
+        {
+        case 0:     Pair->has_axis = 0;
+                    SetDir(Pair, &sep);
+                    lua_pushboolean(L, 1);
+                    pushvec3(L, &sep);
+                    return 2;
+        case -1:    lua_pushboolean(L, 0);
+                    return 1;
+        case -2:    return errmemory(L);
+        default: break;
+        }
+    return unexpected(L);
+    }
+
+static int GJKPenetration(lua_State *L)
+    {
+    int rc;
+    ccd_t c, *ccd;
+    real_t depth;
+    vec3_t dir, pos;
+    ccd = Bind(L, &c);
+    rc = kernel_penetration(ccd, Obj1, Obj2, &depth, &dir, &pos);
+    if(rc == KERNEL_NONE)
+        {
+        checkbounded(L, ccd, Obj1, Obj2);
+        rc = ccdGJKPenetration(Obj1, Obj2, ccd, &depth, &dir, &pos);
+        }
+    switch(rc)
+        {
+        case 0:     Pair->has_axis = 0;
+                    SetDir(Pair, &dir);
+                    lua_pushboolean(L, 1);
+                    lua_pushnumber(L, depth);
+                    pushvec3(L, &dir);
+                    pushvec3(L, &pos);
+                    return 4;
+        case -1:    lua_pushboolean(L, 0);
+                    return 1;
+        case -2:    return errmemory(L);
+        default: break;
+        }
+    return unexpected(L);
+    }
+
+static int SeparatingAxis(lua_State *L)
+    {
+    pair_t *pair = checkpair(L, 1, NULL);
+    if(!pair->has_axis) return 0;
+    pushvec3(L, &pair->axis);
+    pushvec3(L, &pair->p1);
+    pushvec3(L, &pair->p2);
+    return 3;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Contact manifold                                                             |
+ *------------------------------------------------------------------------------*/
+
+static void PushContacts(lua_State *L, const manifold_t *m)
+    {
+    int i;
+    const contact_t *c;
+    lua_newtable(L);
+    for(i = 0; i < m->count; i++)
+        {
+        c = &m->point[i];
+        lua_newtable(L);
+        pushvec3(L, &c->pos1); lua_setfield(L, -2, "pos1");
+        pushvec3(L, &c->pos2); lua_setfield(L, -2, "pos2");
+        pushvec3(L, &m->normal); lua_setfield(L, -2, "normal");
+        lua_pushnumber(L, c->depth); lua_setfield(L, -2, "depth");
+        lua_rawseti(L, -2, i+1);
+        }
+    }
+
+static int Contacts(lua_State *L)
+    {
+    int rc;
+    ccd_t c, *ccd;
+    vec3_t pos1, pos2;
+    quat_t quat1, quat2;
+    checkvec3(L, 2, &pos1);
+    checkquat(L, 3, &quat1);
+    checkvec3(L, 4, &pos2);
+    checkquat(L, 5, &quat2);
+    ccd = Bind(L, &c);
+    if(!kernel_available(ccd, Obj1, Obj2))
+        checkbounded(L, ccd, Obj1, Obj2);
+    rc = manifold_update(&Pair->manifold, Obj1, Obj2, ccd, &pos1, &quat1, &pos2, &quat2);
+    if(rc == -2) return errmemory(L);
+    if(Pair->manifold.count > 0)
+        {
+        Pair->has_axis = 0;
+        SetDir(Pair, &Pair->manifold.normal);
+        }
+    PushContacts(L, &Pair->manifold);
+    return 1;
+    }
+
+static int ClearContacts(lua_State *L)
+    {
+    pair_t *pair = checkpair(L, 1, NULL);
+    pair->manifold.count = 0;
+    return 0;
+    }
+
+static int Reset(lua_State *L)
+    {
+    pair_t *pair = checkpair(L, 1, NULL);
+    pair->has_axis = 0;
+    pair->has_dir = 0;
+    pair->simplex.count = 0;
+    pair->manifold.count = 0;
+    return 0;
+    }
+
+DESTROY_FUNC(pair)
+
+static const struct luaL_Reg Methods[] = 
+    {
+        { "free", Destroy },
+        { "intersect", Intersect },
+        { "distance", Distance },
+        { "gjk_separate", GJKSeparate },
+        { "gjk_penetration", GJKPenetration },
+        { "separating_axis", SeparatingAxis },
+        { "contacts", Contacts },
+        { "clear_contacts", ClearContacts },
+        { "reset", Reset },
+        { NULL, NULL } /* sentinel */
+    };
+
+static const struct luaL_Reg MetaMethods[] = 
+    {
+        { "__gc",  Destroy },
+        { NULL, NULL } /* sentinel */
+    };
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "pair", New },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonccd_open_pair(lua_State *L)
+    {
+    udata_define(L, PAIR_MT, Methods, MetaMethods);
+    luaL_setfuncs(L, Functions, 0);
+    }
+
@@ -0,0 +1,346 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+#include <pthread.h>
+#include <unistd.h>
+
+/* Parallel sweep and prune broadphase.
+ *
+ * The boxes are sorted along the sweep axis by their min value (ties are broken by id,
+ * so that the order is unique), and each box is tested against the following boxes in
+ * the order whose min does not exceed its max. Each pair is thus found exactly once,
+ * by the box that comes first.
+ *
+ * The sorted boxes are split in fixed-size chunks, which are processed in parallel by
+ * a pool of threads (the calling thread included), each chunk producing its own list of
+ * pairs. The lists are then concatenated in chunk order, so the resulting list is the
+ * same regardless of the number of threads and of how the chunks were scheduled.
+ *
+ * The worker threads do not touch the Lua state: the chunk lists are allocated with
+ * plain malloc(), since the Lua allocator is not required to be thread-safe.
+ */
+
+#define CHUNK 1024 /* boxes per chunk */
+#define THREADS_PER_CPU 4 /* max threads per online CPU */
+
+typedef struct {
+    real_t min;
+    int id;
+} sortkey_t;
+
+typedef struct {
+    int axis;           /* sweep axis (0, 1, 2), or -1 for automatic selection */
+    int cur;            /* current sweep axis */
+    sortkey_t *keys;    /* boxes, sorted along cur */
+    int count;          /* number of keys */
+    int size;           /* allocated keys */
+    int unsorted;       /* number of keys appended since the last sort */
+    broadphase_t *bp;
+    pairbuf_t *chunks;  /* chunks[c] = pairs found by chunk c */
+    int nchunks;        /* chunks in the current query */
+    int chunkssize;     /* allocated chunks */
+    int next;           /* next chunk to be processed */
+    int failed;         /* 1 if a memory allocation failed (set atomically by the workers) */
+    /* thread pool */
+    int nthreads;       /* number of worker threads */
+    pthread_t *threads;
+    pthread_mutex_t mutex;
+    pthread_cond_t start, done;
+    unsigned int generation; /* incremented at each query */
+    int running;        /* workers still running in the current query */
+    int quit;
+} psap_t;
+
+#define Less(a, b) ((a)->min < (b)->min || ((a)->min == (b)->min && (a)->id < (b)->id))
+
+static int Compare(const void *p1, const void *p2)
+    {
+    const sortkey_t *a = (const sortkey_t*)p1, *b = (const sortkey_t*)p2;
+    return Less(a, b) ? -1 : (Less(b, a) ? 1 : 0);
+    }
+
+static void InsertionSort(sortkey_t *keys, int count)
+    {
+    int i, j;
+    sortkey_t key;
+    for(i = 1; i < count; i++)
+        {
+        key = keys[i];
+        for(j = i; j > 0 && Less(&key, &keys[j-1]); j--)
+            keys[j] = keys[j-1];
+        keys[j] = key;
+        }
+    }
+
+/*------------------------------------------------------------------------------*
+ | Parallel sweep                                                               |
+ *------------------------------------------------------------------------------*/
+
+static int ChunkAdd(pairbuf_t *buf, int id1, int id2)
+/* Same as pairbuf_add(), but with malloc() (called by the worker threads) */
+    {
+    int *ids;
+    if(buf->count == buf->size)
+        {
+        int size = buf->size ? 2*buf->size : 256;
+        ids = (int*)realloc(buf->ids, 2*size*sizeof(int));
+        if(!ids) return -1;
+        buf->ids = ids;
+        buf->size = size;
+        }
+    buf->ids[2*buf->count] = id1 < id2 ? id1 : id2;
+    buf->ids[2*buf->count+1] = id1 < id2 ? id2 : id1;
+    buf->count++;
+    return 0;
+    }
+
+static void Sweep(psap_t *psap, int c)
+/* Finds the pairs for the boxes in chunk c */
+    {
+    broadphase_t *bp = psap->bp;
+    pairbuf_t *buf = &psap->chunks[c];
+    const sortkey_t *keys = psap->keys;
+    int k, j, id, end = (c+1)*CHUNK < psap->count ? (c+1)*CHUNK : psap->count;
+    real_t max;
+    buf->count = 0;
+    for(k = c*CHUNK; k < end; k++)
+        {
+        id = keys[k].id;
+        max = bp->aabb[id].max.v[psap->cur];
+        for(j = k+1; j < psap->count && keys[j].min <= max; j++)
+            {
+            if(!aabb_overlap(&bp->aabb[id], &bp->aabb[keys[j].id])) continue;
+            if(!broadphase_accept(bp, id, keys[j].id)) continue;
+            if(ChunkAdd(buf, id, keys[j].id) != 0)
+                { __sync_fetch_and_or(&psap->failed, 1); return; }
+            }
+        }
+    }
+
+static void Work(psap_t *psap)
+/* Processes chunks until there are none left */
+    {
+    int c;
+    while((c = __sync_fetch_and_add(&psap->next, 1)) < psap->nchunks)
+        Sweep(psap, c);
+    }
+
+static void *Worker(void *arg)
+    {
+    psap_t *psap = (psap_t*)arg;
+    unsigned int generation = 0;
+    pthread_mutex_lock(&psap->mutex);
+    for(;;)
+        {
+        while(psap->generation == generation && !psap->quit)
+            pthread_cond_wait(&psap->start, &psap->mutex);
+        if(psap->quit) break;
+        generation = psap->generation;
+        pthread_mutex_unlock(&psap->mutex);
+        Work(psap);
+        pthread_mutex_lock(&psap->mutex);
+        if(--psap->running == 0) pthread_cond_signal(&psap->done);
+        }
+    pthread_mutex_unlock(&psap->mutex);
+    return NULL;
+    }
+
+static void Dispatch(psap_t *psap)
+/* Runs Work() on all the threads, and waits for them to finish */
+    {
+    if(psap->nthreads == 0 || psap->nchunks < 2)
+        { psap->next = 0; Work(psap); return; }
+    pthread_mutex_lock(&psap->mutex);
+    psap->next = 0;
+    psap->running = psap->nthreads;
+    psap->generation++;
+    pthread_cond_broadcast(&psap->start);
+    pthread_mutex_unlock(&psap->mutex);
+    Work(psap);
+    pthread_mutex_lock(&psap->mutex);
+    while(psap->running > 0)
+        pthread_cond_wait(&psap->done, &psap->mutex);
+    pthread_mutex_unlock(&psap->mutex);
+    }
+
+/*------------------------------------------------------------------------------*
+ | Hooks                                                                        |
+ *------------------------------------------------------------------------------*/
+
+static void PsapFree(lua_State *L, broadphase_t *bp)
+    {
+    psap_t *psap = (psap_t*)bp->data;
+    int i;
+    if(psap->nthreads > 0)
+        {
+        pthread_mutex_lock(&psap->mutex);
+        psap->quit = 1;
+        pthread_cond_broadcast(&psap->start);
+        pthread_mutex_unlock(&psap->mutex);
+        for(i = 0; i < psap->nthreads; i++)
+            pthread_join(psap->threads[i], NULL);
+        }
+    if(psap->threads) Free(L, psap->threads);
+    pthread_mutex_destroy(&psap->mutex);
+    pthread_cond_destroy(&psap->start);
+    pthread_cond_destroy(&psap->done);
+    for(i = 0; i < psap->chunkssize; i++)
+        free(psap->chunks[i].ids);
+    if(psap->chunks) Free(L, psap->chunks);
+    if(psap->keys) Free(L, psap->keys);
+    Free(L, psap);
+    }
+
+static void PsapResize(lua_State *L, broadphase_t *bp)
+    {
+    psap_t *psap = (psap_t*)bp->data;
+    psap->keys = Realloc(L, psap->keys, psap->size*sizeof(sortkey_t), bp->size*sizeof(sortkey_t));
+    psap->size = bp->size;
+    }
+
+static void PsapInsert(lua_State *L, broadphase_t *bp, int id)
+    {
+    psap_t *psap = (psap_t*)bp->data;
+    (void)L;
+    psap->keys[psap->count].min = bp->aabb[id].min.v[psap->cur];
+    psap->keys[psap->count++].id = id;
+    psap->unsorted++;
+    }
+
+static void PsapRemove(lua_State *L, broadphase_t *bp, int id)
+    {
+    int i, j;
+    psap_t *psap = (psap_t*)bp->data;
+    (void)L;
+    for(i = 0, j = 0; i < psap->count; i++)
+        {
+        if(psap->keys[i].id != id)
+            psap->keys[j++] = psap->keys[i];
+        }
+    psap->count = j;
+    if(psap->unsorted > psap->count) psap->unsorted = psap->count;
+    }
+
+static void PsapUpdate(lua_State *L, broadphase_t *bp, int id)
+    {
+    (void)L; (void)bp; (void)id; /* the keys are refreshed at the next pairs query */
+    }
+
+static void PsapPairs(lua_State *L, broadphase_t *bp, pairbuf_t *buf)
+    {
+    psap_t *psap = (psap_t*)bp->data;
+    int i, c, resort = psap->unsorted > psap->count/4;
+    pairbuf_t *chunk;
+    if(psap->axis < 0)
+        {
+        i = broadphase_axis(bp);
+        if(i != psap->cur) { psap->cur = i; resort = 1; }
+        }
+    /* refresh the keys and sort them */
+    for(i = 0; i < psap->count; i++)
+        psap->keys[i].min = bp->aabb[psap->keys[i].id].min.v[psap->cur];
+    if(resort)
+        qsort(psap->keys, psap->count, sizeof(sortkey_t), Compare);
+    else
+        InsertionSort(psap->keys, psap->count);
+    psap->unsorted = 0;
+    /* sweep the chunks in parallel */
+    psap->nchunks = (psap->count + CHUNK - 1)/CHUNK;
+    if(psap->nchunks > psap->chunkssize)
+        {
+        psap->chunks = Realloc(L, psap->chunks, psap->chunkssize*sizeof(pairbuf_t), psap->nchunks*sizeof(pairbuf_t));
+        psap->chunkssize = psap->nchunks;
+        }
+    psap->bp = bp;
+    psap->failed = 0;
+    Dispatch(psap);
+    if(psap->failed) { errmemory(L); return; }
+    /* concatenate the results */
+    for(c = 0; c < psap->nchunks; c++)
+        {
+        chunk = &psap->chunks[c];
+        for(i = 0; i < chunk->count; i++)
+            pairbuf_add(L, buf, chunk->ids[2*i], chunk->ids[2*i+1]);
+        }
+    }
+
+static const bpclass_t PsapClass = {
+    "parallel_sap", PsapFree, PsapResize, PsapInsert, PsapRemove, PsapUpdate, PsapPairs, NULL, NULL
+};
+
+/*------------------------------------------------------------------------------*
+ | Constructor                                                                  |
+ *------------------------------------------------------------------------------*/
+
+static int NumCPUs(void)
+    {
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#else
+    return 1;
+#endif
+    }
+
+static int NewPsap(lua_State *L)
+/* bp = ccd.parallel_sap([axis], [threads]) */
+    {
+    psap_t *psap;
+    int i, axis = optaxis(L, 1);
+    lua_Integer nthreads = luaL_optinteger(L, 2, NumCPUs());
+    if(nthreads < 1 || nthreads > THREADS_PER_CPU*NumCPUs()) return argerror(L, 2, ERR_RANGE);
+    psap = Malloc(L, sizeof(psap_t));
+    psap->axis = axis;
+    psap->cur = axis < 0 ? 0 : axis;
+    pthread_mutex_init(&psap->mutex, NULL);
+    pthread_cond_init(&psap->start, NULL);
+    pthread_cond_init(&psap->done, NULL);
+    /* create the object before starting the threads, so that they are joined by
+     * PsapFree() if anything fails from here on */
+    broadphase_new(L, &PsapClass, psap);
+    if(nthreads > 1)
+        {
+        psap->threads = Malloc(L, (nthreads-1)*sizeof(pthread_t));
+        for(i = 0; i < nthreads-1; i++)
+            {
+            if(pthread_create(&psap->threads[i], NULL, Worker, psap) != 0) break;
+            psap->nthreads++;
+            }
+        }
+    return 1;
+    }
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "parallel_sap", NewPsap },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonccd_open_psap(lua_State *L)
+    {
+    luaL_setfuncs(L, Functions, 0);
+    }
+
@@ -0,0 +1,213 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* Sweep and prune broadphase.
+ *
+ * The boxes are projected on the sweep axis, and their endpoints (min and max) are
+ * kept sorted along it. At each pairs query, the endpoints are re-sorted with an
+ * insertion sort, which is close to linear when the objects moved little since the
+ * previous query (temporal coherence), and then swept in order keeping the set of
+ * boxes that contain the sweep position: when a box starts, it is tested against
+ * all the boxes in the set.
+ *
+ * The sweep axis is either fixed, or automatically chosen at each query as the one
+ * along which the centers of the boxes have the largest variance (so that as few
+ * boxes as possible overlap along it). A change of axis causes a full re-sort.
+ */
+
+typedef struct {
+    real_t value;
+    int id;     /* (id << 1) | 1 if this is the max endpoint, (id << 1) if min */
+} endpoint_t;
+
+typedef struct {
+    int axis;           /* sweep axis (0, 1, 2), or -1 for automatic selection */
+    int cur;            /* current sweep axis */
+    endpoint_t *ep;     /* endpoints, sorted along cur */
+    int count;          /* number of endpoints */
+    int size;           /* allocated endpoints */
+    int unsorted;       /* number of endpoints appended since the last sort */
+    int *active;        /* ids of the boxes containing the sweep position */
+    int *where;         /* where[id] = position of id in active */
+} sap_t;
+
+#define Less(a, b) \
+    ((a)->value < (b)->value || ((a)->value == (b)->value && ((a)->id & 1) < ((b)->id & 1)))
+
+static int Compare(const void *a_, const void *b_)
+    {
+    const endpoint_t *a = (const endpoint_t*)a_, *b = (const endpoint_t*)b_;
+    if(Less(a, b)) return -1;
+    if(Less(b, a)) return 1;
+    return 0;
+    }
+
+static void InsertionSort(endpoint_t *ep, int count)
+    {
+    int i, j;
+    endpoint_t e;
+    for(i = 1; i < count; i++)
+        {
+        e = ep[i];
+        for(j = i; j > 0 && Less(&e, &ep[j-1]); j--)
+            ep[j] = ep[j-1];
+        ep[j] = e;
+        }
+    }
+
+/*------------------------------------------------------------------------------*
+ | Hooks                                                                        |
+ *------------------------------------------------------------------------------*/
+
+static void SapFree(lua_State *L, broadphase_t *bp)
+    {
+    sap_t *sap = (sap_t*)bp->data;
+    if(sap->ep) Free(L, sap->ep);
+    if(sap->active) Free(L, sap->active);
+    if(sap->where) Free(L, sap->where);
+    Free(L, sap);
+    }
+
+static void SapResize(lua_State *L, broadphase_t *bp)
+    {
+    sap_t *sap = (sap_t*)bp->data;
+    int size = 2*bp->size;
+    sap->ep = Realloc(L, sap->ep, sap->size*sizeof(endpoint_t), size*sizeof(endpoint_t));
+    sap->active = Realloc(L, sap->active, (sap->size/2+1)*sizeof(int), (bp->size+1)*sizeof(int));
+    sap->where = Realloc(L, sap->where, (sap->size/2+1)*sizeof(int), (bp->size+1)*sizeof(int));
+    sap->size = size;
+    }
+
+static void SapInsert(lua_State *L, broadphase_t *bp, int id)
+    {
+    sap_t *sap = (sap_t*)bp->data;
+    (void)L;
+    sap->ep[sap->count].value = bp->aabb[id].min.v[sap->cur];
+    sap->ep[sap->count++].id = id << 1;
+    sap->ep[sap->count].value = bp->aabb[id].max.v[sap->cur];
+    sap->ep[sap->count++].id = (id << 1) | 1;
+    sap->unsorted += 2;
+    }
+
+static void SapRemove(lua_State *L, broadphase_t *bp, int id)
+    {
+    int i, j;
+    sap_t *sap = (sap_t*)bp->data;
+    (void)L;
+    for(i = 0, j = 0; i < sap->count; i++)
+        {
+        if((sap->ep[i].id >> 1) != id)
+            sap->ep[j++] = sap->ep[i];
+        }
+    sap->count = j;
+    if(sap->unsorted > sap->count) sap->unsorted = sap->count;
+    }
+
+static void SapUpdate(lua_State *L, broadphase_t *bp, int id)
+    {
+    (void)L; (void)bp; (void)id; /* the endpoints are refreshed at the next query */
+    }
+
+static void SapPairs(lua_State *L, broadphase_t *bp, pairbuf_t *buf)
+    {
+    int i, j, id, pos, nactive = 0, resort;
+    sap_t *sap = (sap_t*)bp->data;
+    endpoint_t *ep;
+    if(sap->count == 0) return;
+    resort = sap->unsorted > sap->count/4; /* too many new endpoints for an insertion sort */
+    if(sap->axis < 0)
+        {
+        i = broadphase_axis(bp);
+        if(i != sap->cur) { sap->cur = i; resort = 1; }
+        }
+    /* refresh the endpoints and sort them */
+    for(i = 0; i < sap->count; i++)
+        {
+        ep = &sap->ep[i];
+        id = ep->id >> 1;
+        ep->value = (ep->id & 1) ? bp->aabb[id].max.v[sap->cur] : bp->aabb[id].min.v[sap->cur];
+        }
+    if(resort)
+        qsort(sap->ep, sap->count, sizeof(endpoint_t), Compare);
+    else
+        InsertionSort(sap->ep, sap->count);
+    sap->unsorted = 0;
+    /* sweep */
+    for(i = 0; i < sap->count; i++)
+        {
+        id = sap->ep[i].id >> 1;
+        if(sap->ep[i].id & 1) /* end of box */
+            {
+            pos = sap->where[id];
+            sap->active[pos] = sap->active[--nactive];
+            sap->where[sap->active[pos]] = pos;
+            }
+        else /* start of box */
+            {
+            for(j = 0; j < nactive; j++)
+                {
+                if(aabb_overlap(&bp->aabb[id], &bp->aabb[sap->active[j]]) &&
+                        broadphase_accept(bp, id, sap->active[j]))
+                    pairbuf_add(L, buf, id, sap->active[j]);
+                }
+            sap->where[id] = nactive;
+            sap->active[nactive++] = id;
+            }
+        }
+    }
+
+static const bpclass_t SapClass = {
+    "sap", SapFree, SapResize, SapInsert, SapRemove, SapUpdate, SapPairs, NULL, NULL
+};
+
+/*------------------------------------------------------------------------------*
+ | Constructor                                                                  |
+ *------------------------------------------------------------------------------*/
+
+static int NewSap(lua_State *L)
+/* bp = ccd.sap([axis]), axis = 'x' | 'y' | 'z' | 'auto' (default) */
+    {
+    sap_t *sap;
+    int axis = optaxis(L, 1);
+    sap = Malloc(L, sizeof(sap_t));
+    sap->axis = axis;
+    sap->cur = axis < 0 ? 0 : axis;
+    broadphase_new(L, &SapClass, sap);
+    return 1;
+    }
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "sap", NewSap },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonccd_open_sap(lua_State *L)
+    {
+    luaL_setfuncs(L, Functions, 0);
+    }
+
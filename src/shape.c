@@ -0,0 +1,394 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+
+/* Native shapes, with support and center functions implemented in C.
+ * Each shape is defined in its local frame, and placed in the global frame by its pose.
+ * Shapes can be passed as objects to the collision detection functions, in which case
+ * their native functions are used instead of the callbacks in the ccdpar.
+ */
+
+static const char *KindName[SHAPE_NKINDS+1] = {
+    "sphere", "capsule", "box", "plane", "convex",
+    "user", /* user-defined objects (not shapes) */
+};
+
+const char *shape_kindname(int kind)
+    {
+    return (kind >= 0 && kind <= SHAPE_NKINDS) ? KindName[kind] : "?";
+    }
+
+int shape_kindof(const char *name)
+/* Returns the kind with the given name (SHAPE_NKINDS for 'user'), or -1 if not found */
+    {
+    int kind;
+    for(kind = 0; kind <= SHAPE_NKINDS; kind++)
+        if(strcmp(name, KindName[kind]) == 0) return kind;
+    return -1;
+    }
+
+static int freeshape(lua_State *L, ud_t *ud)
+    {
+    shape_t *shape = (shape_t*)ud->handle;
+    if(!freeuserdata(L, ud, "shape")) return 0;
+    if(shape->points) Free(L, shape->points);
+    Free(L, shape);
+    return 0;
+    }
+
+static shape_t *newshape(lua_State *L, int kind)
+    {
+    ud_t *ud;
+    shape_t *shape = Malloc(L, sizeof(shape_t));
+    shape->kind = kind;
+    shape->version = 1; /* the cached box is not valid yet */
+    filter_default(&shape->filter);
+    ccdQuatSet(&shape->quat, CCD_ZERO, CCD_ZERO, CCD_ZERO, CCD_ONE);
+    ccdQuatSet(&shape->inv, CCD_ZERO, CCD_ZERO, CCD_ZERO, CCD_ONE);
+    ud = newuserdata(L, shape, SHAPE_MT, "shape");
+    ud->parent_ud = NULL;
+    ud->destructor = freeshape;
+    return shape;
+    }
+
+static int NewSphere(lua_State *L)
+    {
+    real_t radius = luaL_checknumber(L, 1);
+    if(radius <= 0) return argerror(L, 1, ERR_VALUE);
+    newshape(L, SHAPE_SPHERE)->radius = radius;
+    return 1;
+    }
+
+static int NewCapsule(lua_State *L)
+    {
+    shape_t *shape;
+    real_t radius = luaL_checknumber(L, 1);
+    real_t half_height = luaL_checknumber(L, 2);
+    if(radius <= 0) return argerror(L, 1, ERR_VALUE);
+    if(half_height < 0) return argerror(L, 2, ERR_VALUE);
+    shape = newshape(L, SHAPE_CAPSULE);
+    shape->radius = radius;
+    shape->half_height = half_height;
+    return 1;
+    }
+
+static int NewBox(lua_State *L)
+    {
+    vec3_t half;
+    checkvec3(L, 1, &half);
+    if(half.v[0] <= 0 || half.v[1] <= 0 || half.v[2] <= 0) return argerror(L, 1, ERR_VALUE);
+    ccdVec3Copy(&newshape(L, SHAPE_BOX)->half, &half);
+    return 1;
+    }
+
+static int NewPlane(lua_State *L)
+    {
+    (void)newshape(L, SHAPE_PLANE);
+    return 1;
+    }
+
+static int NewConvex(lua_State *L)
+    {
+    int i, count, err;
+    shape_t *shape;
+    vec3_t *points = checkvec3list(L, 1, &count, &err);
+    if(!points) return argerror(L, 1, err);
+    shape = newshape(L, SHAPE_CONVEX);
+    shape->points = points;
+    shape->count = count;
+    ccdVec3Set(&shape->centroid, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    for(i = 0; i < count; i++)
+        ccdVec3Add(&shape->centroid, &points[i]);
+    ccdVec3Scale(&shape->centroid, CCD_ONE/count);
+    return 1;
+    }
+
+/*------------------------------------------------------------------------------*
+ | Support and center functions                                                 |
+ *------------------------------------------------------------------------------*/
+
+void shape_local_support(const void *obj, const vec3_t *dir, vec3_t *vec)
+/* Support function in the local frame of the shape */
+    {
+    int i, best;
+    real_t d, maxd;
+    vec3_t n;
+    const shape_t *s = (const shape_t*)obj;
+    switch(s->kind)
+        {
+        case SHAPE_SPHERE:
+            ccdVec3Copy(vec, dir);
+            if(ccdVec3Len2(vec) == CCD_ZERO) ccdVec3Set(vec, CCD_ZERO, CCD_ZERO, CCD_ONE);
+            else ccdVec3Normalize(vec);
+            ccdVec3Scale(vec, s->radius);
+            return;
+        case SHAPE_CAPSULE:
+            ccdVec3Copy(&n, dir);
+            if(ccdVec3Len2(&n) == CCD_ZERO) ccdVec3Set(&n, CCD_ZERO, CCD_ZERO, CCD_ONE);
+            else ccdVec3Normalize(&n);
+            ccdVec3Copy(vec, &n);
+            ccdVec3Scale(vec, s->radius);
+            vec->v[2] += n.v[2] >= CCD_ZERO ? s->half_height : -s->half_height;
+            return;
+        case SHAPE_BOX:
+            for(i = 0; i < 3; i++)
+                vec->v[i] = dir->v[i] >= CCD_ZERO ? s->half.v[i] : -s->half.v[i];
+            return;
+        case SHAPE_PLANE:
+            /* unbounded: this is used only if a kernel is not available, see checkbounded() */
+            ccdVec3Set(vec, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+            return;
+        case SHAPE_CONVEX:
+            best = 0;
+            maxd = ccdVec3Dot(&s->points[0], dir);
+            for(i = 1; i < s->count; i++)
+                {
+                d = ccdVec3Dot(&s->points[i], dir);
+                if(d > maxd) { maxd = d; best = i; }
+                }
+            ccdVec3Copy(vec, &s->points[best]);
+            return;
+        default:
+            ccdVec3Set(vec, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+        }
+    }
+
+void shape_local_center(const void *obj, vec3_t *center)
+    {
+    const shape_t *s = (const shape_t*)obj;
+    if(s->kind == SHAPE_CONVEX)
+        ccdVec3Copy(center, &s->centroid);
+    else
+        ccdVec3Set(center, CCD_ZERO, CCD_ZERO, CCD_ZERO);
+    }
+
+void shape_support(const void *obj, const vec3_t *dir, vec3_t *vec)
+/* Support function in the global frame */
+    {
+    const shape_t *s = (const shape_t*)obj;
+    vec3_t d;
+    ccdVec3Copy(&d, dir);
+    ccdQuatRotVec(&d, &s->inv);
+    shape_local_support(obj, &d, vec);
+    ccdQuatRotVec(vec, &s->quat);
+    ccdVec3Add(vec, &s->pos);
+    }
+
+void shape_center(const void *obj, vec3_t *center)
+    {
+    const shape_t *s = (const shape_t*)obj;
+    shape_local_center(obj, center);
+    ccdQuatRotVec(center, &s->quat);
+    ccdVec3Add(center, &s->pos);
+    }
+
+const void *shape_bind(lua_State *L, int arg, ccd_t *ccd, int which, int local)
+/* If the object at arg is a shape, sets its native functions in ccd as the support and
+ * center functions for object 'which' (1 or 2), and returns the shape. Otherwise leaves
+ * ccd untouched and returns the stack position of the object, as expected by the
+ * callbacks. If local=1, the functions are expressed in the local frame of the shape.
+ */
+    {
+    shape_t *shape = testshape(L, arg, NULL);
+    if(!shape) return (void*)(ptrdiff_t)arg;
+    if(which == 1)
+        {
+        ccd->support1 = local ? shape_local_support : shape_support;
+        ccd->center1 = local ? shape_local_center : shape_center;
+        }
+    else
+        {
+        ccd->support2 = local ? shape_local_support : shape_support;
+        ccd->center2 = local ? shape_local_center : shape_center;
+        }
+    return shape;
+    }
+
+int isshape(const ccd_t *ccd, int which)
+/* Returns 1 if object 'which' (1 or 2) is bound to a shape with global frame functions */
+    {
+    return (which == 1 ? ccd->support1 : ccd->support2) == shape_support;
+    }
+
+void checkbounded(lua_State *L, const ccd_t *ccd, const void *obj1, const void *obj2)
+/* Raises an error if any of the objects is a plane, which has no usable support function */
+    {
+    if((ccd->support1 == shape_support || ccd->support1 == shape_local_support)
+            && ((const shape_t*)obj1)->kind == SHAPE_PLANE)
+        luaL_error(L, "plane shapes are not supported by this query");
+    if((ccd->support2 == shape_support || ccd->support2 == shape_local_support)
+            && ((const shape_t*)obj2)->kind == SHAPE_PLANE)
+        luaL_error(L, "plane shapes are not supported by this query");
+    }
+
+/*------------------------------------------------------------------------------*
+ | Methods                                                                      |
+ *------------------------------------------------------------------------------*/
+
+static int Kind(lua_State *L)
+    {
+    shape_t *shape = checkshape(L, 1, NULL);
+    lua_pushstring(L, KindName[shape->kind]);
+    return 1;
+    }
+
+static int SetPose(lua_State *L)
+    {
+    shape_t *shape = checkshape(L, 1, NULL);
+    checkvec3(L, 2, &shape->pos);
+    checkquat(L, 3, &shape->quat);
+    ccdQuatNormalize(&shape->quat);
+    ccdQuatInvert2(&shape->inv, &shape->quat);
+    shape_touch(shape);
+    shape->asleep = 0; /* moving a shape wakes it up (only dynamic shapes can sleep) */
+    return 0;
+    }
+
+static int Pose(lua_State *L)
+    {
+    shape_t *shape = checkshape(L, 1, NULL);
+    pushvec3(L, &shape->pos);
+    pushquat(L, &shape->quat);
+    return 2;
+    }
+
+static int SetFilter(lua_State *L)
+/* shape:set_filter(category, mask, [group]) */
+    {
+    shape_t *shape = checkshape(L, 1, NULL);
+    checkfilter(L, 2, &shape->filter);
+    return 0;
+    }
+
+static int Filter(lua_State *L)
+    {
+    shape_t *shape = checkshape(L, 1, NULL);
+    return pushfilter(L, &shape->filter);
+    }
+
+static const char *BodyName(int body)
+    {
+    switch(body)
+        {
+        case BODY_DYNAMIC: return "dynamic";
+        case BODY_KINEMATIC: return "kinematic";
+        case BODY_STATIC: return "static";
+        default: return "???";
+        }
+    return "???";
+    }
+
+static int SetBody(lua_State *L)
+/* shape:set_body(kind, [asleep]) */
+    {
+    shape_t *shape = checkshape(L, 1, NULL);
+    const char *s = luaL_checkstring(L, 2);
+    if(strcmp(s, "dynamic") == 0) shape->body = BODY_DYNAMIC;
+    else if(strcmp(s, "kinematic") == 0) shape->body = BODY_KINEMATIC;
+    else if(strcmp(s, "static") == 0) shape->body = BODY_STATIC;
+    else return argerror(L, 2, ERR_VALUE);
+    shape->asleep = shape->body == BODY_DYNAMIC ? optboolean(L, 3, 0) : 0;
+    return 0;
+    }
+
+static int Body(lua_State *L)
+/* kind, asleep = shape:body() */
+    {
+    shape_t *shape = checkshape(L, 1, NULL);
+    lua_pushstring(L, BodyName(shape->body));
+    lua_pushboolean(L, shape->asleep);
+    return 2;
+    }
+
+static int Aabb(lua_State *L)
+    {
+    aabb_t box;
+    shape_t *shape = checkshape(L, 1, NULL);
+    shape_aabb(shape, &box);
+    pushaabb(L, &box);
+    return 2;
+    }
+
+static int Support(lua_State *L)
+    {
+    vec3_t dir, vec;
+    shape_t *shape = checkshape(L, 1, NULL);
+    checkvec3(L, 2, &dir);
+    if(shape->kind == SHAPE_PLANE) return luaL_error(L, "plane shapes have no support function");
+    shape_support(shape, &dir, &vec);
+    pushvec3(L, &vec);
+    return 1;
+    }
+
+static int Center(lua_State *L)
+    {
+    vec3_t center;
+    shape_t *shape = checkshape(L, 1, NULL);
+    shape_center(shape, &center);
+    pushvec3(L, &center);
+    return 1;
+    }
+
+DESTROY_FUNC(shape)
+
+static const struct luaL_Reg Methods[] = 
+    {
+        { "free", Destroy },
+        { "kind", Kind },
+        { "set_pose", SetPose },
+        { "pose", Pose },
+        { "set_filter", SetFilter },
+        { "filter", Filter },
+        { "set_body", SetBody },
+        { "body", Body },
+        { "aabb", Aabb },
+        { "support", Support },
+        { "center", Center },
+        { NULL, NULL } /* sentinel */
+    };
+
+static const struct luaL_Reg MetaMethods[] = 
+    {
+        { "__gc",  Destroy },
+        { NULL, NULL } /* sentinel */
+    };
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "sphere", NewSphere },
+        { "capsule", NewCapsule },
+        { "box", NewBox },
+        { "plane", NewPlane },
+        { "convex", NewConvex },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonccd_open_shape(lua_State *L)
+    {
+    udata_define(L, SHAPE_MT, Methods, MetaMethods);
+    luaL_setfuncs(L, Functions, 0);
+    }
+
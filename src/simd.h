@@ -0,0 +1,55 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef simdDEFINED
+#define simdDEFINED
+
+#include <stdint.h>
+#include "internal.h"
+
+/* SIMD vectors, as GCC vector extensions, so that the same code compiles to SSE2 (the
+ * x86-64 baseline), AVX or AVX-512 depending on the target flags (see SIMD in the
+ * Makefile), and to generic code on other targets.
+ */
+
+#if defined(__AVX512F__)
+#define VBYTES 64
+#elif defined(__AVX__)
+#define VBYTES 32
+#else
+#define VBYTES 16
+#endif
+
+#define LANES ((int)(VBYTES/sizeof(real_t)))
+
+typedef real_t vreal_t __attribute__((vector_size(VBYTES)));
+/* lane masks (all ones or all zeros), as returned by comparisons between vreal_t */
+#ifdef CCD_SINGLE
+typedef int32_t vmask_t __attribute__((vector_size(VBYTES)));
+#else
+typedef int64_t vmask_t __attribute__((vector_size(VBYTES)));
+#endif
+
+#endif /* simdDEFINED */
@@ -89,6 +89,20 @@ void *MallocNoErr(lua_State *L, size_t size) /* do not raise errors (check the r
     return ptr;
     }
 
+void *Realloc(lua_State *L, void *ptr, size_t oldsize, size_t newsize)
+/* Resizes a Malloc()'d block, preserving its contents and zeroing the added part */
+    {
+    void *p;
+    if(newsize == 0)
+        { luaL_error(L, errstring(ERR_MALLOC_ZERO)); return NULL; }
+    p = Alloc ? Alloc(AllocUd, ptr, ptr ? oldsize : 0, newsize) : NULL;
+    if(p==NULL)
+        { luaL_error(L, errstring(ERR_MEMORY)); return NULL; }
+    if(newsize > oldsize)
+        memset((char*)p + oldsize, 0, newsize - oldsize);
+    return p;
+    }
+
 char *Strdup(lua_State *L, const char *s)
     {
     size_t len = strnlen(s, 256);
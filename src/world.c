@@ -0,0 +1,745 @@
+/* The MIT License (MIT)
+ *
+ * Copyright (c) 2021 Stefano Trettel
+ *
+ * Software repository: MoonCCD, https://github.com/stetre/moonccd
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "internal.h"
+#include <limits.h>
+
+/* Collision worlds.
+ *
+ * A world owns a set of native shapes, kept in a broadphase object, and finds all their
+ * contacts in a single step() call: it recomputes the boxes of the shapes from their
+ * current poses, finds the candidate pairs with the broadphase, and runs the narrowphase
+ * on each of them (GJK+EPA, MPR, or the automatic choice, with the parameters of a ccdpar),
+ * collecting the contacts in a buffer.
+ *
+ * The ccdpar and the broadphase are referenced by ref[0] and ref[1], and are looked up at
+ * each step, so that the world never holds dangling pointers to them.
+ *
+ * The world also keeps the last pose version of each shape, so that the boxes of the shapes
+ * that did not move are not updated, and puts to sleep the dynamic shapes that stay within a
+ * small distance and angle from a reference pose for sleep_frames steps. The pairs of idle
+ * shapes (static or sleeping) are skipped by the broadphase. A sleeping shape wakes up
+ * when it is moved beyond the thresholds, or when it touches a moving shape.
+ */
+
+#define CCDPAR 0        /* ref[] index of the ccdpar */
+#define BROADPHASE 1    /* ref[] index of the broadphase */
+
+#define WORLD_GJK   0
+#define WORLD_MPR   1
+#define WORLD_AUTO  2
+
+#define STRIDE 9 /* numbers per contact in the Lua buffer */
+
+#define SLEEP_FRAMES    0       /* default sleep_frames (0 = no automatic sleeping) */
+#define SLEEP_LINEAR    1e-3    /* default sleep_linear */
+#define SLEEP_ANGULAR   1e-3    /* default sleep_angular */
+
+typedef struct {
+    int id1, id2;
+    real_t depth;
+    vec3_t dir, pos;
+} wcontact_t;
+
+typedef struct {
+    const shape_t *shape;   /* the shape this state refers to (NULL = none yet) */
+    unsigned int version;   /* pose version at the last step */
+    const shape_t *boxshape;    /* the shape the box in the broadphase refers to */
+    unsigned int boxversion;    /* its pose version when the box was last updated */
+    vec3_t refpos;          /* reference pose for sleeping */
+    quat_t refquat;
+    int still;              /* number of steps within the thresholds from the reference pose */
+    int moving;             /* 1 if the shape moved beyond the thresholds at the last step */
+} wstate_t;
+
+typedef struct {
+    int algorithm;          /* WORLD_XXX */
+    shape_t **shape;        /* shape[id], refreshed at each step */
+    wstate_t *state;        /* state[id] */
+    int slots;              /* allocated shape[] and state[] entries */
+    int sleep_frames;       /* steps before a still dynamic shape goes to sleep (0 = never) */
+    real_t sleep_linear;    /* distance threshold */
+    real_t sleep_angular;   /* cosine of half the angle threshold */
+    wcontact_t *contacts;   /* contacts found by the last step */
+    int count;              /* number of contacts */
+    int size;               /* allocated contacts */
+    knn_t nn;               /* k nearest neighbors search buffers */
+} world_t;
+
+static int freeworld(lua_State *L, ud_t *ud)
+    {
+    world_t *world = (world_t*)ud->handle;
+    if(!freeuserdata(L, ud, "world")) return 0;
+    if(world->shape) Free(L, world->shape);
+    if(world->state) Free(L, world->state);
+    if(world->contacts) Free(L, world->contacts);
+    knn_release(L, &world->nn);
+    Free(L, world);
+    return 0;
+    }
+
+static broadphase_t *GetBroadphase(lua_State *L, ud_t *ud, ud_t **bpud)
+    {
+    broadphase_t *bp;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[BROADPHASE]);
+    bp = testbroadphase(L, -1, bpud);
+    if(!bp) luaL_error(L, "the broadphase of the world was released");
+    lua_pop(L, 1);
+    return bp;
+    }
+
+static ccd_t *GetCcd(lua_State *L, ud_t *ud, ud_t **ccdud)
+    {
+    ccd_t *ccd;
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[CCDPAR]);
+    ccd = testccd(L, -1, ccdud);
+    if(!ccd) luaL_error(L, "the ccdpar of the world was released");
+    lua_pop(L, 1);
+    return ccd;
+    }
+
+static void AddContact(lua_State *L, world_t *world, int id1, int id2, real_t depth, const vec3_t *dir, const vec3_t *pos)
+    {
+    wcontact_t *contact;
+    if(world->count == world->size)
+        {
+        int size = world->size ? 2*world->size : 64;
+        world->contacts = Realloc(L, world->contacts, world->size*sizeof(wcontact_t), size*sizeof(wcontact_t));
+        world->size = size;
+        }
+    contact = &world->contacts[world->count++];
+    contact->id1 = id1;
+    contact->id2 = id2;
+    contact->depth = depth;
+    ccdVec3Copy(&contact->dir, dir);
+    ccdVec3Copy(&contact->pos, pos);
+    }
+
+static int Moved(const world_t *world, const wstate_t *state, const shape_t *shape)
+/* Returns 1 if the shape moved beyond the thresholds from its reference pose */
+    {
+    real_t dot;
+    if(ccdVec3Dist2(&shape->pos, &state->refpos) > world->sleep_linear*world->sleep_linear) return 1;
+    dot = shape->quat.q[0]*state->refquat.q[0] + shape->quat.q[1]*state->refquat.q[1] +
+          shape->quat.q[2]*state->refquat.q[2] + shape->quat.q[3]*state->refquat.q[3];
+    return CCD_FABS(dot) < world->sleep_angular;
+    }
+
+static void Wake(wstate_t *state, shape_t *shape)
+    {
+    shape->asleep = 0;
+    state->still = 0;
+    ccdVec3Copy(&state->refpos, &shape->pos);
+    ccdQuatCopy(&state->refquat, &shape->quat);
+    }
+
+static void Track(world_t *world, int id)
+/* Updates the sleeping state of the shape with the given id */
+    {
+    shape_t *shape = world->shape[id];
+    wstate_t *state = &world->state[id];
+    int changed;
+    if(state->shape != shape) /* new shape */
+        {
+        state->shape = shape;
+        state->moving = 1;
+        state->version = shape->version;
+        Wake(state, shape);
+        return;
+        }
+    changed = state->version != shape->version;
+    state->version = shape->version;
+    if(shape->body != BODY_DYNAMIC)
+        {
+        shape->asleep = 0;
+        state->moving = changed;
+        return;
+        }
+    state->moving = changed && Moved(world, state, shape);
+    if(state->moving)
+        Wake(state, shape);
+    else if(world->sleep_frames > 0 && !shape->asleep && ++state->still >= world->sleep_frames)
+        shape->asleep = 1;
+    }
+
+static void UpdateBox(lua_State *L, world_t *world, broadphase_t *bp, int id)
+/* Updates the box of the shape with the given id in the broadphase, if its pose
+ * changed since the last update */
+    {
+    shape_t *shape = world->shape[id];
+    wstate_t *state = &world->state[id];
+    aabb_t box;
+    if(state->boxshape == shape && state->boxversion == shape->version) return;
+    state->boxshape = shape;
+    state->boxversion = shape->version;
+    shape_aabb(shape, &box);
+    broadphase_update(L, bp, id, &box);
+    }
+
+static int Collide(world_t *world, autopen_t *autopen, const ccd_t *c, const shape_t *s1, const shape_t *s2,
+            real_t *depth, vec3_t *dir, vec3_t *pos)
+/* Narrowphase for a pair of shapes (same return values as ccdGJKPenetration) */
+    {
+    int rc;
+    if(s1->kind == SHAPE_PLANE && s2->kind == SHAPE_PLANE) return -1;
+#ifdef MOONCCD_VENDORED_LIBCCD
+    arena_reset(); /* libccd frees everything it allocates within each call */
+#endif
+    if(world->algorithm == WORLD_AUTO)
+        return autopen_penetration(autopen, c, s1, s2, depth, dir, pos);
+    rc = kernel_penetration(c, s1, s2, depth, dir, pos);
+    if(rc != KERNEL_NONE) return rc;
+    if(world->algorithm == WORLD_MPR)
+        return ccdMPRPenetration(s1, s2, c, depth, dir, pos);
+    return ccdGJKPenetration(s1, s2, c, depth, dir, pos);
+    }
+
+static int Intersect(world_t *world, const ccd_t *c, const shape_t *s1, const shape_t *s2)
+/* Exact intersection test for a pair of shapes (1 if they intersect, 0 otherwise) */
+    {
+    int rc;
+    real_t depth;
+    vec3_t dir, pos;
+    rc = kernel_penetration(c, s1, s2, &depth, &dir, &pos);
+    if(rc != KERNEL_NONE) return rc == 0;
+    if(s1->kind == SHAPE_PLANE || s2->kind == SHAPE_PLANE) return 0;
+#ifdef MOONCCD_VENDORED_LIBCCD
+    arena_reset();
+#endif
+    if(world->algorithm == WORLD_MPR)
+        return ccdMPRIntersect(s1, s2, c);
+    return ccdGJKIntersect(s1, s2, c);
+    }
+
+/*------------------------------------------------------------------------------*
+ | Methods                                                                      |
+ *------------------------------------------------------------------------------*/
+
+static int Create(lua_State *L)
+/* world = ccd.world(ccdpar, [{broadphase=bp, algorithm='auto'}]) */
+    {
+    ud_t *ud;
+    world_t *world;
+    int i, algorithm = WORLD_AUTO;
+    lua_Integer sleep_frames = SLEEP_FRAMES;
+    double sleep_linear = SLEEP_LINEAR, sleep_angular = SLEEP_ANGULAR;
+    const char *s;
+    checkccd(L, 1, NULL);
+    lua_settop(L, 2);
+    lua_pushnil(L); /* broadphase, at 3 */
+    if(!lua_isnil(L, 2))
+        {
+        if(!lua_istable(L, 2)) return argerror(L, 2, ERR_TABLE);
+        lua_getfield(L, 2, "algorithm");
+        s = luaL_optstring(L, -1, "auto");
+        if(strcmp(s, "gjk") == 0) algorithm = WORLD_GJK;
+        else if(strcmp(s, "mpr") == 0) algorithm = WORLD_MPR;
+        else if(strcmp(s, "auto") != 0) return argerror(L, 2, ERR_VALUE);
+        lua_pop(L, 1);
+        lua_getfield(L, 2, "sleep_frames");
+        sleep_frames = luaL_optinteger(L, -1, SLEEP_FRAMES);
+        lua_pop(L, 1);
+        lua_getfield(L, 2, "sleep_linear");
+        sleep_linear = luaL_optnumber(L, -1, SLEEP_LINEAR);
+        lua_pop(L, 1);
+        lua_getfield(L, 2, "sleep_angular");
+        sleep_angular = luaL_optnumber(L, -1, SLEEP_ANGULAR);
+        lua_pop(L, 1);
+        if(sleep_frames < 0 || sleep_frames > INT_MAX || sleep_linear < 0 || sleep_angular < 0)
+            return argerror(L, 2, ERR_VALUE);
+        lua_getfield(L, 2, "broadphase");
+        if(!lua_isnil(L, -1) && !testbroadphase(L, -1, NULL)) return argerror(L, 2, ERR_TYPE);
+        lua_replace(L, 3);
+        }
+    if(lua_isnil(L, 3))
+        {
+        aabbtree_new(L, CCD_REAL(0.1), CCD_REAL(2.0));
+        lua_replace(L, 3);
+        }
+    world = Malloc(L, sizeof(world_t));
+    world->algorithm = algorithm;
+    world->sleep_frames = (int)sleep_frames;
+    world->sleep_linear = sleep_linear;
+    world->sleep_angular = cos(sleep_angular/2);
+    ud = newuserdata(L, world, WORLD_MT, "world");
+    ud->parent_ud = NULL;
+    ud->destructor = freeworld;
+    for(i=0; i<6; i++) ud->ref[i] = LUA_NOREF;
+    Reference(L, 1, ud->ref[CCDPAR]);
+    Reference(L, 3, ud->ref[BROADPHASE]);
+    return 1;
+    }
+
+static int Add(lua_State *L)
+/* id = world:add(shape) */
+    {
+    ud_t *ud, *bpud;
+    aabb_t box;
+    broadphase_t *bp;
+    shape_t *shape;
+    checkworld(L, 1, &ud);
+    shape = checkshape(L, 2, NULL);
+    bp = GetBroadphase(L, ud, &bpud);
+    shape_aabb(shape, &box);
+    lua_pushinteger(L, broadphase_insert(L, bp, bpud, 2, &box));
+    return 1;
+    }
+
+static int Remove(lua_State *L)
+/* world:remove(id) */
+    {
+    ud_t *ud, *bpud;
+    broadphase_t *bp;
+    checkworld(L, 1, &ud);
+    bp = GetBroadphase(L, ud, &bpud);
+    broadphase_remove(L, bp, bpud, broadphase_checkid(L, bp, 2));
+    return 0;
+    }
+
+static int Object(lua_State *L)
+/* shape = world:object(id) */
+    {
+    ud_t *ud, *bpud;
+    broadphase_t *bp;
+    int id;
+    checkworld(L, 1, &ud);
+    bp = GetBroadphase(L, ud, &bpud);
+    id = broadphase_checkid(L, bp, 2);
+    broadphase_pushobjects(L, bpud);
+    lua_rawgeti(L, -1, id);
+    return 1;
+    }
+
+static int Count(lua_State *L)
+    {
+    ud_t *ud;
+    checkworld(L, 1, &ud);
+    lua_pushinteger(L, GetBroadphase(L, ud, NULL)->count);
+    return 1;
+    }
+
+static int Broadphase(lua_State *L)
+    {
+    ud_t *ud;
+    checkworld(L, 1, &ud);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[BROADPHASE]);
+    return 1;
+    }
+
+static int Ccdpar(lua_State *L)
+    {
+    ud_t *ud;
+    checkworld(L, 1, &ud);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, ud->ref[CCDPAR]);
+    return 1;
+    }
+
+static shape_t **Shapes(lua_State *L, world_t *world, broadphase_t *bp, ud_t *bpud)
+/* Refreshes world->shape[] from the objects table of the broadphase */
+    {
+    int id, objects;
+    if(world->slots < bp->size+1)
+        {
+        world->shape = Realloc(L, world->shape, world->slots*sizeof(shape_t*), (bp->size+1)*sizeof(shape_t*));
+        world->state = Realloc(L, world->state, world->slots*sizeof(wstate_t), (bp->size+1)*sizeof(wstate_t));
+        world->slots = bp->size+1;
+        }
+    broadphase_pushobjects(L, bpud);
+    objects = lua_gettop(L);
+    for(id = 1; id <= bp->size; id++)
+        {
+        if(!bp->used[id]) continue;
+        lua_rawgeti(L, objects, id);
+        world->shape[id] = testshape(L, -1, NULL);
+        if(!world->shape[id]) luaL_error(L, "object %d of the world is not a native shape", id);
+        lua_pop(L, 1);
+        }
+    lua_pop(L, 1);
+    return world->shape;
+    }
+
+static int SetPoses(lua_State *L)
+/* world:set_poses(buffer)
+ * buffer = { pos1x, pos1y, pos1z, rot1w, rot1x, rot1y, rot1z, pos2x, ... } (indexed by id)
+ */
+    {
+    ud_t *ud, *bpud;
+    broadphase_t *bp;
+    shape_t **shape;
+    int id, i, k;
+    real_t v[7];
+    world_t *world = checkworld(L, 1, &ud);
+    if(!lua_istable(L, 2)) return argerror(L, 2, ERR_TABLE);
+    bp = GetBroadphase(L, ud, &bpud);
+    shape = Shapes(L, world, bp, bpud);
+    for(id = 1; id <= bp->size; id++)
+        {
+        if(!bp->used[id]) continue;
+        k = 7*(id-1);
+        for(i = 0; i < 7; i++)
+            {
+            lua_rawgeti(L, 2, k+i+1);
+            if(!lua_isnumber(L, -1)) return luaL_error(L, "missing or invalid pose for object %d", id);
+            v[i] = lua_tonumber(L, -1);
+            lua_pop(L, 1);
+            }
+        ccdVec3Set(&shape[id]->pos, v[0], v[1], v[2]);
+        ccdQuatSet(&shape[id]->quat, v[4], v[5], v[6], v[3]);
+        ccdQuatNormalize(&shape[id]->quat);
+        ccdQuatInvert2(&shape[id]->inv, &shape[id]->quat);
+        shape_touch(shape[id]);
+        }
+    return 0;
+    }
+
+static void PushContacts(lua_State *L, world_t *world, int arg)
+/* Fills the buffer at arg (or a new table, if nil) with the contacts, and pushes it */
+    {
+    int i, k;
+    wcontact_t *contact;
+    if(lua_isnoneornil(L, arg))
+        lua_createtable(L, STRIDE*world->count, 0);
+    else
+        lua_pushvalue(L, arg);
+#define SET(val) do { lua_pushnumber(L, (val)); lua_rawseti(L, -2, ++k); } while(0)
+    for(i = 0, k = 0; i < world->count; i++)
+        {
+        contact = &world->contacts[i];
+        lua_pushinteger(L, contact->id1); lua_rawseti(L, -2, ++k);
+        lua_pushinteger(L, contact->id2); lua_rawseti(L, -2, ++k);
+        SET(contact->depth);
+        SET(contact->dir.v[0]); SET(contact->dir.v[1]); SET(contact->dir.v[2]);
+        SET(contact->pos.v[0]); SET(contact->pos.v[1]); SET(contact->pos.v[2]);
+        }
+#undef SET
+    }
+
+static int Step(lua_State *L)
+/* n, buffer = world:step([buffer]) */
+    {
+    ud_t *ud, *bpud, *ccdud;
+    broadphase_t *bp;
+    shape_t **shape;
+    ccd_t c;
+    int i, id, id1, id2, rc;
+    real_t depth;
+    vec3_t dir, pos;
+    midphase_t *mp;
+    world_t *world = checkworld(L, 1, &ud);
+    if(!lua_isnoneornil(L, 2) && !lua_istable(L, 2)) return argerror(L, 2, ERR_TABLE);
+    memcpy(&c, GetCcd(L, ud, &ccdud), sizeof(ccd_t));
+    mp = &ccdinfo(ccdud)->midphase;
+    c.first_dir = ccdFirstDirDefault;
+    c.support1 = c.support2 = shape_support;
+    c.center1 = c.center2 = shape_center;
+    bp = GetBroadphase(L, ud, &bpud);
+    shape = Shapes(L, world, bp, bpud);
+    /* broadphase (the filters and idle flags are refreshed from the shapes) */
+    for(id = 1; id <= bp->size; id++)
+        {
+        if(!bp->used[id]) continue;
+        broadphase_setfilter(bp, id, &shape[id]->filter);
+        Track(world, id);
+        UpdateBox(L, world, bp, id);
+        broadphase_setidle(bp, id, shape_idle(shape[id]));
+        }
+    broadphase_pairs(L, bp);
+    /* narrowphase (preceded by the midphase cascade, if enabled in the ccdpar) */
+    world->count = 0;
+    for(i = 0; i < bp->pairs.count; i++)
+        {
+        id1 = bp->pairs.ids[2*i];
+        id2 = bp->pairs.ids[2*i+1];
+        if(mp->enabled && shape[id1]->kind != SHAPE_PLANE && shape[id2]->kind != SHAPE_PLANE
+                && midphase_reject(L, mp, shape[id1], shape[id2]))
+            continue;
+        rc = Collide(world, &ccdinfo(ccdud)->autopen, &c, shape[id1], shape[id2], &depth, &dir, &pos);
+        if(rc == 0) AddContact(L, world, id1, id2, depth, &dir, &pos);
+        else if(rc == -2) return errmemory(L);
+        }
+    /* wake up the sleeping shapes that touch moving ones */
+    for(i = 0; i < world->count; i++)
+        {
+        id1 = world->contacts[i].id1;
+        id2 = world->contacts[i].id2;
+        if(shape[id1]->asleep && world->state[id2].moving)
+            Wake(&world->state[id1], shape[id1]);
+        else if(shape[id2]->asleep && world->state[id1].moving)
+            Wake(&world->state[id2], shape[id2]);
+        }
+    lua_pushinteger(L, world->count);
+    PushContacts(L, world, 2);
+    return 2;
+    }
+
+static broadphase_t *Prepare(lua_State *L, ud_t *ud, world_t *world, ccd_t *c)
+/* Prepares for a query: sets the ccd_t for native shapes, refreshes world->shape[], and
+ * brings the boxes of the shapes moved since the last step up to date */
+    {
+    int id;
+    ud_t *bpud;
+    broadphase_t *bp;
+    memcpy(c, GetCcd(L, ud, NULL), sizeof(ccd_t));
+    c->first_dir = ccdFirstDirDefault;
+    c->support1 = c->support2 = shape_support;
+    c->center1 = c->center2 = shape_center;
+    bp = GetBroadphase(L, ud, &bpud);
+    (void)Shapes(L, world, bp, bpud);
+    for(id = 1; id <= bp->size; id++)
+        if(bp->used[id]) UpdateBox(L, world, bp, id);
+    return bp;
+    }
+
+static int Query(lua_State *L, ud_t *ud, world_t *world, shape_t *region, int filtered, int arg)
+/* Finds the ids of the shapes that overlap the region, and pushes their number and the
+ * buffer at arg (or a new table, if nil) filled with them. The candidates are those whose
+ * boxes overlap the box of the region in the broadphase, and they are confirmed by an
+ * exact intersection test (closed-form kernel, or GJK or MPR as in the narrowphase).
+ */
+    {
+    broadphase_t *bp;
+    shape_t **shape;
+    ccd_t c;
+    aabb_t box;
+    int i, id, n = 0;
+    bp = Prepare(L, ud, world, &c);
+    shape = world->shape;
+    shape_aabb(region, &box);
+    broadphase_query(L, bp, &box);
+    if(lua_isnoneornil(L, arg))
+        lua_createtable(L, bp->hits.count, 0);
+    else
+        lua_pushvalue(L, arg);
+    for(i = 0; i < bp->hits.count; i++)
+        {
+        id = bp->hits.ids[i];
+        if(shape[id] == region) continue;
+        if(filtered && !filter_accept(&region->filter, &shape[id]->filter)) continue;
+        if(!Intersect(world, &c, region, shape[id])) continue;
+        lua_pushinteger(L, id);
+        lua_rawseti(L, -2, ++n);
+        }
+    lua_pushinteger(L, n);
+    lua_insert(L, -2);
+    return 2;
+    }
+
+static void TempShape(shape_t *shape, int kind)
+/* Initializes a shape for a region query (not a Lua object) */
+    {
+    memset(shape, 0, sizeof(shape_t));
+    shape->kind = kind;
+    shape->version = 1;
+    filter_default(&shape->filter);
+    ccdQuatSet(&shape->quat, CCD_ZERO, CCD_ZERO, CCD_ZERO, CCD_ONE);
+    ccdQuatSet(&shape->inv, CCD_ZERO, CCD_ZERO, CCD_ZERO, CCD_ONE);
+    }
+
+static int Overlap(lua_State *L)
+/* n, ids = world:overlap(shape, [ids]) */
+    {
+    ud_t *ud;
+    world_t *world = checkworld(L, 1, &ud);
+    shape_t *region = checkshape(L, 2, NULL);
+    if(!lua_isnoneornil(L, 3) && !lua_istable(L, 3)) return argerror(L, 3, ERR_TABLE);
+    return Query(L, ud, world, region, 1, 3);
+    }
+
+static int OverlapBox(lua_State *L)
+/* n, ids = world:overlap_box(min, max, [ids]) */
+    {
+    ud_t *ud;
+    aabb_t box;
+    shape_t region;
+    world_t *world = checkworld(L, 1, &ud);
+    checkaabb(L, 2, &box);
+    if(!lua_isnoneornil(L, 4) && !lua_istable(L, 4)) return argerror(L, 4, ERR_TABLE);
+    TempShape(&region, SHAPE_BOX);
+    ccdVec3Copy(&region.pos, &box.min);
+    ccdVec3Add(&region.pos, &box.max);
+    ccdVec3Scale(&region.pos, CCD_REAL(0.5));
+    ccdVec3Sub2(&region.half, &box.max, &box.min);
+    ccdVec3Scale(&region.half, CCD_REAL(0.5));
+    return Query(L, ud, world, &region, 0, 4);
+    }
+
+static int OverlapSphere(lua_State *L)
+/* n, ids = world:overlap_sphere(center, radius, [ids]) */
+    {
+    ud_t *ud;
+    shape_t region;
+    world_t *world = checkworld(L, 1, &ud);
+    TempShape(&region, SHAPE_SPHERE);
+    checkvec3(L, 2, &region.pos);
+    region.radius = luaL_checknumber(L, 3);
+    if(region.radius < 0) return argerror(L, 3, ERR_VALUE);
+    if(!lua_isnoneornil(L, 4) && !lua_istable(L, 4)) return argerror(L, 4, ERR_TABLE);
+    return Query(L, ud, world, &region, 0, 4);
+    }
+
+typedef struct {
+    world_t *world;
+    ccd_t c;
+    shape_t *query;     /* query shape */
+    int filtered;       /* 1 if the filter of the query shape is to be applied */
+} wquery_t;
+
+static real_t Distance(void *data, int id, real_t bound)
+/* Exact distance from the query shape to the shape id (see knn_t) */
+    {
+    wquery_t *q = (wquery_t*)data;
+    shape_t *shape = q->world->shape[id];
+    gjk_simplex_t s;
+    real_t dist;
+    if(shape == q->query || shape->kind == SHAPE_PLANE) return -CCD_ONE;
+    if(q->filtered && !filter_accept(&q->query->filter, &shape->filter)) return -CCD_ONE;
+    s.count = 0;
+    if(bound < CCD_REAL_MAX)
+        {
+        /* stop as soon as it is known to be farther than bound, otherwise go on from
+         * where this left off, to compute the exact distance */
+        if(gjk_distance(q->query, shape, &q->c, &s, bound, &dist, NULL) == 1) return CCD_ZERO;
+        if(dist > bound) return dist;
+        }
+    if(gjk_distance(q->query, shape, &q->c, &s, -CCD_ONE, &dist, NULL) == 1) return CCD_ZERO;
+    return dist;
+    }
+
+static void PushBuffer(lua_State *L, int arg, int n, const int *ids, const real_t *dist)
+/* Fills the buffer at arg (or a new table, if nil) with the n ids or distances, and pushes it */
+    {
+    int i;
+    if(lua_isnoneornil(L, arg))
+        lua_createtable(L, n, 0);
+    else
+        lua_pushvalue(L, arg);
+    for(i = 0; i < n; i++)
+        {
+        if(ids) lua_pushinteger(L, ids[i]); else lua_pushnumber(L, dist[i]);
+        lua_rawseti(L, -2, i+1);
+        }
+    }
+
+static int Nearest(lua_State *L)
+/* n, ids, dists = world:nearest(shape|point, k, [maxdist], [ids], [dists]) */
+    {
+    ud_t *ud;
+    broadphase_t *bp;
+    wquery_t q;
+    shape_t point;
+    knn_t *nn;
+    lua_Integer k;
+    real_t maxdist;
+    world_t *world = checkworld(L, 1, &ud);
+    q.world = world;
+    q.query = testshape(L, 2, NULL);
+    q.filtered = q.query != NULL;
+    if(!q.query)
+        {
+        TempShape(&point, SHAPE_SPHERE); /* a sphere with zero radius */
+        checkvec3(L, 2, &point.pos);
+        q.query = &point;
+        }
+    else if(q.query->kind == SHAPE_PLANE)
+        return argerror(L, 2, ERR_TYPE);
+    k = luaL_checkinteger(L, 3);
+    if(k < 1) return argerror(L, 3, ERR_VALUE);
+    maxdist = luaL_optnumber(L, 4, CCD_REAL_MAX);
+    if(maxdist < 0) return argerror(L, 4, ERR_VALUE);
+    if(!lua_isnoneornil(L, 5) && !lua_istable(L, 5)) return argerror(L, 5, ERR_TABLE);
+    if(!lua_isnoneornil(L, 6) && !lua_istable(L, 6)) return argerror(L, 6, ERR_TABLE);
+    bp = Prepare(L, ud, world, &q.c);
+    nn = &world->nn;
+    nn->count = 0;
+    if(bp->count > 0)
+        {
+        shape_aabb(q.query, &nn->box);
+        nn->k = k < bp->count ? k : bp->count;
+        nn->maxdist = maxdist;
+        nn->distance = Distance;
+        nn->data = &q;
+        broadphase_nearest(L, bp, nn);
+        }
+    lua_pushinteger(L, nn->count);
+    PushBuffer(L, 5, nn->count, nn->ids, NULL);
+    PushBuffer(L, 6, nn->count, NULL, nn->dist);
+    return 3;
+    }
+
+static int Contact(lua_State *L)
+/* id1, id2, depth, dir, pos = world:contact(i) */
+    {
+    world_t *world = checkworld(L, 1, NULL);
+    lua_Integer i = luaL_checkinteger(L, 2);
+    wcontact_t *contact;
+    if(i < 1 || i > world->count) return argerror(L, 2, ERR_VALUE);
+    contact = &world->contacts[i-1];
+    lua_pushinteger(L, contact->id1);
+    lua_pushinteger(L, contact->id2);
+    lua_pushnumber(L, contact->depth);
+    pushvec3(L, &contact->dir);
+    pushvec3(L, &contact->pos);
+    return 5;
+    }
+
+DESTROY_FUNC(world)
+
+static const struct luaL_Reg Methods[] = 
+    {
+        { "free", Destroy },
+        { "add", Add },
+        { "remove", Remove },
+        { "object", Object },
+        { "count", Count },
+        { "broadphase", Broadphase },
+        { "ccdpar", Ccdpar },
+        { "set_poses", SetPoses },
+        { "step", Step },
+        { "contact", Contact },
+        { "overlap", Overlap },
+        { "overlap_box", OverlapBox },
+        { "overlap_sphere", OverlapSphere },
+        { "nearest", Nearest },
+        { NULL, NULL } /* sentinel */
+    };
+
+static const struct luaL_Reg MetaMethods[] = 
+    {
+        { "__gc",  Destroy },
+        { NULL, NULL } /* sentinel */
+    };
+
+static const struct luaL_Reg Functions[] = 
+    {
+        { "world", Create },
+        { NULL, NULL } /* sentinel */
+    };
+
+void moonccd_open_world(lua_State *L)
+    {
+    udata_define(L, WORLD_MT, Methods, MetaMethods);
+    luaL_setfuncs(L, Functions, 0);
+    }
+